@@ -0,0 +1,58 @@
+#ifndef __OPENNI_INCLUDE_BUFFERPOOL_HPP__
+#define __OPENNI_INCLUDE_BUFFERPOOL_HPP__
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <cstdlib>
+
+#include "types.hpp"
+
+//!
+//! Free list of frame buffers handed out as shared pointers. The deleter
+//! of a buffer puts it back on the free list once its last reference is
+//! dropped, on whichever thread that is. The list is guarded by a mutex,
+//! so everything the last holder did to the buffer happens before it is
+//! handed out again. Buffers released after the pool was destroyed are
+//! freed.
+//!
+template <typename T> class BufferPool {
+  typedef std::vector<T> Buffer;
+  struct FreeList {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer> > buffers;
+  };
+  std::shared_ptr<FreeList> m_pFree;
+
+public:
+  BufferPool()
+    : m_pFree(std::make_shared<FreeList>())
+  {};
+
+  //! Buffer of size elements, a released one if there is any.
+  std::shared_ptr<Buffer> get(size_t size) {
+    std::unique_ptr<Buffer> pBuffer;
+    {
+      std::lock_guard<std::mutex> _(m_pFree->mutex);
+      if (!m_pFree->buffers.empty()) {
+	pBuffer = std::move(m_pFree->buffers.back());
+	m_pFree->buffers.pop_back();
+      }
+    }
+    if (!pBuffer)
+      pBuffer.reset(new Buffer());
+    pBuffer->resize(size);
+    std::weak_ptr<FreeList> pFree = m_pFree;
+    return std::shared_ptr<Buffer>(pBuffer.release(), [pFree](Buffer* p){
+	std::unique_ptr<Buffer> pBuffer(p);
+	std::shared_ptr<FreeList> pList = pFree.lock();
+	if (!pList)
+	  return;
+	std::lock_guard<std::mutex> _(pList->mutex);
+	pList->buffers.push_back(std::move(pBuffer));
+      });
+  };
+};
+
+#endif
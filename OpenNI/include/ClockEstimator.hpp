@@ -0,0 +1,53 @@
+#ifndef __OPENNI_INCLUDE_CLOCKESTIMATOR_HPP__
+#define __OPENNI_INCLUDE_CLOCKESTIMATOR_HPP__
+
+#include <mutex>
+#include <cstdint>
+
+#include "types.hpp"
+
+#define CLOCK_BLOCK_SIZE 60   // Samples per block of the drift estimate
+#define CLOCK_MAX_DRIFT  1e-3 // Larger drifts are clamped [us/us]
+
+//!
+//! Maps device timestamps to the steady host clock (getSteadyTimestamp).
+//! A frame can only arrive after it was captured, so the offset host time
+//! minus device time is the true clock offset plus a non-negative delay.
+//! The estimator keeps the lower envelope of the offsets: a line through
+//! the minimum offsets of consecutive blocks of samples, lowered at once
+//! whenever a frame arrives earlier than the line predicts.
+//!
+class ClockEstimator {
+  mutable std::mutex m_mutex;
+  bool     m_bValid;
+  uint64_t m_lastDevice;
+  // Model: offset(device) = m_offset + m_drift * (device - m_anchor)
+  uint64_t m_anchor;
+  int64_t  m_offset;
+  double   m_drift;
+  // Minimum offset of the previous and the current block
+  bool     m_bPrevBlock;
+  uint64_t m_prevDevice, m_blockDevice;
+  int64_t  m_prevOffset, m_blockOffset;
+  uint     m_nBlock;
+
+  void clear();
+  double getOffset(uint64_t device) const;
+
+public:
+  ClockEstimator();
+
+  void reset();
+  //! Add a frame captured at device time and received at host time [us].
+  //! Device time going backwards (e.g. a restarted stream) resets.
+  void update(uint64_t device, uint64_t host);
+
+  //! True once update() was called.
+  bool isValid() const;
+  //! Host time [us] at which the device clock read device. 0 if not valid.
+  uint64_t toHost(uint64_t device) const;
+  //! Drift of the host clock against the device clock [us/us].
+  double getDrift() const;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __OPENNI_INCLUDE_DEPTHCODEC_HPP__
+#define __OPENNI_INCLUDE_DEPTHCODEC_HPP__
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+class ThreadPool;
+
+#define DEPTH_CODEC_BAND_HEIGHT 32 // [rows]
+#define DEPTH_CODEC_LEVEL        1 // zlib compression level
+
+//!
+//! Lossless codec for 16 bit depth/IR frames (CODEC_DEPTH_RLZ).
+//!
+//! The frame is cut into bands of DEPTH_CODEC_BAND_HEIGHT rows which are
+//! coded independently, so bands are encoded and decoded in parallel on a
+//! ThreadPool. In each band:
+//!  1. Runs of invalid (zero) pixels become a run-length token.
+//!  2. Every other pixel is predicted from the previous valid pixel of the
+//!     row and the pixel above, and the zigzag-coded difference is stored
+//!     in 1, 2 or 3 bytes.
+//!  3. The token bytes are entropy coded with zlib.
+//!
+//! Payload layout: uint32_t bandHeight, uint32_t nBands,
+//! uint32_t bandSize x nBands, then the bands. Each band is a uint32_t
+//! token size followed by the zlib stream of its tokens.
+//!
+class DepthCodec {
+  ThreadPool* m_pPool;
+  int m_level;
+  std::vector<std::vector<uint8_t> > m_tokens;
+  std::vector<std::vector<uint8_t> > m_bands;
+
+public:
+  //! @param pool  Pool to code bands on. NULL runs on the calling thread.
+  //! @param level zlib compression level (1: fastest, 9: smallest).
+  DepthCodec(ThreadPool* pool=NULL, int level=DEPTH_CODEC_LEVEL);
+
+  //!
+  //! Encode one frame and store the payload in dst.
+  //! @param stride Size of one source row in byte. 0 means width * 2.
+  //!
+  void encode(const uint16_t* pSrc, uint width, uint height,
+	      std::vector<uint8_t>& dst, uint stride=0);
+
+  //! Decode a payload made by encode() into a width x height frame.
+  void decode(const void* pSrc, size_t size,
+	      uint16_t* pDst, uint width, uint height) const;
+};
+
+#endif
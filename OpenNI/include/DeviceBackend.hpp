@@ -0,0 +1,120 @@
+#ifndef __OPENNI_INCLUDE_DEVICEBACKEND_HPP__
+#define __OPENNI_INCLUDE_DEVICEBACKEND_HPP__
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include "types.hpp"
+#include "FrameView.hpp"
+#include "OpenNI2/OpenNI.h"
+
+//! Called by a stream backend for every new frame, on a backend thread.
+typedef std::function<void(const FrameView&)> FrameCallback;
+
+//!
+//! One video stream of a DeviceBackend. Streamer receives the frames.
+//!
+class StreamBackend {
+public:
+  virtual ~StreamBackend() {};
+  virtual uint getWidth() const = 0;
+  virtual uint getHeight() const = 0;
+  virtual openni::PixelFormat getPixelFormat() const = 0;
+  virtual int getMinValue() const = 0;
+  virtual int getMaxValue() const = 0;
+  //! Deliver frames to callback until stop().
+  virtual void start(const FrameCallback& callback) = 0;
+  //! No callback is running or made once stop() returns.
+  virtual void stop() = 0;
+};
+
+//!
+//! Source of the streams of NIDevice: an OpenNI device, a recording played
+//! back, or a synthetic scene. Selected by the URI given to openDevice().
+//!
+class DeviceBackend {
+public:
+  virtual ~DeviceBackend() {};
+  virtual bool hasSensor(openni::SensorType type) = 0;
+  virtual void printSensorModes(openni::SensorType type) = 0;
+  virtual std::unique_ptr<StreamBackend>
+  createStream(openni::SensorType type, int mode, bool mirroring) = 0;
+  //! @throw RuntimeError if the device can not register depth to color.
+  virtual void setImageRegistration(bool enable) = 0;
+  virtual void setDepthColorSync(bool enable) = 0;
+};
+
+//!
+//! Device URI split into scheme://path?key=value&key=value.
+//! The scheme is empty for plain OpenNI URIs.
+//!
+struct DeviceURI {
+  std::string scheme;
+  std::string path;
+  std::map<std::string, std::string> params;
+
+  DeviceURI(const char* uri);
+  std::string get(const std::string& key, const std::string& value) const;
+  double get(const std::string& key, double value) const;
+};
+
+//!
+//! Open the backend selected by the URI scheme.
+//!   replay://PATH[?speed=S&loop=0|1]  ReplayBackend
+//!   synthetic://[WxH@FPS]             SyntheticBackend
+//!   anything else, or NULL            OpenNIBackend (NULL: any device)
+//!
+std::unique_ptr<DeviceBackend> openDeviceBackend(const char* uri);
+
+//!
+//! Base of backends which produce the frames of all streams on one thread
+//! of their own. run() is restarted whenever a stream starts and must
+//! return soon after isStopping() becomes true.
+//!
+class ThreadedDeviceBackend : public DeviceBackend {
+  class Stream;
+
+  std::mutex m_mutex;
+  FrameCallback m_callbacks[3];
+  uint m_nStarted;
+  std::thread m_thread;
+  std::atomic<bool> m_bStop;
+  std::mutex m_sleepMutex;
+  std::condition_variable m_sleepCond;
+
+  void startStream(openni::SensorType type, const FrameCallback& callback);
+  void stopStream(openni::SensorType type);
+
+protected:
+  //! Produce frames with deliver() until isStopping().
+  virtual void run() = 0;
+  bool isStopping() const;
+  //! Sleep until time. Return false at once if the thread is stopping.
+  bool sleepUntil(std::chrono::steady_clock::time_point time);
+  //! Hand frame to the stream of type if it is started.
+  void deliver(openni::SensorType type, const FrameView& frame);
+  bool isStreamStarted(openni::SensorType type);
+  //! Stop the thread. Must be called by destructors of derived classes.
+  void stopThread();
+
+  //! Stream of the given format. The device keeps the frames coming.
+  std::unique_ptr<StreamBackend>
+  createThreadedStream(openni::SensorType type, uint width, uint height,
+		       openni::PixelFormat format, int minValue, int maxValue);
+
+public:
+  ThreadedDeviceBackend();
+  virtual ~ThreadedDeviceBackend();
+
+  void setImageRegistration(bool enable) override;
+  void setDepthColorSync(bool enable) override;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __OPENNI_INCLUDE_DEVICEGROUP_HPP__
+#define __OPENNI_INCLUDE_DEVICEGROUP_HPP__
+
+#include <memory>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "types.hpp"
+#include "FrameView.hpp"
+#include "NIDevice.hpp"
+
+// Alignment tolerance until the frame periods are measured [us]
+#define DEFAULT_GROUP_TOLERANCE 16667
+
+//! Latest frames of one device of a FrameSet.
+struct DeviceFrames {
+  //! Indexed by openni::SensorType - 1, invalid if the sensor is not
+  //! streaming.
+  FrameView frames[3];
+  //! Host time [us] (NIDevice::toHostTime) of the reference frame.
+  uint64_t hostTimestamp;
+  //! Sequence number of the reference frame.
+  uint64_t sequence;
+};
+
+//! Frames of all devices of a DeviceGroup, captured at about the same time.
+struct FrameSet {
+  std::vector<DeviceFrames> devices;
+
+  const FrameView& get(uint iDevice, openni::SensorType type) const;
+  //! Latest minus earliest host time of the reference frames [us].
+  uint64_t getSpread() const;
+};
+
+//!
+//! Several devices captured together, e.g. a rig of sensors. Every device
+//! is an NIDevice with streams running on their own backend threads.
+//! Opening, creating, starting and stopping are done on all devices in
+//! parallel, since each may take a second with OpenNI devices.
+//!
+//! The device clocks are unrelated, so frames are aligned on the host
+//! clock: the device timestamp of the reference stream of each device
+//! (depth, else color, else IR) is mapped with NIDevice::toHostTime().
+//! waitForFrameSet() takes the latest frames of all devices, and waits for
+//! the next frame of every device which lags the newest one by more than
+//! the tolerance, until all of them are aligned.
+//! Any URI of openDeviceBackend() works, e.g. replay:// for tests.
+//!
+class DeviceGroup {
+  std::vector<std::string> m_uris;
+  std::vector<std::unique_ptr<NIDevice> > m_devices;
+  std::vector<openni::SensorType> m_references;
+  std::vector<uint64_t> m_lastSequences;
+  uint64_t m_tolerance;
+
+  //! Call fcn(i, device i) on a thread per device. Rethrow the first
+  //! exception.
+  void forEachDevice(const std::function<void(uint, NIDevice&)>& fcn);
+  uint64_t getTolerance() const;
+  //!
+  //! Take the latest frames of device i once its reference stream has a
+  //! frame newer than sequence.
+  //! @return false if timeout expired.
+  //!
+  bool takeFrames(uint i, uint64_t sequence, std::chrono::milliseconds timeout,
+		  DeviceFrames& dst);
+
+public:
+  DeviceGroup();
+  ~DeviceGroup();
+
+  //!
+  //! Open the devices at uris concurrently.
+  //! @param uris Empty: all attached OpenNI devices (enumerateDevices()).
+  //! @throw RuntimeError if there is no device or one fails to open.
+  //!
+  void open(const std::vector<std::string>& uris=std::vector<std::string>());
+  uint getNumDevices() const;
+  const std::string& getURI(uint i) const;
+  //! Device i, e.g. to set up its streams one by one.
+  NIDevice& getDevice(uint i);
+
+  //! Create the stream on every device.
+  void createStream(const openni::SensorType type, const int mode=0,
+		    bool mirroring=false);
+  //! NIDevice::setImageRegistrationMode() of every device.
+  void setImageRegistrationMode(const RegistrationMode mode);
+  //! NIDevice::setDepthColorSync() of every device.
+  void setDepthColorSync(const bool enable=true);
+  //!
+  //! Start the streams of every device and wait for their first frames.
+  //! @throw RuntimeError if a device has no streams or times out.
+  //!
+  void startStreams(std::chrono::milliseconds timeout=
+		    std::chrono::milliseconds(READY_TIMEOUT));
+  void stopStreams();
+
+  //!
+  //! Largest difference of the host times of the frames of a set [us].
+  //! 0 (default): half the longest frame period of the reference streams.
+  //!
+  void setTolerance(uint64_t tolerance);
+  //!
+  //! Wait for the next set of aligned frames, each newer than the ones of
+  //! the previous set.
+  //! @return false if timeout expired.
+  //!
+  bool waitForFrameSet(FrameSet& set, std::chrono::milliseconds timeout=
+		       std::chrono::milliseconds(WAIT_TIMEOUT));
+
+  //! NIDevice::printStreamStats() of every device.
+  void printStreamStats();
+};
+
+#endif
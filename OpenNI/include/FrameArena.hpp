@@ -0,0 +1,77 @@
+#ifndef __OPENNI_INCLUDE_FRAMEARENA_HPP__
+#define __OPENNI_INCLUDE_FRAMEARENA_HPP__
+
+#include <mutex>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+#define ARENA_ALIGNMENT 64         // Cache line, and any SIMD load [byte]
+#define HUGE_PAGE_SIZE  (2 << 20)  // [byte]
+
+//! Options of the memory of a FrameArena.
+enum ArenaFlag {
+  ARENA_HUGE_PAGES = 1, // Back with huge pages if the system allows
+  ARENA_PREFAULT   = 2, // Fault every page in when reserved
+};
+
+//!
+//! Memory for frame buffers, mapped at once and carved into blocks.
+//! Blocks are ARENA_ALIGNMENT aligned. Released blocks go to a free list
+//! and are handed out again for blocks of up to their size, so
+//! reallocating frames of the same size, e.g. when streams restart,
+//! neither calls the system allocator nor faults in pages.
+//!
+//! With ARENA_HUGE_PAGES the memory is mapped with MAP_HUGETLB if huge
+//! pages are reserved, else transparent huge pages are requested with
+//! madvise, on Linux. With ARENA_PREFAULT every page is faulted in by
+//! reserve(), so a ring of frames does not fault while it is filled
+//! during capture. Without it the memory is only reserved virtually and
+//! pages are faulted in as they are first written, so an arena can be
+//! larger than the memory a short capture ever touches.
+//! @note Thread safe.
+//!
+class FrameArena {
+  struct Block;
+
+  std::mutex m_mutex;
+  uint8_t* m_pData;
+  size_t m_capacity, m_used;
+  bool m_bHugePages;
+  Block* m_pFree;
+
+public:
+  FrameArena();
+  //! @see reserve()
+  FrameArena(size_t capacity, uint flags=0);
+  //! @note Blocks must not be used any more.
+  ~FrameArena();
+
+  //!
+  //! Map capacity bytes, dropping every block.
+  //! @param flags ArenaFlag values or-ed.
+  //! @throw RuntimeError if the memory can not be mapped.
+  //!
+  void reserve(size_t capacity, uint flags=0);
+  void release();
+
+  //!
+  //! Take a block of size byte.
+  //! @throw RuntimeError if the arena is full.
+  //!
+  void* allocate(size_t size);
+  //! Return a block taken from this arena. NULL is ignored.
+  void deallocate(void* pBlock);
+
+  //! Arena bytes a block of size byte takes, for capacity planning.
+  static size_t getBlockSize(size_t size);
+  size_t getCapacity() const;
+  //! Bytes carved out so far, whether or not released.
+  size_t getUsed() const;
+  //! Whether MAP_HUGETLB or transparent huge pages are in use.
+  bool hasHugePages() const;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __OPENNI_INCLUDE_FRAMENOTIFIER_HPP__
+#define __OPENNI_INCLUDE_FRAMENOTIFIER_HPP__
+
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include "types.hpp"
+
+//!
+//! Wakes up threads waiting for new frames. notify() is called from the
+//! driver callback or a pipeline stage; it only takes the mutex for the
+//! instant waiters need to check their condition, so it does not block on
+//! consumers.
+//!
+class FrameNotifier {
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+public:
+  FrameNotifier();
+  ~FrameNotifier();
+  void notify();
+  //! Wait until pred() returns true or timeout expires. Return pred().
+  template <typename Pred> bool waitFor(Pred pred,
+					std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_cond.wait_for(lock, timeout, pred);
+  };
+  //! Wait until pred() returns true.
+  template <typename Pred> void wait(Pred pred) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, pred);
+  };
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __OPENNI_INCLUDE_FRAMERECORDER_HPP__
+#define __OPENNI_INCLUDE_FRAMERECORDER_HPP__
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+
+#include "types.hpp"
+#include "FrameView.hpp"
+#include "Recording.hpp"
+#include "SPSCQueue.hpp"
+#include "DepthCodec.hpp"
+#include "ThreadPool.hpp"
+
+#define DEFAULT_QUEUE_SIZE 64 // [frames]
+
+//!
+//! Streams captured frames to a recording file through two pipeline stages,
+//! each on its own thread:
+//!
+//!   push() --> encode --> write --+
+//!     ^                           |
+//!     +------- free slots --------+
+//!
+//! push() copies a frame into one of a fixed pool of slots allocated by
+//! open(), so memory use does not depend on the length of the recording.
+//! The encode stage compresses streams whose StreamInfo::codec is
+//! CODEC_DEPTH_RLZ with the help of an own ThreadPool, and the write stage
+//! appends them to the file. Stages are connected by SPSCQueues, so a slow
+//! disk does not stall encoding and vice versa.
+//! When all slots are in use, push() waits (BACKPRESSURE_BLOCK, default) or
+//! drops and counts the frame (BACKPRESSURE_DROP).
+//! @note push() and close() must be called from one thread.
+//!
+class FrameRecorder {
+  struct Slot {
+    uint stream;
+    uint64_t size, timestamp, hostTimestamp;
+    int64_t frameIndex;
+    uint8_t* pData;
+    std::vector<uint8_t> encoded;
+  };
+
+  RecordingWriter m_writer;
+  std::unique_ptr<ThreadPool> m_pPool;
+  std::unique_ptr<DepthCodec> m_pCodec;
+  std::vector<uint8_t> m_buffer;
+  std::vector<Slot> m_slots;
+  BackpressurePolicy m_policy;
+
+  SPSCQueue<uint> m_freeQueue;   // write  --> push()
+  SPSCQueue<uint> m_encodeQueue; // push() --> encode
+  SPSCQueue<uint> m_writeQueue;  // encode --> write
+  // Slot push() took from m_freeQueue but failed to queue, -1 if none.
+  // push() reuses it first, as it may not push to m_freeQueue itself.
+  int m_spareSlot;
+  std::thread m_encodeThread;
+  std::thread m_writeThread;
+  std::mutex m_mutex;
+  std::exception_ptr m_error;
+
+  std::atomic<uint64_t> m_nPushed, m_nDropped, m_nWritten;
+  std::atomic<uint64_t> m_nRawBytes, m_nBytes;
+
+  void encode();
+  void write();
+  //! Keep the current exception and stop all stages.
+  void fail();
+
+public:
+  FrameRecorder();
+  ~FrameRecorder();
+
+  //!
+  //! Register a stream. Return its index. Must be called before open().
+  //! @note info.codec selects how frames of the stream are stored.
+  //!
+  uint addStream(const StreamInfo& info);
+  //! What push() does when all slots are in use. Must be set before open().
+  void setBackpressurePolicy(BackpressurePolicy policy);
+
+  //!
+  //! Open the file and start the encode and write threads.
+  //! @param nSlots   Number of frames which can be in the pipeline.
+  //! @param nThreads Number of threads encoding a frame. 0 means one per
+  //!   hardware thread. Unused if no stream is compressed.
+  //!
+  void open(const char* path, uint nSlots=DEFAULT_QUEUE_SIZE,
+	    uint nThreads=0);
+  bool isOpen() const;
+  //! Write out all queued frames, then stop the threads and close the file.
+  void close();
+
+  //!
+  //! Queue a copy of frame. Never blocks on disk I/O, but waits for a free
+  //! slot with BACKPRESSURE_BLOCK.
+  //! @return false if the frame was dropped.
+  //! @throw RuntimeError if a stage failed.
+  //!
+  bool push(uint stream, const FrameView& frame);
+
+  uint getNumSlots() const;
+  uint64_t getNumPushed() const;
+  uint64_t getNumDropped() const;
+  uint64_t getNumWritten() const;
+  //! Largest number of frames waiting for the encode and write stages.
+  uint getMaxEncodeQueued() const;
+  uint getMaxWriteQueued() const;
+  //! Size of the written frames before and after encoding [byte].
+  uint64_t getNumRawBytes() const;
+  uint64_t getNumBytes() const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __OPENNI_INCLUDE_FRAMEVIEW_HPP__
+#define __OPENNI_INCLUDE_FRAMEVIEW_HPP__
+
+#include <memory>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+class ThreadPool;
+
+//!
+//! Read-only, reference-counted view of one captured frame.
+//! The view points straight into the memory of the frame owner (e.g. the
+//! OpenNI driver), which keeps the frame alive until the last copy of the
+//! view is released or destroyed. Copying a view does not copy pixels.
+//! @note Holding views for long keeps driver buffers from being reused.
+//!
+class FrameView {
+  std::shared_ptr<const void> m_holder;
+  const uint8_t* m_pData;
+  uint m_width, m_height, m_stride, m_BPP;
+  uint64_t m_timestamp;
+  int m_frameIndex;
+  uint64_t m_sequence;
+  uint64_t m_hostTimestamp;
+
+public:
+  FrameView();
+  //!
+  //! @param holder     Owner of the frame memory. Released with the last view.
+  //! @param pData      Pointer to the first pixel.
+  //! @param stride     Size of one row in byte.
+  //! @param BPP        Byte Par Pixel.
+  //! @param timestamp  Device timestamp. Unit: [us]
+  //! @param frameIndex Device frame index.
+  //! @param sequence   Sequence number given by the receiver, starting from 1.
+  //!
+  FrameView(std::shared_ptr<const void> holder, const void* pData,
+	    uint width, uint height, uint stride, uint BPP,
+	    uint64_t timestamp, int frameIndex, uint64_t sequence=0);
+
+  bool isValid() const;
+  void release();
+
+  const void* getData() const;
+  uint getWidth() const;
+  uint getHeight() const;
+  uint getStrideInBytes() const;
+  uint getBPP() const;
+  uint64_t getTimestamp() const;
+  int getFrameIndex() const;
+  uint64_t getSequenceNumber() const;
+  //! Set by the receiver, e.g. Streamer, when it accepts the frame.
+  void setSequenceNumber(uint64_t sequence);
+  //! Host time at arrival, 0 if unknown. Unit: [us] (getSteadyTimestamp)
+  uint64_t getHostTimestamp() const;
+  //! Set by the receiver, e.g. Streamer, when it accepts the frame.
+  void setHostTimestamp(uint64_t timestamp);
+
+  //! Same as copyFrame(), taking the row stride into account.
+  void copyTo(void* pDst, int offset=0, int padding=0,
+	      ThreadPool* pool=NULL, uint dstStride=0) const;
+  //! Same as convert16BitFrameToJet(), taking the row stride into account.
+  void convert16BitFrameToJet(uint8_t* pDst,
+			      const uint16_t v_min, const uint16_t v_max,
+			      const uint format=1, ThreadPool* pool=NULL,
+			      uint dstStride=0) const;
+};
+
+#endif
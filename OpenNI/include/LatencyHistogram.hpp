@@ -0,0 +1,51 @@
+#ifndef __OPENNI_INCLUDE_LATENCYHISTOGRAM_HPP__
+#define __OPENNI_INCLUDE_LATENCYHISTOGRAM_HPP__
+
+#include <atomic>
+#include <cstdint>
+
+#include "types.hpp"
+
+// Each power of two range is split into 2^LATENCY_SUB_BITS linear buckets,
+// so a bucket is at most 1/32 (3 %) of its value wide.
+#define LATENCY_SUB_BITS 5
+#define LATENCY_MAX_BITS 40 // Larger values go to the last bucket
+#define LATENCY_N_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 2) \
+			   << LATENCY_SUB_BITS)
+
+//!
+//! Log-linear histogram of latencies (any unit, [us] in this project).
+//! record() is lock-free and wait-free, so it can be called from driver
+//! callbacks and pipeline threads at the same time as readers query
+//! percentiles. Readers see a consistent enough snapshot for statistics;
+//! counts recorded while reading may or may not be included.
+//!
+class LatencyHistogram {
+  std::atomic<uint64_t> m_buckets[LATENCY_N_BUCKETS];
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_sum;
+  std::atomic<uint64_t> m_max;
+
+  static uint getBucket(uint64_t value);
+  //! Largest value which falls into bucket.
+  static uint64_t getBucketMax(uint bucket);
+
+public:
+  LatencyHistogram();
+
+  void record(uint64_t value);
+  //! Clear all counts. Values recorded concurrently may be lost.
+  void reset();
+
+  uint64_t getCount() const;
+  uint64_t getMax() const;
+  double getMean() const;
+  //!
+  //! Smallest value which percentile percent of the recorded values do not
+  //! exceed, within the bucket width. 0 if empty.
+  //! @param percentile In [0, 100].
+  //!
+  uint64_t getPercentile(double percentile) const;
+};
+
+#endif
@@ -2,64 +2,174 @@
 #define __OPENNI_INCLUDE_NIDEVICE_HPP__
 
 #include <mutex>
+#include <memory>
 #include <atomic>
+#include <chrono>
 #include <string>
+#include <vector>
 #include <functional>
 
 #include "types.hpp"
+#include "FrameView.hpp"
+#include "StreamStats.hpp"
+#include "ClockEstimator.hpp"
+#include "Registration.hpp"
+#include "TemporalFilter.hpp"
+#include "TripleBuffer.hpp"
+#include "BufferPool.hpp"
+#include "FrameNotifier.hpp"
+#include "DeviceBackend.hpp"
 #include "OpenNI2/OpenNI.h"
 
+class ThreadPool;
+
+#define WAIT_TIMEOUT 500 // [ms]
+#define READY_TIMEOUT 10000 // [ms]
+
+// Bit masks to select sensors in NIDevice::waitForFrames
+#define SENSOR_MASK(type) (1u << (type))
+#define SENSOR_MASK_IR    SENSOR_MASK(openni::SENSOR_IR)
+#define SENSOR_MASK_COLOR SENSOR_MASK(openni::SENSOR_COLOR)
+#define SENSOR_MASK_DEPTH SENSOR_MASK(openni::SENSOR_DEPTH)
+#define SENSOR_MASK_ALL   (SENSOR_MASK_IR | SENSOR_MASK_COLOR | SENSOR_MASK_DEPTH)
+
 const char* getSensorTypeString(const openni::SensorType type);
 const char* getPixelFormatString(const openni::PixelFormat val);
+uint getBytesPerPixel(const openni::PixelFormat val);
 
 void printSupportedVideoModes(const openni::SensorInfo* info);
 
-class Listener : public openni::VideoStream::NewFrameListener {
-  std::function<void()> m_callbackFcn;
-public:
-  Listener();
-  ~Listener();
-  void onNewFrame (openni::VideoStream &stream) override;
-  void setCallbackFcn (std::function<void()> fcn);
+//! Where depth frames are registered to the color camera.
+enum RegistrationMode {
+  REGISTRATION_OFF,
+  REGISTRATION_AUTO,   // On the device if supported, else on the host
+  REGISTRATION_DEVICE,
+  REGISTRATION_HOST,   // DepthRegistration in the backend callback
 };
 
+const char* getRegistrationModeString(const RegistrationMode mode);
+//! Parse "off", "auto", "device" or "host".
+RegistrationMode parseRegistrationMode(const std::string& val);
+
+//! Replaces a frame before it is published, e.g. by a processed copy.
+typedef std::function<FrameView(const FrameView&)> FrameFilter;
+
+//!
+//! One video stream of a DeviceBackend. The backend callback publishes each
+//! new frame into a lock-free triple buffer, so it never waits for
+//! consumers. Consumers are serialized among themselves by m_consumerMutex.
+//! Arrival and consumption of frames are recorded in the stream statistics,
+//! and the device clock is tracked against the steady host clock.
+//!
 class Streamer {
-  openni::VideoStream   m_stream;
-  openni::VideoFrameRef m_frame;
-  std::mutex            m_frameMutex;
-  Listener              m_listener;
+  std::unique_ptr<StreamBackend> m_pBackend;
+  TripleBuffer<FrameView> m_frames;
+  std::mutex            m_consumerMutex;
+  FrameNotifier*        m_pNotifier;
   bool                  m_bStreaming;
-  std::atomic<std::chrono::microseconds> m_time;
+  std::atomic<uint64_t> m_lastRead;
+  StreamStats           m_stats;
+  ClockEstimator        m_clock;
+  std::atomic<uint64_t> m_lastTimestamp;
+  std::atomic<uint64_t> m_period;
+  FrameCallback         m_frameHook;
+  FrameFilter           m_frameFilter;
+
+  const StreamBackend& getBackend() const;
+  //! Backend callback: publish frame and wake up waiting consumers.
+  void onNewFrame(const FrameView& frame);
 public:
   Streamer();
   ~Streamer();
 
-  void create(openni::Device &device, const openni::SensorType type,
+  void create(DeviceBackend& device, const openni::SensorType type,
 	      const int mode=0, const bool mirroring=false);
+  //! Notifier signalled on every new frame. Must be set before start().
+  void setFrameNotifier(FrameNotifier* pNotifier);
+  //!
+  //! Called in the backend callback with every new frame, before it is
+  //! published. Must be short. Must be set before start().
+  //!
+  void setFrameHook(FrameCallback hook);
+  //!
+  //! Called in the backend callback with every new frame. The returned
+  //! frame is published instead. Must be set before start().
+  //!
+  void setFrameFilter(FrameFilter filter);
+  //! Start streaming. Resets the statistics and the clock estimate.
   void start();
   void stop();
   bool isStreamValid() const;
   bool isStreaming() const;
   bool isFrameValid() const;
+  //! Sequence number of the latest received frame. 0 if none.
+  uint64_t getSequenceNumber() const;
+  //! True if a frame newer than the last one read by getFrameView() arrived.
+  bool hasNewFrame() const;
+  //! Device timestamp of the latest received frame [us]. 0 if none.
+  uint64_t getLastTimestamp() const;
+  //! Device time between the latest two frames [us]. 0 if unknown.
+  uint64_t getFramePeriod() const;
 
   uint getWidth() const;
   uint getHeight() const;
   uint getNumChannels() const;
+  openni::PixelFormat getPixelFormat() const;
   uint getMinValue() const;
   uint getMaxValue() const;
+  //!
+  //! Return a view of the latest frame without copying pixel data.
+  //! The frame is kept alive by the view, so the callback can move on to
+  //! the next frame at once.
+  //!
+  FrameView getFrameView();
   void copyTo(void* pDst, const uint offset=0, const uint padding=0);
+
+  //! Consumers record STAGE_CONVERT and STAGE_PRESENT here.
+  StreamStats& getStats();
+  //! Mapping of the device timestamps of this stream to the host clock.
+  const ClockEstimator& getClock() const;
 };
 
+//!
+//! RGB-D device with up to one IR, color and depth stream.
+//! The frames come from the backend selected by the URI of openDevice(),
+//! so a recording or a synthetic scene can stand in for a sensor.
+//!
 class NIDevice {
-  openni::Device m_device;
+  std::unique_ptr<DeviceBackend> m_pDevice;
   Streamer       m_streamers[3];
+  FrameNotifier  m_notifier;
+  std::atomic<bool> m_bTrackSkew;
+  SkewStats      m_skew;
+  RegistrationMode  m_registrationMode;
+  DepthRegistration m_registration;
+  bool              m_bTemporalFilter;
+  DepthTemporalFilter m_temporalFilter;
+  std::unique_ptr<ThreadPool> m_pDepthPool;
+  BufferPool<uint16_t> m_depthBuffers;
+
+  DeviceBackend& getDevice() const;
+  //! Frame hook of the streams: pair depth and color frames for m_skew.
+  void onNewFrame(const openni::SensorType type, const FrameView& frame);
+  //! Frame filter of the depth stream: host registration, then the
+  //! temporal filter, into a buffer of m_depthBuffers.
+  FrameView filterDepth(const FrameView& frame);
+  //! Install filterDepth() on the depth stream if it has anything to do.
+  void updateDepthFilter();
 public:
   static void initONI();
   static void quitONI();
+  //! URIs of all attached OpenNI devices.
+  static std::vector<std::string> enumerateDevices();
 
   NIDevice();
   ~NIDevice();
 
+  //!
+  //! Open the device at uri. See openDeviceBackend() for the schemes.
+  //! @param uri NULL (openni::ANY_DEVICE) opens any OpenNI device.
+  //!
   void openDevice(const char* uri=openni::ANY_DEVICE);
   void listAllSensorModes();
 
@@ -71,6 +181,7 @@ public:
   uint getWidth(openni::SensorType type) const;
   uint getHeight(openni::SensorType type) const;
   uint getNumChannels(openni::SensorType type) const;
+  openni::PixelFormat getPixelFormat(openni::SensorType type) const;
   int getMinValue(openni::SensorType type) const;
   int getMaxValue(openni::SensorType type) const;
 
@@ -90,16 +201,86 @@ public:
   int getIRMinValue() const;
   int getIRMaxValue() const;
 
+  //! Same as setImageRegistrationMode(REGISTRATION_AUTO or _OFF).
   void setImageRegistration(const bool enable=true);
+  //!
+  //! Register depth frames to the color camera on the device or on the
+  //! host. Must be called before the depth stream is started.
+  //! @throw RuntimeError if mode is REGISTRATION_DEVICE and the device
+  //!   does not support it.
+  //!
+  void setImageRegistrationMode(const RegistrationMode mode);
+  //! Resolved mode: never REGISTRATION_AUTO.
+  RegistrationMode getImageRegistrationMode() const;
+  //! Calibration of REGISTRATION_HOST. Defaults: see DepthRegistration.
+  void setRegistrationCalibration(const CameraIntrinsics& depth,
+				  const CameraIntrinsics& color,
+				  const CameraExtrinsics& extrinsics);
+  //!
+  //! Denoise depth frames with a DepthTemporalFilter in the backend
+  //! callback, after host registration if any. Must be called before the
+  //! depth stream is started.
+  //!
+  void setDepthTemporalFilter(const bool enable=true);
+  bool isDepthTemporalFilterEnabled() const;
+  //! The filter, to set its parameters before the depth stream is started.
+  DepthTemporalFilter& getDepthTemporalFilter();
+  //!
+  //! Enable hardware depth/color sync and track the skew between the
+  //! device timestamps of depth and color frames (getSyncSkewStats()).
+  //!
   void setDepthColorSync(const bool enable=true);
 
   void startStream(openni::SensorType type);
   void startStreams();
 
-  void waitStreamsToGetReady() const;
+  //!
+  //! Block until every streaming sensor has delivered its first frame.
+  //! @throw RuntimeError if no sensor is streaming or timeout expires.
+  //!
+  void waitStreamsToGetReady(std::chrono::milliseconds timeout=
+			     std::chrono::milliseconds(READY_TIMEOUT));
+  //!
+  //! Block until every streaming sensor in sensorMask has a frame newer than
+  //! the one last read from it. Sensors which are not streaming are ignored.
+  //! @param sensorMask Combination of SENSOR_MASK_* bits.
+  //! @return false if timeout expired.
+  //!
+  bool waitForFrames(uint sensorMask=SENSOR_MASK_ALL,
+		     std::chrono::milliseconds timeout=
+		     std::chrono::milliseconds(WAIT_TIMEOUT));
+  //!
+  //! Block until a frame with sequence number larger than lastSeq arrives.
+  //! @return Sequence number of the latest frame, or 0 if timeout expired.
+  //!
+  uint64_t waitForNextFrame(openni::SensorType type, uint64_t lastSeq,
+			    std::chrono::milliseconds timeout=
+			    std::chrono::milliseconds(WAIT_TIMEOUT));
 
   void stopStream(openni::SensorType type);
   void stopStreams();
+  bool isStreaming(openni::SensorType type) const;
+  //! Device time between the latest two frames of the stream [us].
+  //! 0 if unknown.
+  uint64_t getFramePeriod(openni::SensorType type) const;
+
+  FrameView getFrameView(openni::SensorType type);
+  FrameView getDepthFrameView();
+  FrameView getColorFrameView();
+  FrameView getIRFrameView();
+
+  StreamStats& getStreamStats(openni::SensorType type);
+  //! Depth minus color skew of frame pairs. Empty unless depth/color sync.
+  const SkewStats& getSyncSkewStats() const;
+  //!
+  //! Host time [us] (getSteadyTimestamp) at which the device clock of the
+  //! stream read timestamp. 0 if the stream has not received a frame yet.
+  //!
+  uint64_t toHostTime(openni::SensorType type, uint64_t timestamp) const;
+  //! Print the statistics of every created stream and the sync skew.
+  void printStreamStats();
+  //! StreamStats::getSummary() of every created stream, for a window title.
+  std::string getStreamStatsSummary();
 
   void copyFrame(openni::SensorType type,
 		 void* pDstBuffer, int offset, int padding);
@@ -0,0 +1,58 @@
+#ifndef __OPENNI_INCLUDE_OPENNIBACKEND_HPP__
+#define __OPENNI_INCLUDE_OPENNIBACKEND_HPP__
+
+#include <functional>
+
+#include "types.hpp"
+#include "DeviceBackend.hpp"
+#include "OpenNI2/OpenNI.h"
+
+class Listener : public openni::VideoStream::NewFrameListener {
+  std::function<void()> m_callbackFcn;
+public:
+  Listener();
+  ~Listener();
+  void onNewFrame (openni::VideoStream &stream) override;
+  void setCallbackFcn (std::function<void()> fcn);
+};
+
+//!
+//! One openni::VideoStream. Frames read in the driver callback are handed
+//! on as views holding their openni::VideoFrameRef.
+//!
+class OpenNIStream : public StreamBackend {
+  openni::VideoStream m_stream;
+  openni::SensorType  m_type;
+  Listener            m_listener;
+  bool                m_bStarted;
+public:
+  OpenNIStream(openni::Device& device, const openni::SensorType type,
+	       const int mode, const bool mirroring);
+  ~OpenNIStream();
+
+  uint getWidth() const override;
+  uint getHeight() const override;
+  openni::PixelFormat getPixelFormat() const override;
+  int getMinValue() const override;
+  int getMaxValue() const override;
+  void start(const FrameCallback& callback) override;
+  void stop() override;
+};
+
+//! Physical device opened through OpenNI.
+class OpenNIBackend : public DeviceBackend {
+  openni::Device m_device;
+public:
+  //! @param uri OpenNI device URI. NULL opens any device.
+  OpenNIBackend(const char* uri);
+  ~OpenNIBackend();
+
+  bool hasSensor(openni::SensorType type) override;
+  void printSensorModes(openni::SensorType type) override;
+  std::unique_ptr<StreamBackend>
+  createStream(openni::SensorType type, int mode, bool mirroring) override;
+  void setImageRegistration(bool enable) override;
+  void setDepthColorSync(bool enable) override;
+};
+
+#endif
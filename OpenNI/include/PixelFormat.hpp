@@ -0,0 +1,107 @@
+#ifndef __OPENNI_INCLUDE_PIXELFORMAT_HPP__
+#define __OPENNI_INCLUDE_PIXELFORMAT_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "types.hpp"
+#include "simd.hpp"
+#include "ThreadPool.hpp"
+
+//!
+//! Pixel formats of the frame buffers. Each type is the memory layout of
+//! one pixel, so sizeof() is the BPP and a frame is an array of pixels.
+//! Depth16 and IR16 share the layout but are distinct types, so a depth
+//! frame can not be passed where an IR frame is expected.
+//!
+struct Depth16 {
+  uint16_t value; // [mm]
+};
+
+struct IR16 {
+  uint16_t value;
+};
+
+struct Gray8 {
+  uint8_t value;
+};
+
+struct RGB888 {
+  uint8_t r, g, b;
+};
+
+//! SDL_PIXELFORMAT_BGRA8888 in memory (A, R, G, B) on little endian.
+struct BGRA8888 {
+  uint8_t a, r, g, b;
+};
+
+//!
+//! Conversion of n pixels from Src to Dst, selected at compile time.
+//! Only the specialized pairs exist, so an unsupported conversion fails to
+//! compile rather than at runtime. Conversions to BGRA8888 leave the alpha
+//! byte untouched, as copyFrame() with an offset of 1 does.
+//!
+template <typename Src, typename Dst> struct PixelConversion;
+
+template <typename Pixel> struct PixelConversion<Pixel, Pixel> {
+  static void apply(const Pixel* pSrc, Pixel* pDst, const size_t n) {
+    memcpy(pDst, pSrc, n * sizeof(Pixel));
+  };
+};
+
+template <> struct PixelConversion<RGB888, BGRA8888> {
+  static void apply(const RGB888* pSrc, BGRA8888* pDst, const size_t n) {
+    expand3To4(reinterpret_cast<const uint8_t *>(pSrc),
+	       reinterpret_cast<uint8_t *>(pDst) + 1, n);
+  };
+};
+
+template <> struct PixelConversion<Gray8, BGRA8888> {
+  static void apply(const Gray8* pSrc, BGRA8888* pDst, const size_t n) {
+    for (size_t i=0; i<n; ++i)
+      pDst[i].r = pDst[i].g = pDst[i].b = pSrc[i].value;
+  };
+};
+
+//!
+//! Convert a frame from Src to Dst pixels like copyFrame(), with the kernel
+//! of PixelConversion<Src, Dst> instead of a branch on the BPP.
+//! @param pool      If given, rows are split into bands processed on the pool.
+//! @param dstStride Row size of pDst in byte. 0 for width * sizeof(Dst).
+//! @param srcStride Row size of pSrc in byte. 0 for width * sizeof(Src).
+//!
+template <typename Src, typename Dst>
+void convertFrame(const Src* pSrc, Dst* pDst, const uint width,
+		  const uint height, ThreadPool* pool=NULL,
+		  const uint dstStride=0, const uint srcStride=0) {
+  typedef PixelConversion<Src, Dst> Conversion;
+  const size_t srcRow = srcStride ? srcStride : size_t(width) * sizeof(Src);
+  const size_t dstRow = dstStride ? dstStride : size_t(width) * sizeof(Dst);
+  if (srcRow == size_t(width) * sizeof(Src) &&
+      dstRow == size_t(width) * sizeof(Dst)) {
+    // Packed rows: convert the whole band at once
+    if (!pool) {
+      Conversion::apply(pSrc, pDst, size_t(width) * height);
+      return;
+    }
+    pool->parallelFor(0, height, [&](uint h0, uint h1){
+	size_t begin = size_t(h0) * width;
+	Conversion::apply(pSrc + begin, pDst + begin, size_t(h1 - h0) * width);
+      });
+    return;
+  }
+  const uint8_t* pSrcBuff = reinterpret_cast<const uint8_t *>(pSrc);
+  uint8_t* pDstBuff = reinterpret_cast<uint8_t *>(pDst);
+  auto convertRows = [&](uint h0, uint h1){
+    for (uint h=h0; h<h1; ++h)
+      Conversion::apply(reinterpret_cast<const Src *>(pSrcBuff + h * srcRow),
+			reinterpret_cast<Dst *>(pDstBuff + h * dstRow), width);
+  };
+  if (pool)
+    pool->parallelFor(0, height, convertRows);
+  else
+    convertRows(0, height);
+}
+
+#endif
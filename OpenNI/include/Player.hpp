@@ -0,0 +1,169 @@
+#ifndef __OPENNI_INCLUDE_PLAYER_HPP__
+#define __OPENNI_INCLUDE_PLAYER_HPP__
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include <cstdint>
+
+#include "types.hpp"
+#include "FrameView.hpp"
+
+class Frames;
+class ThreadPool;
+class RecordingReader;
+
+#define DEFAULT_PREFETCH_DEPTH 8       // Frame sets decoded ahead
+#define MIN_PLAYBACK_SPEED     0.25
+#define MAX_PLAYBACK_SPEED     16.0
+#define DEFAULT_FRAME_PERIOD   33333   // [us] if timestamps do not tell
+#define MAX_FRAME_GAP          1000000 // [us] longer gaps are not waited
+#define MAX_PLAYBACK_LATENESS  50000   // [us] later frames restart the clock
+
+//!
+//! Frames to play: frame set iFrame holds frame iFrame of every stream.
+//! getFrame() is called on the prefetch thread of Player.
+//!
+class PlaybackSource {
+public:
+  virtual ~PlaybackSource() {};
+  virtual uint getNumStreams() const = 0;
+  virtual uint64_t getNumFrames() const = 0;
+  //! Frame iFrame of stream, invalid if the stream has no such frame.
+  virtual FrameView getFrame(uint stream, uint64_t iFrame) = 0;
+};
+
+//! Streams of a recording. Compressed frames are decoded by getFrame().
+class RecordingSource : public PlaybackSource {
+  const RecordingReader& m_reader;
+  std::vector<int> m_streams;
+  ThreadPool* m_pPool;
+
+public:
+  //!
+  //! @param streams Stream numbers of reader, -1 for a stream without
+  //!   frames (e.g. a region of the visualizer left empty).
+  //! @param pool    Pool to decode on, or NULL.
+  //!
+  RecordingSource(const RecordingReader& reader,
+		  const std::vector<int>& streams, ThreadPool* pool=NULL);
+
+  virtual uint getNumStreams() const;
+  virtual uint64_t getNumFrames() const;
+  virtual FrameView getFrame(uint stream, uint64_t iFrame);
+};
+
+//! Frames in memory, e.g. rings filled by capture. NULL for no frames.
+class FramesSource : public PlaybackSource {
+  std::vector<Frames*> m_frames;
+  uint64_t m_nFrames;
+
+public:
+  //! @param nFrames Number of frames to play, e.g. the number captured.
+  FramesSource(const std::vector<Frames*>& frames, uint64_t nFrames);
+
+  virtual uint getNumStreams() const;
+  virtual uint64_t getNumFrames() const;
+  virtual FrameView getFrame(uint stream, uint64_t iFrame);
+};
+
+//! One frame set of a PlaybackSource.
+struct PlaybackFrame {
+  uint64_t index;
+  uint64_t timestamp;             // [us] of the first stream with a frame
+  std::vector<FrameView> frames;  // One per stream
+};
+
+//!
+//! Plays a PlaybackSource in time with its recorded timestamps.
+//! A prefetch thread reads (and decodes) the next frame sets ahead of
+//! display and faults their pages in, so playback of a recording on disk
+//! does not stall on I/O. next() hands out each frame set when it is due:
+//! the difference of the timestamps divided by the speed after the
+//! previous one. Gaps the timestamps do not explain, e.g. where a ring of
+//! frames wrapped, take DEFAULT_FRAME_PERIOD, and a frame shown late
+//! restarts the clock rather than having later frames rush to catch up.
+//! Playback can be paused, stepped frame by frame, seeked, played at
+//! MIN_PLAYBACK_SPEED to MAX_PLAYBACK_SPEED, or unthrottled (as fast as
+//! frames are fetched).
+//! @note Thread safe. next() is meant to be called from one thread.
+//!
+class Player {
+  PlaybackSource* m_pSource;
+  uint m_depth;
+  uint64_t m_nFrames;
+  std::thread m_thread;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_fetchCond;
+  std::condition_variable m_readyCond;
+  std::deque<PlaybackFrame> m_prefetched;
+  uint64_t m_nextFetch;
+  uint64_t m_generation;      // Incremented by seeks, to drop old fetches
+  bool m_bStop;
+  std::exception_ptr m_error;
+
+  uint64_t m_position;        // Next frame set to show
+  double m_speed;
+  bool m_bUnthrottled, m_bPaused, m_bLoop;
+  uint m_nSteps;              // Frame sets to show while paused
+  bool m_bClockStarted;
+  uint64_t m_lastTimestamp;   // [us] of the last frame set shown
+  std::chrono::steady_clock::time_point m_lastDue;
+  bool m_bStalled;
+  uint64_t m_nStalls;
+
+  void prefetch();
+  //! Drop what was fetched and continue from iFrame. Locked.
+  void seekLocked(uint64_t iFrame);
+
+public:
+  Player();
+  ~Player();
+
+  //!
+  //! Start prefetching from frame set 0, paused if bPaused.
+  //! @param pSource Must outlive close().
+  //! @param depth   Number of frame sets fetched ahead.
+  //! @throw RuntimeError if the source has no frame.
+  //!
+  void open(PlaybackSource* pSource, uint depth=DEFAULT_PREFETCH_DEPTH,
+	    bool bPaused=false);
+  void close();
+
+  //!
+  //! Wait up to timeout for the next frame set to be due and take it.
+  //! Return false on timeout, while paused, and at the end without loop.
+  //! @throw The exception thrown by PlaybackSource::getFrame().
+  //!
+  bool next(PlaybackFrame& frame, std::chrono::milliseconds timeout);
+
+  //! @throw RuntimeError if speed is out of [MIN_PLAYBACK_SPEED,
+  //!   MAX_PLAYBACK_SPEED].
+  void setSpeed(double speed);
+  double getSpeed() const;
+  //! Show frame sets as soon as they are fetched, ignoring timestamps.
+  void setUnthrottled(bool bUnthrottled);
+  bool isUnthrottled() const;
+  void setPaused(bool bPaused);
+  bool isPaused() const;
+  //! Start over after the last frame set (default) or stop there.
+  void setLoop(bool bLoop);
+  //! @throw RuntimeError if iFrame is out of range.
+  void seek(uint64_t iFrame);
+  //! Pause and show the frame set nFrames after (or before) the last one.
+  void step(int nFrames);
+
+  uint64_t getNumFrames() const;
+  //! Index of the frame set shown last.
+  uint64_t getPosition() const;
+  //! Number of frame sets which were due before they were fetched.
+  uint64_t getNumStalls() const;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef __OPENNI_INCLUDE_POINTCLOUD_HPP__
+#define __OPENNI_INCLUDE_POINTCLOUD_HPP__
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+class ThreadPool;
+class RGBDFrames;
+
+// TUM RGB-D freiburg3 depth intrinsics, VGA
+#define FR3_FX     535.4f
+#define FR3_FY     539.2f
+#define FR3_CX     320.1f
+#define FR3_CY     247.6f
+#define FR3_WIDTH  640
+#define FR3_HEIGHT 480
+
+//!
+//! Pinhole intrinsics of a depth camera.
+//! fx, fy, cx and cy are given for a width x height image and are scaled
+//! to the size of the frames they are applied to.
+//!
+struct CameraIntrinsics {
+  float fx, fy, cx, cy;
+  uint width, height;
+  float depthScale; // Depth unit [m], 1e-3 for 1 mm depth
+
+  CameraIntrinsics(float fx=FR3_FX, float fy=FR3_FY,
+		   float cx=FR3_CX, float cy=FR3_CY,
+		   uint width=FR3_WIDTH, uint height=FR3_HEIGHT,
+		   float depthScale=1e-3f);
+  //! Intrinsics scaled to width x height.
+  CameraIntrinsics scaledTo(uint width, uint height) const;
+};
+
+struct PointXYZ {
+  float x, y, z;
+};
+
+//! Point with color bytes in SDL_PIXELFORMAT_BGRA8888 order (A, R, G, B).
+struct PointXYZRGBA {
+  float x, y, z;
+  uint8_t color[4];
+};
+
+//!
+//! Back-projects depth frames to organized point clouds [m]: the point of
+//! pixel (u, v) is written to index v * width + u, and pixels without
+//! depth (0) give NaN coordinates.
+//! The rays (u - cx) / fx and (v - cy) / fy are tabulated per column and
+//! per row for the frame size, so a point costs two multiplications.
+//! Rows are split over the pool if one is given.
+//! @note The kernel is chosen at runtime according to getSIMDLevel().
+//!
+class DepthProjector {
+  CameraIntrinsics m_intrinsics;
+  uint m_width, m_height;
+  std::vector<float> m_rayX, m_rayY;
+
+  //! Build the ray tables for width x height if not done yet.
+  void prepare(uint width, uint height);
+
+public:
+  DepthProjector(const CameraIntrinsics& intrinsics=CameraIntrinsics());
+
+  void setIntrinsics(const CameraIntrinsics& intrinsics);
+  const CameraIntrinsics& getIntrinsics() const;
+
+  void project(const uint16_t* pDepth, PointXYZ* pDst,
+	       uint width, uint height, ThreadPool* pool=NULL);
+  //!
+  //! Project with the color of the same pixel.
+  //! @param pColor RGB888 frame registered to the depth frame, i.e. of the
+  //!   same size (see NIDevice::setImageRegistration).
+  //!
+  void project(const uint16_t* pDepth, const uint8_t* pColor,
+	       PointXYZRGBA* pDst, uint width, uint height,
+	       ThreadPool* pool=NULL);
+  //!
+  //! Project frame iFrame of frames with its color.
+  //! @throw RuntimeError if the depth and color frames differ in size.
+  //!
+  void project(RGBDFrames& frames, int iFrame, PointXYZRGBA* pDst,
+	       ThreadPool* pool=NULL);
+};
+
+#endif
@@ -1,13 +1,63 @@
 #ifndef __OPENNI_INCLUDE_RGBDVISUALIZER_HPP__
 #define __OPENNI_INCLUDE_RGBDVISUALIZER_HPP__
 
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
 #include "types.hpp"
+#include "FrameView.hpp"
 #include "SDL2/SDL.h"
 
 #define MAX_WINDOW_TITLE_LENGTH 64
+#define DEFAULT_MAX_FPS         60
+#define EVENT_POLL_INTERVAL     10 // Longest time events wait in run() [ms]
+
+class ThreadPool;
+class StreamStats;
+
+//! Part of the window a frame is shown in.
+enum VisualizerRegion {
+  REGION_DEPTH, // Left
+  REGION_COLOR, // Right
+  N_VISUALIZER_REGIONS,
+};
 
+//! Receives the events RGBDVisualizer does not handle itself.
 class EventHandler {
+public:
+  virtual ~EventHandler() {};
+  virtual void onKeyDown(const SDL_Keysym& key) = 0;
+};
+
+//!
+//! Region of the streaming texture of RGBDVisualizer, locked for writing
+//! (SDL_LockTexture). Row y of the region starts at getPixels() + y *
+//! getPitch(), so the conversion kernels write into the texture directly
+//! when given the pitch as destination stride. The region is uploaded on
+//! unlock() or destruction.
+//! @note The locked memory is write only: every pixel of the region must be
+//!   written, its previous content is undefined.
+//!
+class TextureLock {
+  SDL_Texture *m_pTexture;
+  uint8_t *m_pPixels;
+  int m_pitch;
+
+  TextureLock(const TextureLock&) = delete;
+  TextureLock& operator=(const TextureLock&) = delete;
+
+public:
+  //! Lock rect of texture. An empty rect locks nothing.
+  TextureLock(SDL_Texture* pTexture, const SDL_Rect& rect);
+  TextureLock(TextureLock&& other);
+  ~TextureLock();
 
+  uint8_t* getPixels() const;
+  //! Row size in byte.
+  uint getPitch() const;
+  void unlock();
 };
 
 class RGBDVisualizer {
@@ -17,16 +67,32 @@ class RGBDVisualizer {
   SDL_Rect m_depthRect;
   SDL_Rect m_colorRect;
 
-  uint m_depthW, m_depthH, m_colorW, m_colorH, m_channel;
-  uint8_t *m_pColorBuff;
-  uint8_t *m_pDepthBuff;
+  uint m_depthW, m_depthH, m_colorW, m_colorH;
 
-  char m_windowTitle[MAX_WINDOW_TITLE_LENGTH];
+  //! Latest frame published for a region, not shown yet.
+  struct Published {
+    FrameView frame;
+    uint16_t v_min, v_max;
+    StreamStats* pStats;
+    uint64_t published; // [us]
+    bool bNew;
+  };
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  Published m_published[N_VISUALIZER_REGIONS];
+  mutable std::atomic<bool> m_bStopped;
 
-  void createWindow();
-  void createConversionBuffers();
-  void updateTexture();
+  EventHandler* m_pEventHandler;
+
+  mutable std::mutex m_titleMutex;
+  mutable char m_windowTitle[MAX_WINDOW_TITLE_LENGTH];
+  mutable bool m_bTitleChanged;
+
+  void createWindow(bool bVSync);
   void render();
+  //! Take the new published frames. Wait up to timeout if there is none.
+  bool takePublished(Published (&pending)[N_VISUALIZER_REGIONS],
+		     std::chrono::milliseconds timeout);
 
 public:
   static void initSDL(Uint32 flag=SDL_INIT_VIDEO);
@@ -36,14 +102,62 @@ public:
   RGBDVisualizer();
   ~RGBDVisualizer();
 
-  void initWindow(uint depthW, uint depthH, uint colorW, uint colorH);
+  //! @param bVSync Wait for the vertical blank on presenting.
+  void initWindow(uint depthW, uint depthH, uint colorW, uint colorH,
+		  bool bVSync=false);
+  //! Present the texture. Regions not locked since the last call keep
+  //! their content.
   void refreshWindow();
 
-  uint8_t* getColorBuffer() const;
-  uint8_t* getDepthBuffer() const;
+  //!
+  //! Capture side: show frame in region with the next presentation of
+  //! run(). Never waits for the display: a frame published before the
+  //! previous one was shown replaces it. Thread safe.
+  //! 16 bit frames are shown through the jet colormap from v_min to
+  //! v_max, 24 bit frames as RGB.
+  //! @param pStats If given, the time from publish() to the end of the
+  //!   conversion is recorded as STAGE_CONVERT, and from there to the
+  //!   presentation as STAGE_PRESENT.
+  //! @note The view keeps its driver buffer until it is shown or replaced.
+  //!
+  void publish(VisualizerRegion region, const FrameView& frame,
+	       uint16_t v_min=DEFAULT_DEPTH_MIN,
+	       uint16_t v_max=DEFAULT_DEPTH_MAX, StreamStats* pStats=NULL);
+  //!
+  //! Render loop: convert the latest published frames into the texture and
+  //! present them, at most maxFPS times a second (0: no limit, e.g. with
+  //! vsync), and handle all pending events. Returns when the window is
+  //! closed or stop() is called.
+  //! Call on the thread SDL was initialized on (the main thread on macOS)
+  //! and capture on another one, so the capture cadence does not depend
+  //! on presentation.
+  //! @param pool Pool to convert on, or NULL.
+  //!
+  void run(uint maxFPS=DEFAULT_MAX_FPS, ThreadPool* pool=NULL);
+  //! Make run() return and isStopped() true. Thread safe.
+  void stop();
+  //!
+  //! Clear the stop state, so the window can serve another loop after the
+  //! one a quit event or stop() ended, e.g. playback after capture.
+  //!
+  void resetStop();
+
+  //!
+  //! Lock the depth (left) or color (right) region to convert the next
+  //! frame into, in SDL_PIXELFORMAT_BGRA8888. Unlock before refreshWindow().
+  //! @throw RuntimeError if SDL fails to lock the texture.
+  //!
+  TextureLock lockDepthRegion();
+  TextureLock lockColorRegion();
 
+  //! Thread safe. The title is set with the next presentation.
   void setWindowTitle(const char* format, ...) const;
+  //! Key presses other than ESC and q go to pHandler (NULL: ignored).
+  void setEventHandler(EventHandler* pHandler);
   void delay(Uint32 mSec) const;
+  //! Handle all pending events. True once the window was closed (window
+  //! close, ESC or q) or stop() was called, until resetStop(). Call on the
+  //! thread of run().
   bool isStopped() const;
 };
 
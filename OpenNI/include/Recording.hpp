@@ -0,0 +1,185 @@
+#ifndef __OPENNI_INCLUDE_RECORDING_HPP__
+#define __OPENNI_INCLUDE_RECORDING_HPP__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+#include "FrameView.hpp"
+
+class ThreadPool;
+
+//
+// Recording file layout (native byte order)
+//
+//   RecordingHeader
+//   StreamInfo x RecordingHeader::nStreams
+//   { ChunkHeader, payload } x number of frames, streams interleaved
+//   uint64_t x nStreams        Number of frames in each stream
+//   IndexEntry x nFrames       Index of stream 0, stream 1, ...
+//   IndexFooter
+//
+// The index is written by RecordingWriter::close(). Files without it
+// (e.g. when the recorder crashed) are indexed by scanning the chunks.
+//
+#define RECORDING_MAGIC   "RGBDREC"
+#define RECORDING_VERSION 1
+#define CHUNK_MAGIC       0x454d5246 // "FRME"
+#define INDEX_MAGIC       "RGBDIDX"
+
+// Same values as openni::SensorType
+enum RecordingSensor {
+  RECORDING_SENSOR_IR    = 1,
+  RECORDING_SENSOR_COLOR = 2,
+  RECORDING_SENSOR_DEPTH = 3,
+};
+
+// Same values as openni::PixelFormat
+enum RecordingFormat {
+  RECORDING_FORMAT_DEPTH_1_MM = 100,
+  RECORDING_FORMAT_RGB888     = 200,
+};
+
+enum FrameCodec {
+  CODEC_RAW       = 0,
+  CODEC_DEPTH_RLZ = 1, // DepthCodec, 16 bit streams only
+};
+
+struct RecordingHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t nStreams;
+};
+
+struct StreamInfo {
+  uint32_t sensorType;  // openni::SensorType
+  uint32_t pixelFormat; // openni::PixelFormat
+  uint32_t width;
+  uint32_t height;
+  uint32_t BPP;
+  int32_t  minValue;
+  int32_t  maxValue;
+  uint32_t codec;       // Default FrameCodec of the stream
+};
+
+struct ChunkHeader {
+  uint32_t magic;
+  uint32_t stream;        // Index of StreamInfo
+  uint32_t codec;         // FrameCodec of the payload
+  uint32_t reserved;
+  uint64_t size;          // Payload size in byte
+  uint64_t timestamp;     // Device timestamp [us]
+  int64_t  frameIndex;    // Device frame index
+  uint64_t hostTimestamp; // Steady host time at arrival [us]
+};
+
+struct IndexEntry {
+  uint64_t offset;    // File offset of ChunkHeader
+  uint64_t timestamp; // Device timestamp [us]
+};
+
+struct IndexFooter {
+  uint64_t indexOffset; // File offset of the frame counts
+  uint32_t nStreams;
+  uint32_t reserved;
+  char     magic[8];
+};
+
+//!
+//! Sequential writer of recording files.
+//! Streams are registered with addStream() before open().
+//!
+class RecordingWriter {
+  std::FILE* m_pFile;
+  std::string m_path;
+  std::vector<StreamInfo> m_streams;
+  std::vector<std::vector<IndexEntry> > m_index;
+  uint64_t m_nFrames;
+  uint64_t m_nBytes;
+
+  void write(const void* pData, size_t size);
+  void writeIndex();
+
+public:
+  RecordingWriter();
+  ~RecordingWriter();
+
+  //! Register a stream. Return its index.
+  uint addStream(const StreamInfo& info);
+  uint getNumStreams() const;
+  const StreamInfo& getStreamInfo(uint stream) const;
+
+  void open(const char* path);
+  bool isOpen() const;
+  //! Write the seek index and close the file.
+  void close();
+
+  //! Append one frame chunk. pData holds size bytes encoded with codec.
+  void writeFrame(const uint stream, const void* pData, const uint64_t size,
+		  const uint64_t timestamp, const int64_t frameIndex,
+		  const uint64_t hostTimestamp, const uint codec=CODEC_RAW);
+
+  uint64_t getNumFrames() const;
+  uint64_t getNumBytes() const;
+};
+
+//!
+//! Random access reader of recording files.
+//! The file is memory mapped, so opening it only reads the headers and the
+//! footer, and reading a frame touches only that frame's chunk.
+//!
+class RecordingReader {
+  struct Mapping;
+
+  std::shared_ptr<Mapping> m_pMapping;
+  std::string m_path;
+  std::vector<StreamInfo> m_streams;
+  std::vector<const IndexEntry*> m_index;
+  std::vector<uint64_t> m_nFrames;
+  std::vector<std::vector<IndexEntry> > m_scannedIndex;
+
+  const uint8_t* getPointer(uint64_t offset, uint64_t size) const;
+  bool readIndex(uint64_t offset);
+  void scanChunks(uint64_t offset);
+
+public:
+  RecordingReader();
+  ~RecordingReader();
+
+  void open(const char* path);
+  bool isOpen() const;
+  void close();
+
+  uint getNumStreams() const;
+  const StreamInfo& getStreamInfo(uint stream) const;
+  //! Return the index of the first stream of sensorType, or -1.
+  int findStream(uint sensorType) const;
+
+  uint64_t getNumFrames(uint stream) const;
+  const ChunkHeader& getChunkHeader(uint stream, uint64_t iFrame) const;
+  //! Encoded payload of the frame. Its size is getChunkHeader().size.
+  const void* getFrameData(uint stream, uint64_t iFrame) const;
+  //! Return the first frame whose device timestamp is not before timestamp.
+  uint64_t findFrame(uint stream, uint64_t timestamp) const;
+
+  //!
+  //! Decode one frame into pDst (width * height * BPP bytes).
+  //! @param pool Pool to decode on, or NULL.
+  //!
+  void readFrame(uint stream, uint64_t iFrame, void* pDst,
+		 ThreadPool* pool=NULL) const;
+  //!
+  //! Return a view of one frame. Raw frames point into the mapped file,
+  //! encoded frames are decoded into a buffer owned by the view.
+  //! @param pool Pool to decode on, or NULL.
+  //!
+  FrameView getFrameView(uint stream, uint64_t iFrame,
+			 ThreadPool* pool=NULL) const;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __OPENNI_INCLUDE_REGISTRATION_HPP__
+#define __OPENNI_INCLUDE_REGISTRATION_HPP__
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+#include "PointCloud.hpp"
+
+class ThreadPool;
+class FrameView;
+class RGBDFrames;
+
+// Nominal distance from the IR to the RGB camera of PrimeSense sensors [m]
+#define DEFAULT_DEPTH_COLOR_BASELINE 0.025f
+
+//!
+//! Pose of the color camera relative to the depth camera:
+//! p_color = R * p_depth + t, with R row-major and t in [m].
+//!
+struct CameraExtrinsics {
+  float R[9];
+  float t[3];
+
+  //! Identity rotation, color camera DEFAULT_DEPTH_COLOR_BASELINE to the
+  //! right of the depth camera.
+  CameraExtrinsics();
+  CameraExtrinsics(const float R[9], const float t[3]);
+};
+
+//! Output pixel (top left of the splat) and depth of one input pixel.
+struct RegistrationTarget {
+  int16_t x, y;
+  uint16_t depth; // 0: nothing to splat
+  uint16_t reserved;
+};
+
+//!
+//! Host side depth to color registration for devices which cannot do it
+//! (see NIDevice::setImageRegistrationMode). Each depth pixel is moved to
+//! the pixel of the color camera it is seen at, and the depth is measured
+//! from the color camera. The output has the size of the input, like the
+//! registration of OpenNI, so the color intrinsics are scaled to it.
+//!
+//! Per pixel remap tables hold the color camera projection of the depth
+//! ray, so mapping a pixel costs a few multiply-adds and one division.
+//! The mapping kernel is chosen at runtime according to getSIMDLevel().
+//! Pixels are splatted into a z-buffer: where several depth pixels land
+//! on one output pixel the nearest wins, and pixels no depth lands on are
+//! 0. Both the mapping and the splatting are split over the pool if one is
+//! given; each thread splats into its own band of output rows, so no
+//! locking is needed.
+//! @note Not thread safe: one instance registers one stream.
+//!
+class DepthRegistration {
+  CameraIntrinsics m_depth, m_color;
+  CameraExtrinsics m_extrinsics;
+  uint m_width, m_height, m_splatSize;
+  //! Per depth pixel: color camera projection (x, y, z) of its ray per unit
+  //! of raw depth.
+  std::vector<float> m_tableX, m_tableY, m_tableZ;
+  //! Color camera projection of t.
+  float m_offset[3];
+  std::vector<RegistrationTarget> m_targets;
+  //! Range of output rows the splats of each input row touch.
+  std::vector<int> m_rowMin, m_rowMax;
+
+  //! Build the tables for width x height if not done yet.
+  void prepare(uint width, uint height);
+
+public:
+  DepthRegistration(const CameraIntrinsics& depth=CameraIntrinsics(),
+		    const CameraIntrinsics& color=CameraIntrinsics(),
+		    const CameraExtrinsics& extrinsics=CameraExtrinsics());
+
+  void setCalibration(const CameraIntrinsics& depth,
+		      const CameraIntrinsics& color,
+		      const CameraExtrinsics& extrinsics);
+  //!
+  //! Side of the square each depth pixel covers in the output.
+  //! 0 (default) derives it from the ratio of the focal lengths.
+  //!
+  void setSplatSize(uint size);
+
+  //!
+  //! Register one depth frame.
+  //! @param pDepth      Depth frame in the unit of the depth intrinsics.
+  //! @param strideBytes Row size of pDepth in byte. 0 for width * 2.
+  //! @param pDst        Registered frame, width * height, not pDepth.
+  //!
+  void apply(const uint16_t* pDepth, uint16_t* pDst, uint width, uint height,
+	     uint strideBytes=0, ThreadPool* pool=NULL);
+  void apply(const FrameView& depth, uint16_t* pDst, ThreadPool* pool=NULL);
+  //! Register every depth frame of frames in place, e.g. a recording
+  //! which was made without registration.
+  void apply(RGBDFrames& frames, ThreadPool* pool=NULL);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __OPENNI_INCLUDE_REPLAYBACKEND_HPP__
+#define __OPENNI_INCLUDE_REPLAYBACKEND_HPP__
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "types.hpp"
+#include "Recording.hpp"
+#include "DeviceBackend.hpp"
+
+//!
+//! Device playing back captured frames at their recorded pace:
+//! a recording file written by the recorder, or a sequence of the TUM
+//! RGB-D dataset (directory with rgb.txt and depth.txt). TUM depth images
+//! (16 bit, 5000 per meter) are converted to 1 mm on the fly.
+//!   replay://PATH?speed=S&loop=0|1
+//! speed scales the playback rate (0: as fast as possible, default 1).
+//! loop restarts at the first frame after the last (default 1).
+//! Each recorded stream serves mode 0 of its sensor. Timestamps of the
+//! frames start at 0 and keep increasing across loops.
+//!
+class ReplayBackend : public ThreadedDeviceBackend {
+  struct Source {
+    openni::SensorType type;
+    StreamInfo info;
+    int stream; // Recording stream, or -1 for TUM files
+    std::vector<std::pair<uint64_t, std::string> > files; // TUM [us], path
+  };
+
+  RecordingReader m_reader;
+  std::vector<Source> m_sources;
+  double m_speed;
+  bool m_bLoop;
+
+  void openRecording(const std::string& path);
+  void openTUM(const std::string& directory);
+  void addTUMSource(const std::string& directory, openni::SensorType type,
+		    const char* list);
+  const Source* findSource(openni::SensorType type) const;
+
+  uint64_t getNumFrames(const Source& source) const;
+  uint64_t getTimestamp(const Source& source, uint64_t iFrame) const;
+  FrameView readFrame(const Source& source, uint64_t iFrame) const;
+
+protected:
+  void run() override;
+
+public:
+  ReplayBackend(const DeviceURI& uri);
+  ~ReplayBackend();
+
+  bool hasSensor(openni::SensorType type) override;
+  void printSensorModes(openni::SensorType type) override;
+  std::unique_ptr<StreamBackend>
+  createStream(openni::SensorType type, int mode, bool mirroring) override;
+};
+
+#endif
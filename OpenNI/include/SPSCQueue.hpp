@@ -0,0 +1,157 @@
+#ifndef __OPENNI_INCLUDE_SPSCQUEUE_HPP__
+#define __OPENNI_INCLUDE_SPSCQUEUE_HPP__
+
+#include <atomic>
+#include <vector>
+#include <utility>
+
+#include <cstdint>
+
+#include "types.hpp"
+#include "FrameNotifier.hpp"
+
+//! What a pipeline stage does when the queue to the next stage is full.
+enum BackpressurePolicy {
+  BACKPRESSURE_BLOCK, // Wait for the next stage. Nothing is lost.
+  BACKPRESSURE_DROP,  // Drop the new item and count it.
+};
+
+//!
+//! Bounded lock-free queue between one producer and one consumer thread,
+//! used to connect pipeline stages. Items are moved in and out of a ring
+//! allocated once by the constructor or reset().
+//! The blocking calls sleep on a FrameNotifier, so an idle stage costs no
+//! CPU. tryPush() and tryPop() only notify, taking its mutex, while the
+//! other side is waiting. close() wakes both sides up: push() then fails,
+//! and pop() fails once the queue is drained.
+//! @note There must be at most one producer and one consumer at a time.
+//!
+template <typename T> class SPSCQueue {
+  std::vector<T> m_slots;
+  std::atomic<uint64_t> m_head; // Next item to pop
+  std::atomic<uint64_t> m_tail; // Next slot to push to
+  std::atomic<bool> m_bClosed;
+  std::atomic<uint> m_maxSize;
+  std::atomic<uint64_t> m_nPushed, m_nDropped;
+  std::atomic<uint> m_nWaiters;
+  FrameNotifier m_notifier;
+
+  void updateMaxSize(uint size) {
+    uint maxSize = m_maxSize.load(std::memory_order_relaxed);
+    while (maxSize < size &&
+	   !m_maxSize.compare_exchange_weak(maxSize, size,
+					    std::memory_order_relaxed));
+  };
+
+  // The fences of waitUntil() and notifyWaiters() order the waiter count
+  // against the indices: either the waiter sees the new index, or the
+  // other side sees the waiter and notifies.
+  template <typename Pred> void waitUntil(Pred pred) {
+    m_nWaiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_notifier.wait(pred);
+    m_nWaiters.fetch_sub(1, std::memory_order_relaxed);
+  };
+
+  void notifyWaiters() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (0 < m_nWaiters.load(std::memory_order_relaxed))
+      m_notifier.notify();
+  };
+
+public:
+  SPSCQueue(uint capacity=1)
+    : m_slots(capacity)
+    , m_head(0)
+    , m_tail(0)
+    , m_bClosed(false)
+    , m_maxSize(0)
+    , m_nPushed(0)
+    , m_nDropped(0)
+    , m_nWaiters(0)
+    , m_notifier()
+  {};
+
+  //! Empty and reopen the queue. Not thread safe.
+  void reset(uint capacity) {
+    m_slots.assign(capacity, T());
+    m_head = m_tail = 0;
+    m_bClosed = false;
+    m_maxSize = 0;
+    m_nPushed = m_nDropped = 0;
+  };
+
+  //! Producer: move value in unless the queue is full or closed.
+  bool tryPush(T& value) {
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    if (m_bClosed.load(std::memory_order_acquire) ||
+	tail - head >= m_slots.size())
+      return false;
+    m_slots[tail % m_slots.size()] = std::move(value);
+    m_tail.store(tail + 1, std::memory_order_release);
+    m_nPushed.fetch_add(1, std::memory_order_relaxed);
+    updateMaxSize(tail + 1 - head);
+    notifyWaiters();
+    return true;
+  };
+
+  //!
+  //! Producer: move value in, applying policy if the queue is full.
+  //! @return false if value was dropped or the queue is closed.
+  //!
+  bool push(T& value, BackpressurePolicy policy=BACKPRESSURE_BLOCK) {
+    while (!tryPush(value)) {
+      if (isClosed())
+	return false;
+      if (BACKPRESSURE_DROP == policy) {
+	m_nDropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+      }
+      waitUntil([this](){ return isClosed() || !isFull(); });
+    }
+    return true;
+  };
+
+  //! Consumer: move the oldest item out unless the queue is empty.
+  bool tryPop(T& value) {
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return false;
+    value = std::move(m_slots[head % m_slots.size()]);
+    m_head.store(head + 1, std::memory_order_release);
+    notifyWaiters();
+    return true;
+  };
+
+  //! Consumer: wait for an item. Return false once closed and drained.
+  bool pop(T& value) {
+    while (!tryPop(value)) {
+      if (isClosed() && isEmpty())
+	return false;
+      waitUntil([this](){ return isClosed() || !isEmpty(); });
+    }
+    return true;
+  };
+
+  //! Refuse new items and wake up waiting threads.
+  void close() {
+    m_bClosed.store(true, std::memory_order_release);
+    m_notifier.notify();
+  };
+
+  bool isClosed() const { return m_bClosed.load(std::memory_order_acquire); };
+  bool isEmpty() const { return 0 == getSize(); };
+  bool isFull() const { return getSize() >= m_slots.size(); };
+  uint getSize() const {
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    return m_tail.load(std::memory_order_acquire) - head;
+  };
+  uint getCapacity() const { return m_slots.size(); };
+  //! Largest number of queued items seen since reset().
+  uint getMaxSize() const { return m_maxSize.load(); };
+  uint64_t getNumPushed() const { return m_nPushed.load(); };
+  uint64_t getNumDropped() const { return m_nDropped.load(); };
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef __OPENNI_INCLUDE_STREAMASSOCIATOR_HPP__
+#define __OPENNI_INCLUDE_STREAMASSOCIATOR_HPP__
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+#include "types.hpp"
+#include "io.hpp"
+
+#define DEFAULT_ASSOCIATION_WINDOW 1000000 // [us]
+
+//!
+//! Online association of timestamped items of N streams, e.g. frames of
+//! the streams of NIDevice or entries of TUM lists. Stream 0 is the base:
+//! every other stream is matched to it greedily in timestamp order as
+//! associate.py does (pair the two oldest items if less than maxDiff
+//! apart, else drop the older one), and a tuple is emitted for every base
+//! item matched in all streams, in base order.
+//!
+//! Items are pushed as they come. An item is decided as soon as the greedy
+//! rule allows: when the item it is compared with is there, or when the
+//! latest timestamp of the other stream shows no item can match any more.
+//! Every push and pop is O(1) amortized, and only undecided items are
+//! kept. If a stream stalls, items older than the window before the newest
+//! push are decided as unmatched, which bounds the memory; a window of 0
+//! waits forever, so the result equals associate.py on sorted input.
+//! @note Timestamps of each stream must not decrease. Thread safe.
+//!
+template <typename T> class StreamAssociator {
+public:
+  struct Item {
+    uint64_t timestamp; // [us]
+    T value;
+  };
+  //! One item per stream, the base item first.
+  typedef std::vector<Item> Tuple;
+
+private:
+  struct Pending {
+    Item base;
+    Tuple tuple;     // Matched items, base item first
+    uint nDecided;   // Number of streams decided on this item
+    uint nMatched;
+  };
+
+  std::mutex m_mutex;
+  uint m_nStreams;
+  uint64_t m_maxDiff, m_window;
+  std::deque<Pending> m_base;
+  uint64_t m_baseFront;              // Number of retired base items
+  std::vector<std::deque<Item> > m_queues;
+  std::vector<uint64_t> m_cursors;   // Next base item of each stream
+  std::vector<uint64_t> m_latest;    // Latest timestamp of each stream
+  std::vector<bool> m_bStarted;
+  std::vector<bool> m_bEnded;
+  uint64_t m_newest;
+  std::deque<Tuple> m_tuples;
+
+  //! Decide the base item at the cursor of stream as unmatched.
+  void skipBase(uint stream) {
+    ++m_base[m_cursors[stream] - m_baseFront].nDecided;
+    ++m_cursors[stream];
+  };
+
+  //! Apply the greedy rule to stream as far as its items allow.
+  void advance(uint stream) {
+    std::deque<Item>& queue = m_queues[stream];
+    uint64_t& cursor = m_cursors[stream];
+    while (cursor < m_baseFront + m_base.size()) {
+      Pending& pending = m_base[cursor - m_baseFront];
+      if (queue.empty()) {
+	// Later items of stream are too late for the base item
+	if (m_bEnded[stream] ||
+	    (m_bStarted[stream] &&
+	     pending.base.timestamp + m_maxDiff <= m_latest[stream]))
+	  skipBase(stream);
+	else
+	  break;
+	continue;
+      }
+      const Item& item = queue.front();
+      int64_t diff = int64_t(pending.base.timestamp - item.timestamp);
+      if (uint64_t(llabs(diff)) < m_maxDiff) {
+	pending.tuple[stream] = item;
+	++pending.nMatched;
+	queue.pop_front();
+	skipBase(stream);
+      } else if (diff < 0) {
+	skipBase(stream);
+      } else {
+	queue.pop_front();
+      }
+    }
+    // Items too early for every later base item
+    while (!queue.empty() &&
+	   (m_bEnded[0] || (m_bStarted[0] &&
+			    queue.front().timestamp + m_maxDiff <= m_latest[0])))
+      queue.pop_front();
+  };
+
+  //! Decide what stalled streams left older than the window as unmatched.
+  void expire() {
+    if (0 == m_window || m_newest < m_window)
+      return;
+    const uint64_t oldest = m_newest - m_window;
+    for (uint stream=1; stream<m_nStreams; ++stream) {
+      std::deque<Item>& queue = m_queues[stream];
+      while (!queue.empty() && queue.front().timestamp < oldest)
+	queue.pop_front();
+      while (m_cursors[stream] < m_baseFront + m_base.size() &&
+	     m_base[m_cursors[stream] - m_baseFront].base.timestamp < oldest)
+	skipBase(stream);
+    }
+  };
+
+  //! Emit or drop the leading base items every stream decided on.
+  void retire() {
+    while (!m_base.empty() && m_nStreams - 1 == m_base.front().nDecided) {
+      Pending& pending = m_base.front();
+      if (m_nStreams - 1 == pending.nMatched) {
+	pending.tuple[0] = pending.base;
+	m_tuples.push_back(std::move(pending.tuple));
+      }
+      m_base.pop_front();
+      ++m_baseFront;
+    }
+  };
+
+public:
+  //!
+  //! @param nStreams Number of streams including the base stream 0.
+  //! @param maxDiff  Matched items are less than this apart [us].
+  //! @param window   Longest wait for a stalled stream [us]. 0: forever.
+  //!
+  StreamAssociator(uint nStreams=2, uint64_t maxDiff=20000,
+		   uint64_t window=DEFAULT_ASSOCIATION_WINDOW)
+    : m_mutex()
+    , m_nStreams(0)
+    , m_maxDiff(maxDiff)
+    , m_window(window)
+  {
+    reset(nStreams);
+  };
+
+  //! Drop every item, e.g. when the streams restart.
+  void reset(uint nStreams) {
+    std::lock_guard<std::mutex> _(m_mutex);
+    if (0 == nStreams)
+      throw RuntimeError(__func__, ": No stream.");
+    m_nStreams = nStreams;
+    m_base.clear();
+    m_baseFront = 0;
+    m_queues.assign(nStreams, std::deque<Item>());
+    m_cursors.assign(nStreams, 0);
+    m_latest.assign(nStreams, 0);
+    m_bStarted.assign(nStreams, false);
+    m_bEnded.assign(nStreams, false);
+    m_newest = 0;
+    m_tuples.clear();
+  };
+
+  uint getNumStreams() const { return m_nStreams; };
+
+  //!
+  //! Add an item of stream.
+  //! @throw RuntimeError if timestamp is older than the previous item of
+  //!   stream, or stream has ended.
+  //!
+  void push(uint stream, uint64_t timestamp, const T& value) {
+    std::lock_guard<std::mutex> _(m_mutex);
+    if (m_nStreams <= stream)
+      throw RuntimeError(__func__, ": Invalid stream ", stream, ".");
+    if (m_bEnded[stream])
+      throw RuntimeError(__func__, ": Stream ", stream, " has ended.");
+    if (m_bStarted[stream] && timestamp < m_latest[stream])
+      throw RuntimeError(__func__, ": Timestamp ", timestamp,
+			 " of stream ", stream, " goes back from ",
+			 m_latest[stream], ".");
+    m_bStarted[stream] = true;
+    m_latest[stream] = timestamp;
+    m_newest = std::max(m_newest, timestamp);
+    Item item = {timestamp, value};
+    if (0 == stream) {
+      m_base.push_back(Pending{item, Tuple(m_nStreams), 0, 0});
+      for (uint i=1; i<m_nStreams; ++i)
+	advance(i);
+    } else {
+      m_queues[stream].push_back(item);
+      advance(stream);
+    }
+    expire();
+    retire();
+  };
+
+  //!
+  //! End of stream: no item will come, so nothing waits for it any more.
+  //! Ending the base stream drops the items of the other streams.
+  //!
+  void end(uint stream) {
+    std::lock_guard<std::mutex> _(m_mutex);
+    if (m_nStreams <= stream)
+      throw RuntimeError(__func__, ": Invalid stream ", stream, ".");
+    m_bEnded[stream] = true;
+    if (0 == stream) {
+      for (uint i=1; i<m_nStreams; ++i)
+	advance(i);
+    } else {
+      advance(stream);
+    }
+    retire();
+  };
+
+  //! End of all streams: decide every item that is left.
+  void flush() {
+    for (uint i=0; i<m_nStreams; ++i)
+      end(i);
+  };
+
+  //! Take the oldest matched tuple. Return false if there is none.
+  bool pop(Tuple& tuple) {
+    std::lock_guard<std::mutex> _(m_mutex);
+    if (m_tuples.empty())
+      return false;
+    tuple = std::move(m_tuples.front());
+    m_tuples.pop_front();
+    return true;
+  };
+
+  //! Number of items kept for decisions.
+  size_t getNumPending() {
+    std::lock_guard<std::mutex> _(m_mutex);
+    size_t n = m_base.size();
+    for (const std::deque<Item>& queue : m_queues)
+      n += queue.size();
+    return n;
+  };
+};
+
+#endif
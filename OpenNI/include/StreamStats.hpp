@@ -0,0 +1,96 @@
+#ifndef __OPENNI_INCLUDE_STREAMSTATS_HPP__
+#define __OPENNI_INCLUDE_STREAMSTATS_HPP__
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+#include "types.hpp"
+#include "FrameView.hpp"
+#include "LatencyHistogram.hpp"
+
+// Stages of a frame from the device to the screen
+enum LatencyStage {
+  STAGE_DRIVER,  // Device timestamp --> backend callback
+  STAGE_CONSUME, // Backend callback --> consumer took the frame
+  STAGE_CONVERT, // Consumer took the frame --> conversion for display done
+  STAGE_PRESENT, // Conversion done --> shown on the screen
+  N_LATENCY_STAGES,
+};
+
+const char* getLatencyStageString(const LatencyStage stage);
+
+//!
+//! Latencies [us] and frame counts of one stream. Streamer records the
+//! arrival and consumption of frames; conversion and presentation are
+//! recorded by whoever does them. All methods are lock-free.
+//!
+//! Device timestamps run on the clock of the device, so STAGE_DRIVER is
+//! measured from the device timestamp mapped to the host clock by the
+//! ClockEstimator of the stream.
+//!
+class StreamStats {
+  LatencyHistogram m_latencies[N_LATENCY_STAGES];
+  std::atomic<uint64_t> m_nArrived;
+  std::atomic<uint64_t> m_nConsumed;
+  std::atomic<uint64_t> m_nDropped;
+
+public:
+  StreamStats();
+
+  void reset();
+  //!
+  //! Frame arrived in the backend callback. Its host timestamp is set.
+  //! @param captured Device timestamp mapped to the host clock [us].
+  //!
+  void recordArrival(const FrameView& frame, uint64_t captured);
+  //!
+  //! Frame taken by the consumer, whose previous frame was lastSequence.
+  //! Frames in between arrived but were never consumed.
+  //!
+  void recordConsume(const FrameView& frame, uint64_t lastSequence);
+  void record(const LatencyStage stage, uint64_t latency);
+  //! Record end - begin, or 0 if the host clock was set back in between.
+  void record(const LatencyStage stage, uint64_t begin, uint64_t end);
+
+  const LatencyHistogram& getLatency(const LatencyStage stage) const;
+  uint64_t getNumArrived() const;
+  uint64_t getNumConsumed() const;
+  //! Number of frames overwritten before any consumer took them.
+  uint64_t getNumDropped() const;
+  //! Dropped frames per arrived frame.
+  double getDropRate() const;
+
+  //! Print p50/p99/max of every stage that has data and the drop rate.
+  void print(const char* name) const;
+  //! One line for a window title: p99 of each stage [ms] and drop rate.
+  std::string getSummary(const char* name) const;
+};
+
+//!
+//! Skew [us] between the device timestamps of paired depth and color frames,
+//! signed as depth minus color. Lock-free like StreamStats.
+//!
+class SkewStats {
+  LatencyHistogram m_magnitude;
+  std::atomic<int64_t> m_sum;
+
+public:
+  SkewStats();
+
+  void reset();
+  void record(int64_t skew);
+
+  uint64_t getCount() const;
+  //! Mean signed skew. Positive if depth is captured after color.
+  double getMean() const;
+  //! Histogram of the magnitude of the skew.
+  const LatencyHistogram& getMagnitude() const;
+
+  //! Print the pair count, mean and p50/p99/max of the magnitude.
+  void print(const char* name) const;
+  //! One line for a window title: p99 of the magnitude [ms].
+  std::string getSummary(const char* name) const;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef __OPENNI_INCLUDE_SYNTHETICBACKEND_HPP__
+#define __OPENNI_INCLUDE_SYNTHETICBACKEND_HPP__
+
+#include <memory>
+#include <vector>
+
+#include "types.hpp"
+#include "BufferPool.hpp"
+#include "DeviceBackend.hpp"
+
+#define DEFAULT_SYNTHETIC_WIDTH  640
+#define DEFAULT_SYNTHETIC_HEIGHT 480
+#define DEFAULT_SYNTHETIC_FPS    30
+
+//!
+//! Device rendering a simple moving scene: a ball swinging in front of a
+//! tilted wall, with invalid pixels in its shadow and at the left border
+//! like a structured light sensor. Depth (1 mm), color (RGB888) and IR
+//! (16 bit) streams share one resolution and frame rate, given by the URI
+//!   synthetic://WIDTHxHEIGHT@FPS
+//! FPS 0 produces frames as fast as possible.
+//!
+class SyntheticBackend : public ThreadedDeviceBackend {
+  uint m_width, m_height;
+  double m_fps;
+  BufferPool<uint8_t> m_buffers[3];
+
+  void renderDepth(uint16_t* pDst, uint64_t iFrame) const;
+  void renderColor(uint8_t* pDst, uint64_t iFrame) const;
+  void renderIR(uint16_t* pDst, uint64_t iFrame) const;
+
+protected:
+  void run() override;
+
+public:
+  SyntheticBackend(const DeviceURI& uri);
+  ~SyntheticBackend();
+
+  bool hasSensor(openni::SensorType type) override;
+  void printSensorModes(openni::SensorType type) override;
+  std::unique_ptr<StreamBackend>
+  createStream(openni::SensorType type, int mode, bool mirroring) override;
+};
+
+#endif
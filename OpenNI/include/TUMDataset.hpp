@@ -0,0 +1,87 @@
+#ifndef __OPENNI_INCLUDE_TUMDATASET_HPP__
+#define __OPENNI_INCLUDE_TUMDATASET_HPP__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+
+#include "types.hpp"
+
+#define TUM_DEPTH_SCALE 5       // TUM depth values per mm
+#define TUM_MAX_DIFF    0.02    // Default association radius [s]
+
+//! One line of a TUM list: "timestamp value value ...".
+struct TUMEntry {
+  double timestamp; // [s]
+  std::vector<std::string> values;
+};
+
+//!
+//! Read a list of the TUM RGB-D dataset, e.g. rgb.txt, depth.txt or
+//! groundtruth.txt. Commas and tabs separate values like spaces, empty
+//! lines and lines starting with # are skipped. Entries are sorted by
+//! timestamp.
+//! @throw RuntimeError if the file can not be read or a timestamp is
+//!   invalid.
+//!
+std::vector<TUMEntry> readTUMList(const std::string& path);
+
+//!
+//! Read a TUM list entry by entry, for lists too long to be kept.
+//! The list must be sorted by timestamp, as the lists of the dataset are.
+//!
+class TUMListReader {
+  std::string m_path;
+  std::ifstream m_file;
+  double m_last;
+  bool m_bStarted;
+
+public:
+  TUMListReader();
+
+  //! @throw RuntimeError if path can not be opened.
+  void open(const std::string& path);
+  bool isOpen() const;
+  void close();
+
+  //!
+  //! Read the next entry. Return false at the end of the list.
+  //! @throw RuntimeError if a timestamp is invalid or goes back.
+  //!
+  bool read(TUMEntry& entry);
+};
+
+//! Entries of several lists associated to one entry of the base list.
+struct TUMAssociation {
+  uint base;                 // Index in the base list
+  std::vector<uint> matches; // Index in each associated list
+};
+
+//!
+//! Associate lists to a base list by timestamp, as associate.py does:
+//! each list is matched to the base list greedily in timestamp order,
+//! pairing entries less than maxDiff [s] apart, and only base entries
+//! matched in every list are kept, in timestamp order.
+//!
+std::vector<TUMAssociation>
+associateTUMLists(const std::vector<TUMEntry>& base,
+		  const std::vector<std::vector<TUMEntry> >& lists,
+		  const double maxDiff=TUM_MAX_DIFF);
+
+//!
+//! Associate TUM list files like associateTUMLists while reading them,
+//! with StreamAssociator: the lists are read interleaved in timestamp
+//! order and only entries not decided yet are kept, so lists of millions
+//! of lines take little memory.
+//! @param fcn Called with the base entry and the entry of each list, in
+//!   the order of the base list.
+//! @return Number of associations.
+//! @throw RuntimeError as TUMListReader::read.
+//!
+size_t associateTUMFiles(const std::string& basePath,
+			 const std::vector<std::string>& listPaths,
+			 std::function<void(const std::vector<TUMEntry>&)> fcn,
+			 const double maxDiff=TUM_MAX_DIFF);
+
+#endif
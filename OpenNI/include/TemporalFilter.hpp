@@ -0,0 +1,96 @@
+#ifndef __OPENNI_INCLUDE_TEMPORALFILTER_HPP__
+#define __OPENNI_INCLUDE_TEMPORALFILTER_HPP__
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+class ThreadPool;
+class FrameView;
+class RGBDFrames;
+
+#define DEFAULT_TEMPORAL_ALPHA  0.4f // Weight of the new depth in the average
+#define DEFAULT_TEMPORAL_DELTA  20   // [mm] larger steps restart the average
+#define DEFAULT_HOLE_WINDOW     4    // Frames of history a hole is filled from
+#define DEFAULT_HOLE_MIN_VALID  1    // Valid frames in the window to fill
+#define TEMPORAL_HISTORY_SIZE   8    // Frames of validity history per pixel
+
+//!
+//! Temporal denoising of depth frames, against the flicker of raw depth,
+//! especially near the range limits of the sensor.
+//!
+//! Each pixel keeps an exponential moving average of its valid (non-zero)
+//! depth, with alpha the weight of the new depth. A step larger than delta
+//! is taken as an edge rather than noise and restarts the average, so
+//! moving objects do not smear. Each pixel also keeps a bit per frame of
+//! the last TEMPORAL_HISTORY_SIZE frames telling whether its depth was
+//! valid; the number of set bits is the confidence of the pixel. A hole
+//! (zero depth) is filled with the average if the pixel was valid in at
+//! least minValid of the last window frames, so pixels which drop out
+//! every other frame are held rather than blinking.
+//!
+//! The average is kept with 4 fractional bits, so small alphas still
+//! converge to the depth. The kernel is chosen at runtime according to
+//! getSIMDLevel(), and rows are split over the pool if one is given.
+//! Frames of another size reset the state.
+//! @note Not thread safe: one instance filters one stream.
+//!
+class DepthTemporalFilter {
+  float m_alpha;
+  uint m_delta, m_window, m_minValid;
+  uint m_width, m_height;
+  std::vector<int32_t> m_average;  // [mm / 16], 0 if never valid
+  std::vector<uint8_t> m_history;  // Bit i: valid i frames ago
+
+public:
+  //! @see setParameters()
+  DepthTemporalFilter(float alpha=DEFAULT_TEMPORAL_ALPHA,
+		      uint delta=DEFAULT_TEMPORAL_DELTA,
+		      uint window=DEFAULT_HOLE_WINDOW,
+		      uint minValid=DEFAULT_HOLE_MIN_VALID);
+
+  //!
+  //! @param alpha    Weight of the new depth, in (0, 1]. 1 disables the
+  //!   averaging.
+  //! @param delta    Largest step in [mm] which is averaged.
+  //! @param window   Frames of history, in [1, TEMPORAL_HISTORY_SIZE], a
+  //!   hole is filled from. The current frame counts, so 1 fills no hole.
+  //! @param minValid Valid frames in the window a hole is filled with, in
+  //!   [1, window].
+  //! @throw RuntimeError if a parameter is out of range.
+  //!
+  void setParameters(float alpha, uint delta, uint window, uint minValid);
+  float getAlpha() const;
+  uint getDelta() const;
+  uint getHoleWindow() const;
+  uint getHoleMinValid() const;
+  //! Forget every frame filtered so far.
+  void reset();
+
+  //!
+  //! Filter one depth frame.
+  //! @param pDepth      Depth frame in [mm].
+  //! @param pDst        Filtered frame, width * height. May be pDepth (then
+  //!   strideBytes applies to both) to filter in place.
+  //! @param strideBytes Row size of pDepth in byte. 0 for width * 2.
+  //!
+  void apply(const uint16_t* pDepth, uint16_t* pDst, uint width, uint height,
+	     uint strideBytes=0, ThreadPool* pool=NULL);
+  void apply(const FrameView& depth, uint16_t* pDst, ThreadPool* pool=NULL);
+  //! Filter every depth frame of frames in place, in order.
+  void apply(RGBDFrames& frames, ThreadPool* pool=NULL);
+
+  //!
+  //! Confidence of each pixel of the last frame: the number of the last
+  //! TEMPORAL_HISTORY_SIZE frames its depth was valid in.
+  //! @param pDst width * height values. Untouched if nothing was filtered.
+  //!
+  void getConfidence(uint8_t* pDst) const;
+  //! Validity history per pixel: bit i is set if it was valid i frames ago.
+  const std::vector<uint8_t>& getHistory() const;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __OPENNI_INCLUDE_THREADPOOL_HPP__
+#define __OPENNI_INCLUDE_THREADPOOL_HPP__
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include "types.hpp"
+
+//!
+//! Persistent pool of worker threads for data parallel loops.
+//! The calling thread takes part in the work, so a pool of N threads
+//! owns N-1 workers. Calls to parallelFor from different threads are
+//! serialized.
+//!
+class ThreadPool {
+  std::vector<std::thread> m_workers;
+  std::mutex m_runMutex;
+  std::mutex m_mutex;
+  std::condition_variable m_taskCond;
+  std::condition_variable m_doneCond;
+
+  std::function<void(uint, uint)> m_task;
+  uint m_begin, m_end, m_nBands, m_nextBand, m_nPending;
+  bool m_bStop;
+  std::exception_ptr m_error;
+
+  void work();
+  bool runBand(std::unique_lock<std::mutex>& lock);
+
+public:
+  //! @param nThreads Number of threads including the caller.
+  //!   0 means one per hardware thread.
+  ThreadPool(uint nThreads=0);
+  ~ThreadPool();
+
+  uint getNumThreads() const;
+
+  //!
+  //! Split [begin, end) into contiguous bands, one per thread, and call
+  //! fcn(bandBegin, bandEnd) for each of them. Return when all bands are
+  //! done. An exception thrown by fcn is rethrown here.
+  //!
+  void parallelFor(uint begin, uint end,
+		   const std::function<void(uint, uint)>& fcn);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __OPENNI_INCLUDE_TRIPLEBUFFER_HPP__
+#define __OPENNI_INCLUDE_TRIPLEBUFFER_HPP__
+
+#include <atomic>
+#include <cstdint>
+
+#include "types.hpp"
+
+//!
+//! Lock-free triple buffer holding the latest value from one producer.
+//! The producer fills the back slot and publishes it, which never waits for
+//! the consumer; unread values are overwritten. The consumer swaps in the
+//! newest published slot and reads it while the producer keeps going.
+//! Every published value gets a sequence number starting from 1, so the
+//! consumer can tell whether it is new.
+//! @note There must be at most one producer and one consumer at a time.
+//!   Concurrent consumers must be serialized by the caller.
+//!
+template <typename T> class TripleBuffer {
+  T m_slots[3];
+  // (sequence number << 2) | index of the slot ready for the consumer
+  std::atomic<uint64_t> m_state;
+  std::atomic<uint64_t> m_latest;
+  uint m_back;
+  uint64_t m_produced;
+  uint m_front;
+  uint64_t m_frontSeq;
+
+public:
+  TripleBuffer()
+    : m_slots()
+    , m_state(1)
+    , m_latest(0)
+    , m_back(2)
+    , m_produced(0)
+    , m_front(0)
+    , m_frontSeq(0)
+  {};
+
+  //! Producer: slot to be filled before publish().
+  T& getBackBuffer() { return m_slots[m_back]; };
+
+  //! Producer: make the back slot the latest value. Return its sequence number.
+  uint64_t publish() {
+    uint64_t seq = ++m_produced;
+    uint64_t old = m_state.exchange((seq << 2) | m_back,
+				    std::memory_order_acq_rel);
+    m_back = old & 3;
+    m_latest.store(seq, std::memory_order_release);
+    return seq;
+  };
+
+  //!
+  //! Consumer: swap in the latest published value if it is newer than the
+  //! front one. Return true if the front slot changed.
+  //!
+  bool update() {
+    uint64_t state = m_state.load(std::memory_order_acquire);
+    if ((state >> 2) <= m_frontSeq)
+      return false;
+    uint64_t old = m_state.exchange((m_frontSeq << 2) | m_front,
+				    std::memory_order_acq_rel);
+    m_front = old & 3;
+    m_frontSeq = old >> 2;
+    return true;
+  };
+
+  //! Consumer: slot swapped in by the last update().
+  T& getFrontBuffer() { return m_slots[m_front]; };
+  //! Consumer: sequence number of the front slot. 0 if nothing was read.
+  uint64_t getFrontSequence() const { return m_frontSeq; };
+
+  //! Sequence number of the latest published value. 0 if none. Thread safe.
+  uint64_t getLatestSequence() const {
+    return m_latest.load(std::memory_order_acquire);
+  };
+};
+
+#endif
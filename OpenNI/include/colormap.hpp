@@ -0,0 +1,54 @@
+#ifndef __OPENNI_INCLUDE_COLORMAP_HPP__
+#define __OPENNI_INCLUDE_COLORMAP_HPP__
+
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+//!
+//! Precomputed jet colormap for one (v_min, v_max) pair.
+//! Each entry holds one output pixel in SDL_PIXELFORMAT_BGRA8888 byte order,
+//! computed with jet(), so the result is identical to calling jet() for
+//! every pixel. Only [v_min, v_max] is tabulated; values outside the range
+//! are clamped onto two sentinel entries (black and white).
+//!
+class JetColormap {
+  uint16_t m_vMin, m_vMax;
+  int m_last;
+  std::vector<uint32_t> m_table;
+
+public:
+  JetColormap(const uint16_t v_min, const uint16_t v_max);
+
+  //!
+  //! Return the cached table for the given range, building it on first use.
+  //! Thread safe. The returned table stays valid while it is referenced,
+  //! even if it is evicted from the cache.
+  //!
+  static std::shared_ptr<const JetColormap> get(const uint16_t v_min,
+						const uint16_t v_max);
+
+  uint16_t getMinValue() const;
+  uint16_t getMaxValue() const;
+
+  //! Return the BGRA8888 pixel (in memory byte order) for val.
+  inline uint32_t lookup(const uint16_t val) const {
+    int i = int(val) - m_vMin + 1;
+    i = (i < 0) ? 0 : i;
+    i = (i > m_last) ? m_last : i;
+    return m_table[i];
+  };
+
+  //!
+  //! Colorize nPixels values into a BGRA8888 buffer.
+  //! @note Same as jet(), the first (alpha) byte of each output pixel is
+  //!   left untouched.
+  //!
+  void apply(const uint16_t* pSrc, uint8_t* pDst, const size_t nPixels) const;
+};
+
+#endif
@@ -4,11 +4,18 @@
 #include <stdexcept>
 #include <string>
 #include <chrono>
+#include <vector>
 
 #include <cstdint>
 #include <cstdlib>
 
 #include "types.hpp"
+#include "PixelFormat.hpp"
+
+class ThreadPool;
+class FrameView;
+class FrameArena;
+class RecordingReader;
 
 class RuntimeError : public std::exception {
   std::string m_message;
@@ -45,17 +52,24 @@ void jet(const uint16_t val, uint8_t& R, uint8_t& G, uint8_t& B,
 
 //!
 //! Convert depth frame (16 bit 1 ch) to RGB frame (8bit 3ch) using jet
-//! colormap.
+//! colormap. The mapping is looked up from a cached JetColormap table, so
+//! the output is identical to calling jet() on every pixel.
 //! @param format Inidicates the alignment of output buffer.
 //!   1: ARGB == SDL_PIXELFORMAT_BGRA8888
 //! @param v_min Minimum value to trancate. Unit: [mm]
 //! @param v_max Maximum value to trancate. Unit: [mm]
+//! @param pool  If given, rows are split into bands processed on the pool.
+//! @param dstStride Row size of pDst in byte, e.g. the pitch of a locked
+//!   texture. 0 for width * 4.
+//! @param srcStride Row size of pSrc in byte. 0 for width * 2.
 //!
 void convert16BitFrameToJet(const uint16_t* pSrc, uint8_t* pDst,
 			    const uint width, const uint height,
 			    const uint format=1,
 			    const uint16_t v_min = DEFAULT_DEPTH_MIN,
-			    const uint16_t v_max = DEFAULT_DEPTH_MAX);
+			    const uint16_t v_max = DEFAULT_DEPTH_MAX,
+			    ThreadPool* pool=NULL, const uint dstStride=0,
+			    const uint srcStride=0);
 
 //!
 //! Copy one frame data from source to destination buffer (both preallocated).
@@ -68,64 +82,187 @@ void convert16BitFrameToJet(const uint16_t* pSrc, uint8_t* pDst,
 //!   is skipped.
 //! @param padding Padding in byte. At the end of each pixel, this size of
 //!   buffer is skipped.
+//! @param pool    If given, rows are split into bands processed on the pool.
+//! @param dstStride Row size of pDst in byte, e.g. the pitch of a locked
+//!   texture. 0 for width * (BPP + padding).
+//! @param srcStride Row size of pSrc in byte. 0 for width * BPP.
+//! @note Plain copies (padding == 0) and 3 to 4 byte expansion (BPP == 3,
+//!   padding == 1) use vectorized kernels. See simd.hpp.
 //!
 void copyFrame(const void* pSrc, void* pDst,
 	       const uint width, const uint height,
-	       const uint BPP, const int offset=0, const int padding=0);
+	       const uint BPP, const int offset=0, const int padding=0,
+	       ThreadPool* pool=NULL, const uint dstStride=0,
+	       const uint srcStride=0);
 
 std::chrono::microseconds getCurrentTimestamp();
+//! Host time of the steady clock, which never jumps. Used for frame arrival.
+std::chrono::microseconds getSteadyTimestamp();
+
+//! Timing of one stored frame.
+struct FrameInfo {
+  uint64_t timestamp;     // Device timestamp [us]
+  int      frameIndex;    // Device frame index, -1 if unknown
+  uint64_t hostTimestamp; // Host arrival time [us] (getSteadyTimestamp)
+};
 
+//!
+//! Ring of frames of any pixel format, given as BPP at runtime.
+//! See FrameBuffer for frames of a pixel format known at compile time.
+//! The buffer is ARENA_ALIGNMENT aligned, and taken from a FrameArena if
+//! one is given, e.g. to have a long ring prefaulted before capture.
+//!
 class Frames {
   uint m_width, m_height, m_BPP, m_nFrames, m_currentFrame;
+  uint m_fixedBPP;
   void *m_pBuffer;
+  FrameArena* m_pArena;
+  std::vector<FrameInfo> m_info;
+
+protected:
+  //! Frames which only take BPP byte pixels, see FrameBuffer.
+  explicit Frames(uint BPP);
 
 public:
   Frames();
   ~Frames();
 
   void deallocate();
-  void allocate(uint width=0, uint height=0, uint BPP=4, uint nFrames=0);
+  //!
+  //! @param pArena Arena to take the buffer from. It must outlive it.
+  //! @throw RuntimeError if this is a FrameBuffer of another pixel size.
+  //!
+  void allocate(uint width=0, uint height=0, uint BPP=4, uint nFrames=0,
+		FrameArena* pArena=NULL);
+  //!
+  //! Allocate and fill with all frames of one stream of a recording.
+  //! @throw RuntimeError if BPP is not 0 and the stream has another BPP.
+  //!
+  void load(const RecordingReader& reader, uint stream, uint BPP=0);
 
   uint getWidth();
   uint getHeight();
+  uint getBPP();
   uint getNumFrames();
   uint getFrameIndex();
   void setFrameIndex(int iFrame);
   void incrementFrameIndex();
 
   void* getFrame(int iFrame=-1);
-  void copyFrameTo(void* pDst, int iFrame=-1, int offset=0, int padding=0);
+  const FrameInfo& getFrameInfo(int iFrame=-1);
+  //! View of a frame with its timestamps. It does not keep the frame alive.
+  FrameView getFrameView(int iFrame=-1);
+  //!
+  //! Copy frame with its timestamps into the current slot and move on to
+  //! the next one.
+  //!
+  void store(const FrameView& frame, ThreadPool* pool=NULL);
+  void copyFrameTo(void* pDst, int iFrame=-1, int offset=0, int padding=0,
+		   ThreadPool* pool=NULL, uint dstStride=0);
   void convert16BitFrameToJet(uint8_t* pDst, int iFrame,
 			      const uint16_t v_min, const uint16_t v_max,
-			      const uint format=1);
-  void copyCurrentFrameTo(void* pDst, int offset=0, int padding=0);
+			      const uint format=1, ThreadPool* pool=NULL,
+			      uint dstStride=0);
+  void copyCurrentFrameTo(void* pDst, int offset=0, int padding=0,
+			  ThreadPool* pool=NULL);
   void convertCurrent16BitFrameToJet(uint8_t* pDst,
 				     const uint16_t v_min, const uint16_t v_max,
-				     const uint format=1);
+				     const uint format=1, ThreadPool* pool=NULL);
+};
+
+//!
+//! Frames of the pixel format Pixel (see PixelFormat.hpp). Frames are
+//! handed out as Pixel arrays, and copies and conversions use the kernel
+//! of PixelConversion chosen at compile time. It is still a Frames, so it
+//! can be passed to code which handles any pixel format.
+//!
+template <typename Pixel> class FrameBuffer : public Frames {
+public:
+  FrameBuffer() : Frames(sizeof(Pixel)) {};
+
+  //! Named apart from Frames::allocate(), whose third argument is the BPP.
+  void allocateFrames(uint width=0, uint height=0, uint nFrames=0,
+		      FrameArena* pArena=NULL) {
+    Frames::allocate(width, height, sizeof(Pixel), nFrames, pArena);
+  };
+  //! The BPP is the one of Pixel: use allocateFrames().
+  void allocate(uint width=0, uint height=0, uint BPP=4, uint nFrames=0,
+		FrameArena* pArena=NULL) = delete;
+  //! @throw RuntimeError if the stream is not of this pixel size.
+  void load(const RecordingReader& reader, uint stream) {
+    Frames::load(reader, stream, sizeof(Pixel));
+  };
+
+  Pixel* getFrame(int iFrame=-1) {
+    return static_cast<Pixel *>(Frames::getFrame(iFrame));
+  };
+
+  //!
+  //! Convert frame iFrame to pDst, e.g. into a locked BGRA8888 texture.
+  //! @param dstStride Row size of pDst in byte. 0 for width * sizeof(Dst).
+  //!
+  template <typename Dst>
+  void convertTo(Dst* pDst, int iFrame=-1, ThreadPool* pool=NULL,
+		 uint dstStride=0) {
+    convertFrame(getFrame(iFrame), pDst, getWidth(), getHeight(), pool,
+		 dstStride);
+  };
+
+  //! Jet colormap of a 16 bit frame. See ::convert16BitFrameToJet.
+  void convertToJet(BGRA8888* pDst, int iFrame,
+		    const uint16_t v_min, const uint16_t v_max,
+		    ThreadPool* pool=NULL, uint dstStride=0) {
+    static_assert(2 == sizeof(Pixel), "Not a 16 bit pixel format.");
+    ::convert16BitFrameToJet(reinterpret_cast<const uint16_t *>(getFrame(iFrame)),
+			     reinterpret_cast<uint8_t *>(pDst), getWidth(),
+			     getHeight(), 1, v_min, v_max, pool, dstStride);
+  };
 };
 
 class RGBDFrames {
-  Frames m_depthFrames, m_colorFrames;
+  FrameBuffer<Depth16> m_depthFrames;
+  FrameBuffer<RGB888> m_colorFrames;
 public:
   RGBDFrames();
   ~RGBDFrames();
 
   void deallocate();
-  void allocate(uint depthW, uint depthH, uint colorW, uint colorH, uint nFrames);
+  void allocate(uint depthW, uint depthH, uint colorW, uint colorH, uint nFrames,
+		FrameArena* pArena=NULL);
+  //!
+  //! Load the depth and color streams of a recording.
+  //! @note If the streams have different numbers of frames, the frame index
+  //!   is bounded by the depth stream.
+  //!
+  void load(const RecordingReader& reader);
 
   uint getNumFrames();
   void incrementFrameIndex();
   uint getFrameIndex();
   void setFrameIndex(int iFrame);
 
+  uint getDepthWidth();
+  uint getDepthHeight();
+  uint getColorWidth();
+  uint getColorHeight();
+
+  FrameBuffer<Depth16>& getDepthFrames();
+  FrameBuffer<RGB888>& getColorFrames();
   uint8_t* getColorFrame(int iFrame=-1);
   uint16_t* getDepthFrame(int iFrame=-1);
+  const FrameInfo& getColorFrameInfo(int iFrame=-1);
+  const FrameInfo& getDepthFrameInfo(int iFrame=-1);
+  //! Depth minus color device timestamp of a frame pair [us].
+  int64_t getSyncSkew(int iFrame=-1);
 
-  void copyDepthFrameTo(uint16_t* pDst, int iFrame=-1, uint offset=0, uint padding=0);
-  void copyColorFrameTo(uint8_t* pDst, int iFrame=-1, uint offset=0, uint padding=0);
+  void copyDepthFrameTo(uint16_t* pDst, int iFrame=-1, uint offset=0, uint padding=0,
+			ThreadPool* pool=NULL, uint dstStride=0);
+  void copyColorFrameTo(uint8_t* pDst, int iFrame=-1, uint offset=0, uint padding=0,
+			ThreadPool* pool=NULL, uint dstStride=0);
   void convert16BitFrameToJet(uint8_t* pDst, int iFrame,
 			      const uint16_t v_min, const uint16_t v_max,
-			      const uint color_format=1);
+			      const uint color_format=1, ThreadPool* pool=NULL,
+			      uint dstStride=0);
 };
 
 
@@ -0,0 +1,43 @@
+#ifndef __OPENNI_INCLUDE_NPYIO_HPP__
+#define __OPENNI_INCLUDE_NPYIO_HPP__
+
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+//!
+//! Sequential writer of a NumPy .npy file (format version 1.0, C order).
+//! The shape is known up front, so the data is streamed to the file as it
+//! is produced and the result can be loaded with
+//! numpy.load(path, mmap_mode='r') without reading it into memory.
+//!
+class NpyWriter {
+  std::FILE* m_pFile;
+  std::string m_path;
+  uint64_t m_nBytes;    // Data size given by the shape
+  uint64_t m_nWritten;
+
+public:
+  NpyWriter();
+  ~NpyWriter();
+
+  //!
+  //! @param descr    NumPy type string, e.g. "<u2" for little endian uint16.
+  //! @param itemSize Size of one element in byte.
+  //! @param shape    Dimensions, outermost first.
+  //!
+  void open(const char* path, const char* descr, uint itemSize,
+	    const std::vector<uint64_t>& shape);
+  bool isOpen() const;
+  //! Append size bytes of elements in C order.
+  void write(const void* pData, size_t size);
+  //! @throw RuntimeError if less data than the shape was written.
+  void close();
+};
+
+#endif
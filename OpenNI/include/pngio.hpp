@@ -0,0 +1,25 @@
+#ifndef __OPENNI_INCLUDE_PNGIO_HPP__
+#define __OPENNI_INCLUDE_PNGIO_HPP__
+
+#include <vector>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+//!
+//! Decode a PNG file, e.g. a frame of the TUM RGB-D dataset.
+//! Palette and low bit depth images are expanded to 8 bit and alpha is
+//! dropped, so the result is 8 bit gray (BPP 1), RGB888 (BPP 3) or 16 bit
+//! gray (BPP 2) in host byte order.
+//! @param path   Path to the file.
+//! @param data   Output pixels, resized to width * height * BPP.
+//! @param width  Output width.
+//! @param height Output height.
+//! @param BPP    Output byte per pixel.
+//!
+void readPNG(const char* path, std::vector<uint8_t>& data,
+	     uint& width, uint& height, uint& BPP);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __OPENNI_INCLUDE_SIMD_HPP__
+#define __OPENNI_INCLUDE_SIMD_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "types.hpp"
+
+//! Instruction set extensions used by the dispatched kernels.
+enum SIMDLevel {
+  SIMD_NONE  = 0,
+  SIMD_SSSE3 = 1,
+  SIMD_AVX2  = 2,
+};
+
+//!
+//! Return the best instruction set supported by the running CPU.
+//! The result is detected once and cached.
+//!
+SIMDLevel getSIMDLevel();
+const char* getSIMDLevelString(const SIMDLevel level);
+
+//!
+//! Expand 3 byte pixels to 4 byte pixels. The bytes of pixel i are copied to
+//! pDst[4*i], pDst[4*i+1] and pDst[4*i+2], and pDst[4*i+3] is left untouched.
+//! Equivalent to copyFrame(pSrc, pDst, nPixels, 1, 3, 0, 1).
+//! @note The kernel is chosen at runtime according to getSIMDLevel().
+//!
+void expand3To4(const uint8_t* pSrc, uint8_t* pDst, const size_t nPixels);
+
+#endif
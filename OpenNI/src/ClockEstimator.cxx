@@ -0,0 +1,86 @@
+#include "ClockEstimator.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+ClockEstimator::ClockEstimator()
+  : m_mutex()
+  , m_bValid(false)
+  , m_lastDevice(0)
+  , m_anchor(0)
+  , m_offset(0)
+  , m_drift(0.0)
+  , m_bPrevBlock(false)
+  , m_prevDevice(0)
+  , m_blockDevice(0)
+  , m_prevOffset(0)
+  , m_blockOffset(0)
+  , m_nBlock(0)
+{}
+
+void ClockEstimator::clear() {
+  m_bValid = false;
+  m_drift = 0.0;
+  m_bPrevBlock = false;
+  m_nBlock = 0;
+}
+
+void ClockEstimator::reset() {
+  std::lock_guard<std::mutex> _(m_mutex);
+  clear();
+}
+
+double ClockEstimator::getOffset(uint64_t device) const {
+  return m_offset + m_drift * (double(device) - double(m_anchor));
+}
+
+void ClockEstimator::update(uint64_t device, uint64_t host) {
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (m_bValid && device < m_lastDevice)
+    clear();
+  m_lastDevice = device;
+  int64_t offset = int64_t(host - device);
+
+  if (!m_bValid || offset < getOffset(device)) {
+    m_anchor = device;
+    m_offset = offset;
+    m_bValid = true;
+  }
+
+  if (0 == m_nBlock || offset < m_blockOffset) {
+    m_blockDevice = device;
+    m_blockOffset = offset;
+  }
+  if (++m_nBlock < CLOCK_BLOCK_SIZE)
+    return;
+
+  // Block done: fit the line through the minima of the last two blocks.
+  if (m_bPrevBlock && m_prevDevice < m_blockDevice) {
+    double drift = double(m_blockOffset - m_prevOffset)
+      / double(m_blockDevice - m_prevDevice);
+    m_drift = std::min(CLOCK_MAX_DRIFT, std::max(-CLOCK_MAX_DRIFT, drift));
+    m_anchor = m_blockDevice;
+    m_offset = m_blockOffset;
+  }
+  m_bPrevBlock = true;
+  m_prevDevice = m_blockDevice;
+  m_prevOffset = m_blockOffset;
+  m_nBlock = 0;
+}
+
+bool ClockEstimator::isValid() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_bValid;
+}
+
+uint64_t ClockEstimator::toHost(uint64_t device) const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (!m_bValid)
+    return 0;
+  return uint64_t(int64_t(device) + llround(getOffset(device)));
+}
+
+double ClockEstimator::getDrift() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_drift;
+}
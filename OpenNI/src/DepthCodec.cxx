@@ -0,0 +1,250 @@
+#include "DepthCodec.hpp"
+#include "ThreadPool.hpp"
+#include "io.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+//
+// Tokens of one band, row by row
+//   0x00 - 0x7e            zigzag residual 0 - 126
+//   0x7f, varint           run of (varint + 1) zero pixels
+//   0x80 - 0xbf, 1 byte    zigzag residual < 2^14
+//   0xc0 - 0xc1, 2 byte    zigzag residual < 2^17
+//
+#define TOKEN_ZERO_RUN 0x7f
+#define TOKEN_MAX_SIZE 3 // [byte/pixel]
+
+static inline uint32_t zigzag(int32_t r) {
+  return (uint32_t(r) << 1) ^ uint32_t(r >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t z) {
+  return int32_t(z >> 1) ^ -int32_t(z & 1);
+}
+
+static inline void put32(uint8_t* p, uint32_t v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t get32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Prediction at the start of a row: the pixel above if it is valid,
+// otherwise the last valid pixel seen in the band.
+static inline uint16_t predictRowStart(const uint16_t* pAbove, uint16_t last) {
+  return (pAbove && *pAbove) ? *pAbove : last;
+}
+
+// Prediction of a valid pixel: the mean of the previous valid pixel of the
+// row and the pixel above, or only the former if the pixel above is invalid.
+static inline int32_t predict(uint16_t left, const uint16_t* pAbove, uint x) {
+  if (pAbove && pAbove[x])
+    return (int32_t(left) + pAbove[x] + 1) >> 1;
+  return left;
+}
+
+static size_t tokenizeBand(const uint8_t* pSrc, const size_t stride,
+			   const uint width, const uint nRows, uint8_t* pDst) {
+  uint8_t* p = pDst;
+  const uint16_t* pAbove = NULL;
+  uint16_t last = 0;
+  for (uint y=0; y<nRows; ++y) {
+    const uint16_t* pRow = (const uint16_t*) (pSrc + y * stride);
+    uint16_t pred = predictRowStart(pAbove, last);
+    uint x = 0;
+    while (x < width) {
+      uint16_t v = pRow[x];
+      if (0 == v) {
+	uint run = 1;
+	while (x + run < width && 0 == pRow[x + run])
+	  ++run;
+	x += run;
+	*p++ = TOKEN_ZERO_RUN;
+	for (--run; run >= 0x80; run >>= 7)
+	  *p++ = uint8_t(run | 0x80);
+	*p++ = uint8_t(run);
+	continue;
+      }
+      uint32_t z = zigzag(int32_t(v) - predict(pred, pAbove, x));
+      if (z < TOKEN_ZERO_RUN) {
+	*p++ = uint8_t(z);
+      } else if (z < 0x4000) {
+	*p++ = uint8_t(0x80 | (z >> 8));
+	*p++ = uint8_t(z);
+      } else {
+	*p++ = uint8_t(0xc0 | (z >> 16));
+	*p++ = uint8_t(z >> 8);
+	*p++ = uint8_t(z);
+      }
+      pred = v;
+      ++x;
+    }
+    last = pred;
+    pAbove = pRow;
+  }
+  return p - pDst;
+}
+
+static void untokenizeBand(const uint8_t* pSrc, const size_t size,
+			   const uint width, const uint nRows, uint16_t* pDst) {
+  const uint8_t* p = pSrc;
+  const uint8_t* pEnd = pSrc + size;
+  const uint16_t* pAbove = NULL;
+  uint16_t last = 0;
+  for (uint y=0; y<nRows; ++y) {
+    uint16_t* pRow = pDst + size_t(y) * width;
+    uint16_t pred = predictRowStart(pAbove, last);
+    uint x = 0;
+    while (x < width) {
+      if (p >= pEnd)
+	throw RuntimeError(__func__, ": Truncated band.");
+      uint32_t b = *p++;
+      if (TOKEN_ZERO_RUN == b) {
+	uint32_t run = 0;
+	uint shift = 0;
+	do {
+	  if (p >= pEnd || shift > 28)
+	    throw RuntimeError(__func__, ": Bad zero run.");
+	  b = *p++;
+	  run |= (b & 0x7f) << shift;
+	  shift += 7;
+	} while (b & 0x80);
+	if (run >= width - x)
+	  throw RuntimeError(__func__, ": Zero run exceeds the row.");
+	memset(pRow + x, 0, (run + 1) * sizeof(uint16_t));
+	x += run + 1;
+	continue;
+      }
+      uint32_t z = b;
+      if (b >= 0xc0) {
+	if (p + 2 > pEnd)
+	  throw RuntimeError(__func__, ": Truncated band.");
+	z = ((b & 0x3f) << 16) | (uint32_t(p[0]) << 8) | p[1];
+	p += 2;
+      } else if (b >= 0x80) {
+	if (p + 1 > pEnd)
+	  throw RuntimeError(__func__, ": Truncated band.");
+	z = ((b & 0x3f) << 8) | p[0];
+	p += 1;
+      }
+      pred = uint16_t(predict(pred, pAbove, x) + unzigzag(z));
+      pRow[x++] = pred;
+    }
+    last = pred;
+    pAbove = pRow;
+  }
+  if (p != pEnd)
+    throw RuntimeError(__func__, ": ", pEnd - p, " trailing bytes in band.");
+}
+
+DepthCodec::DepthCodec(ThreadPool* pool, int level)
+  : m_pPool(pool)
+  , m_level(level)
+  , m_tokens()
+  , m_bands()
+{}
+
+void DepthCodec::encode(const uint16_t* pSrc, uint width, uint height,
+			std::vector<uint8_t>& dst, uint stride) {
+  if (0 == stride)
+    stride = width * sizeof(uint16_t);
+  const uint nBands = (height + DEPTH_CODEC_BAND_HEIGHT - 1)
+    / DEPTH_CODEC_BAND_HEIGHT;
+  m_tokens.resize(nBands);
+  m_bands.resize(nBands);
+
+  auto encodeBands = [&](uint b0, uint b1){
+    for (uint b=b0; b<b1; ++b) {
+      const uint y0 = b * DEPTH_CODEC_BAND_HEIGHT;
+      const uint nRows = std::min(height - y0, uint(DEPTH_CODEC_BAND_HEIGHT));
+      std::vector<uint8_t>& tokens = m_tokens[b];
+      std::vector<uint8_t>& band = m_bands[b];
+      tokens.resize(size_t(width) * nRows * TOKEN_MAX_SIZE);
+      size_t nTokens = tokenizeBand((const uint8_t*) pSrc + size_t(y0) * stride,
+				    stride, width, nRows, tokens.data());
+      uLongf size = compressBound(nTokens);
+      band.resize(sizeof(uint32_t) + size);
+      put32(band.data(), nTokens);
+      int ret = compress2(band.data() + sizeof(uint32_t), &size,
+			  tokens.data(), nTokens, m_level);
+      if (Z_OK != ret)
+	throw RuntimeError(__func__, ": zlib error ", ret, ".");
+      band.resize(sizeof(uint32_t) + size);
+    }
+  };
+  if (!m_pPool)
+    encodeBands(0, nBands);
+  else
+    m_pPool->parallelFor(0, nBands, encodeBands);
+
+  size_t size = (2 + nBands) * sizeof(uint32_t);
+  for (const auto& band : m_bands)
+    size += band.size();
+  dst.resize(size);
+  uint8_t* p = dst.data();
+  put32(p, DEPTH_CODEC_BAND_HEIGHT);
+  put32(p + sizeof(uint32_t), nBands);
+  p += 2 * sizeof(uint32_t);
+  for (uint b=0; b<nBands; ++b, p+=sizeof(uint32_t))
+    put32(p, m_bands[b].size());
+  for (const auto& band : m_bands) {
+    memcpy(p, band.data(), band.size());
+    p += band.size();
+  }
+}
+
+void DepthCodec::decode(const void* pSrc, size_t size,
+			uint16_t* pDst, uint width, uint height) const {
+  const uint8_t* pData = (const uint8_t*) pSrc;
+  if (size < 2 * sizeof(uint32_t))
+    throw RuntimeError(__func__, ": Payload too short (", size, " byte).");
+  const uint bandHeight = get32(pData);
+  const uint nBands = get32(pData + sizeof(uint32_t));
+  if (0 == bandHeight ||
+      nBands != (uint64_t(height) + bandHeight - 1) / bandHeight)
+    throw RuntimeError(__func__, ": Payload does not match a ", width, "x",
+		       height, " frame.");
+  const size_t headerSize = (2 + size_t(nBands)) * sizeof(uint32_t);
+  if (size < headerSize)
+    throw RuntimeError(__func__, ": Truncated band table.");
+
+  std::vector<size_t> offsets(nBands + 1, headerSize);
+  for (uint b=0; b<nBands; ++b) {
+    uint32_t bandSize = get32(pData + (2 + b) * sizeof(uint32_t));
+    if (bandSize < sizeof(uint32_t))
+      throw RuntimeError(__func__, ": Bad size of band ", b, ".");
+    offsets[b + 1] = offsets[b] + bandSize;
+  }
+  if (offsets[nBands] > size)
+    throw RuntimeError(__func__, ": Truncated payload (", size, " of ",
+		       offsets[nBands], " byte).");
+
+  auto decodeBands = [&](uint b0, uint b1){
+    std::vector<uint8_t> tokens;
+    for (uint b=b0; b<b1; ++b) {
+      const uint y0 = b * bandHeight;
+      const uint nRows = std::min(height - y0, bandHeight);
+      const uint8_t* pBand = pData + offsets[b];
+      uLongf nTokens = get32(pBand);
+      if (nTokens > size_t(width) * nRows * TOKEN_MAX_SIZE)
+	throw RuntimeError(__func__, ": Bad token size of band ", b, ".");
+      tokens.resize(nTokens);
+      int ret = uncompress(tokens.data(), &nTokens, pBand + sizeof(uint32_t),
+			   offsets[b + 1] - offsets[b] - sizeof(uint32_t));
+      if (Z_OK != ret || nTokens != tokens.size())
+	throw RuntimeError(__func__, ": zlib error ", ret, " in band ", b, ".");
+      untokenizeBand(tokens.data(), nTokens, width, nRows,
+		     pDst + size_t(y0) * width);
+    }
+  };
+  if (!m_pPool)
+    decodeBands(0, nBands);
+  else
+    m_pPool->parallelFor(0, nBands, decodeBands);
+}
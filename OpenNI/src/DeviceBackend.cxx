@@ -0,0 +1,203 @@
+#include "DeviceBackend.hpp"
+#include "OpenNIBackend.hpp"
+#include "ReplayBackend.hpp"
+#include "SyntheticBackend.hpp"
+#include "NIDevice.hpp"
+#include "io.hpp"
+
+#include <cstring>
+
+using namespace openni;
+
+DeviceURI::DeviceURI(const char* uri)
+  : scheme()
+  , path()
+  , params()
+{
+  std::string str = uri ? uri : "";
+  size_t pos = str.find("://");
+  if (std::string::npos == pos) {
+    path = str;
+    return;
+  }
+  scheme = str.substr(0, pos);
+  str = str.substr(pos + 3);
+  pos = str.find('?');
+  path = str.substr(0, pos);
+  while (std::string::npos != pos) {
+    size_t begin = pos + 1;
+    pos = str.find('&', begin);
+    std::string param = str.substr(begin, pos - begin);
+    if (param.empty())
+      continue;
+    size_t eq = param.find('=');
+    if (std::string::npos == eq)
+      params[param] = "1";
+    else
+      params[param.substr(0, eq)] = param.substr(eq + 1);
+  }
+}
+
+std::string DeviceURI::get(const std::string& key,
+			   const std::string& value) const {
+  auto it = params.find(key);
+  return (params.end() == it) ? value : it->second;
+}
+
+double DeviceURI::get(const std::string& key, double value) const {
+  auto it = params.find(key);
+  if (params.end() == it)
+    return value;
+  try {
+    return std::stod(it->second);
+  } catch (const std::exception&) {
+    throw RuntimeError(__func__, ": Invalid value of ", key, ": ",
+		       it->second, ".");
+  }
+}
+
+std::unique_ptr<DeviceBackend> openDeviceBackend(const char* uri) {
+  DeviceURI parsed(uri);
+  if (parsed.scheme == "replay")
+    return std::unique_ptr<DeviceBackend>(new ReplayBackend(parsed));
+  if (parsed.scheme == "synthetic")
+    return std::unique_ptr<DeviceBackend>(new SyntheticBackend(parsed));
+  return std::unique_ptr<DeviceBackend>(new OpenNIBackend(uri));
+}
+
+class ThreadedDeviceBackend::Stream : public StreamBackend {
+  ThreadedDeviceBackend* m_pDevice;
+  SensorType m_type;
+  uint m_width, m_height;
+  PixelFormat m_format;
+  int m_minValue, m_maxValue;
+  bool m_bStarted;
+public:
+  Stream(ThreadedDeviceBackend* pDevice, SensorType type,
+	 uint width, uint height, PixelFormat format,
+	 int minValue, int maxValue)
+    : m_pDevice(pDevice)
+    , m_type(type)
+    , m_width(width)
+    , m_height(height)
+    , m_format(format)
+    , m_minValue(minValue)
+    , m_maxValue(maxValue)
+    , m_bStarted(false)
+  {};
+  ~Stream() { stop(); };
+
+  uint getWidth() const override { return m_width; };
+  uint getHeight() const override { return m_height; };
+  PixelFormat getPixelFormat() const override { return m_format; };
+  int getMinValue() const override { return m_minValue; };
+  int getMaxValue() const override { return m_maxValue; };
+
+  void start(const FrameCallback& callback) override {
+    if (m_bStarted)
+      throw RuntimeError(__func__, ": ", getSensorTypeString(m_type),
+			 " stream is already started.");
+    m_pDevice->startStream(m_type, callback);
+    m_bStarted = true;
+  };
+
+  void stop() override {
+    if (m_bStarted) {
+      m_pDevice->stopStream(m_type);
+      m_bStarted = false;
+    }
+  };
+};
+
+ThreadedDeviceBackend::ThreadedDeviceBackend()
+  : m_mutex()
+  , m_callbacks()
+  , m_nStarted(0)
+  , m_thread()
+  , m_bStop(false)
+  , m_sleepMutex()
+  , m_sleepCond()
+{}
+
+ThreadedDeviceBackend::~ThreadedDeviceBackend() {
+  stopThread();
+}
+
+void ThreadedDeviceBackend::startStream(SensorType type,
+					const FrameCallback& callback) {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_callbacks[type-1] = callback;
+    ++m_nStarted;
+  }
+  // Restart, so that streams started one after another all get the first
+  // frame, e.g. of a recording.
+  stopThread();
+  m_bStop = false;
+  m_thread = std::thread([this](){
+      try {
+	run();
+      } catch (const std::exception& e) {
+	printf("%s\n", e.what());
+      }
+    });
+}
+
+void ThreadedDeviceBackend::stopStream(SensorType type) {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_callbacks[type-1] = nullptr;
+    if (0 < --m_nStarted)
+      return;
+  }
+  stopThread();
+}
+
+void ThreadedDeviceBackend::stopThread() {
+  m_bStop = true;
+  {
+    std::lock_guard<std::mutex> _(m_sleepMutex);
+  }
+  m_sleepCond.notify_all();
+  if (m_thread.joinable() && std::this_thread::get_id() != m_thread.get_id())
+    m_thread.join();
+}
+
+bool ThreadedDeviceBackend::isStopping() const {
+  return m_bStop;
+}
+
+bool ThreadedDeviceBackend::sleepUntil(std::chrono::steady_clock::time_point
+				       time) {
+  std::unique_lock<std::mutex> lock(m_sleepMutex);
+  return !m_sleepCond.wait_until(lock, time, [this](){ return isStopping(); });
+}
+
+void ThreadedDeviceBackend::deliver(SensorType type, const FrameView& frame) {
+  // Holding the mutex makes stopStream() wait for a running callback.
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (m_callbacks[type-1])
+    m_callbacks[type-1](frame);
+}
+
+bool ThreadedDeviceBackend::isStreamStarted(SensorType type) {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return (bool) m_callbacks[type-1];
+}
+
+std::unique_ptr<StreamBackend>
+ThreadedDeviceBackend::createThreadedStream(SensorType type,
+					    uint width, uint height,
+					    PixelFormat format,
+					    int minValue, int maxValue) {
+  return std::unique_ptr<StreamBackend>(new Stream(this, type, width, height,
+						   format, minValue, maxValue));
+}
+
+void ThreadedDeviceBackend::setImageRegistration(bool enable) {
+  // Frames of software devices share one viewpoint already.
+}
+
+void ThreadedDeviceBackend::setDepthColorSync(bool enable) {
+  // Frames are produced together, so they are in sync.
+}
@@ -0,0 +1,213 @@
+#include "DeviceGroup.hpp"
+#include "io.hpp"
+
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <algorithm>
+
+using namespace openni;
+
+const FrameView& FrameSet::get(uint iDevice, SensorType type) const {
+  return devices[iDevice].frames[type-1];
+}
+
+uint64_t FrameSet::getSpread() const {
+  if (devices.empty())
+    return 0;
+  uint64_t earliest = devices[0].hostTimestamp;
+  uint64_t latest = earliest;
+  for (const DeviceFrames& device : devices) {
+    earliest = std::min(earliest, device.hostTimestamp);
+    latest = std::max(latest, device.hostTimestamp);
+  }
+  return latest - earliest;
+}
+
+DeviceGroup::DeviceGroup()
+  : m_uris()
+  , m_devices()
+  , m_references()
+  , m_lastSequences()
+  , m_tolerance(0)
+{}
+
+DeviceGroup::~DeviceGroup() {
+  stopStreams();
+}
+
+void DeviceGroup::forEachDevice(const std::function<void(uint, NIDevice&)>& fcn) {
+  std::mutex mutex;
+  std::exception_ptr error;
+  std::vector<std::thread> threads;
+  for (uint i=0; i<m_devices.size(); ++i) {
+    NIDevice& device = *m_devices[i];
+    threads.emplace_back([&fcn, &device, &mutex, &error, i](){
+	try {
+	  fcn(i, device);
+	} catch (...) {
+	  std::lock_guard<std::mutex> _(mutex);
+	  if (!error)
+	    error = std::current_exception();
+	}
+      });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void DeviceGroup::open(const std::vector<std::string>& uris) {
+  if (!m_devices.empty())
+    throw RuntimeError(__func__, ": Devices are already open.");
+  m_uris = uris.empty() ? NIDevice::enumerateDevices() : uris;
+  if (m_uris.empty())
+    throw RuntimeError(__func__, ": No device is attached.");
+  for (uint i=0; i<m_uris.size(); ++i)
+    m_devices.emplace_back(new NIDevice());
+  try {
+    forEachDevice([this](uint i, NIDevice& device){
+	device.openDevice(m_uris[i].c_str());
+      });
+  } catch (...) {
+    m_devices.clear();
+    m_uris.clear();
+    throw;
+  }
+}
+
+uint DeviceGroup::getNumDevices() const {
+  return m_devices.size();
+}
+
+const std::string& DeviceGroup::getURI(uint i) const {
+  return m_uris.at(i);
+}
+
+NIDevice& DeviceGroup::getDevice(uint i) {
+  if (m_devices.size() <= i)
+    throw RuntimeError(__func__, ": No device ", i, ".");
+  return *m_devices[i];
+}
+
+void DeviceGroup::createStream(const SensorType type, const int mode,
+			       bool mirroring) {
+  forEachDevice([&](uint, NIDevice& device){
+      device.createStream(type, mode, mirroring);
+    });
+}
+
+void DeviceGroup::setImageRegistrationMode(const RegistrationMode mode) {
+  forEachDevice([&](uint, NIDevice& device){
+      device.setImageRegistrationMode(mode);
+    });
+}
+
+void DeviceGroup::setDepthColorSync(const bool enable) {
+  forEachDevice([&](uint, NIDevice& device){
+      device.setDepthColorSync(enable);
+    });
+}
+
+void DeviceGroup::startStreams(std::chrono::milliseconds timeout) {
+  forEachDevice([&](uint, NIDevice& device){
+      device.startStreams();
+      device.waitStreamsToGetReady(timeout);
+    });
+  const SensorType types[] = {SENSOR_DEPTH, SENSOR_COLOR, SENSOR_IR};
+  m_references.clear();
+  for (std::unique_ptr<NIDevice>& pDevice : m_devices) {
+    for (SensorType type : types) {
+      if (pDevice->isStreaming(type)) {
+	m_references.push_back(type);
+	break;
+      }
+    }
+  }
+  m_lastSequences.assign(m_devices.size(), 0);
+}
+
+void DeviceGroup::stopStreams() {
+  if (!m_devices.empty())
+    forEachDevice([](uint, NIDevice& device){
+	device.stopStreams();
+      });
+  m_references.clear();
+}
+
+void DeviceGroup::setTolerance(uint64_t tolerance) {
+  m_tolerance = tolerance;
+}
+
+uint64_t DeviceGroup::getTolerance() const {
+  if (m_tolerance)
+    return m_tolerance;
+  uint64_t period = 0;
+  for (uint i=0; i<m_devices.size(); ++i)
+    period = std::max(period, m_devices[i]->getFramePeriod(m_references[i]));
+  return (period) ? period / 2 : DEFAULT_GROUP_TOLERANCE;
+}
+
+bool DeviceGroup::takeFrames(uint i, uint64_t sequence,
+			     std::chrono::milliseconds timeout,
+			     DeviceFrames& dst) {
+  NIDevice& device = *m_devices[i];
+  const SensorType reference = m_references[i];
+  if (!device.waitForNextFrame(reference, sequence, timeout))
+    return false;
+  for (int type=SENSOR_IR; type<=SENSOR_DEPTH; ++type) {
+    if (device.isStreaming(SensorType(type)))
+      dst.frames[type-1] = device.getFrameView(SensorType(type));
+  }
+  const FrameView& frame = dst.frames[reference-1];
+  dst.sequence = frame.getSequenceNumber();
+  dst.hostTimestamp = device.toHostTime(reference, frame.getTimestamp());
+  return true;
+}
+
+bool DeviceGroup::waitForFrameSet(FrameSet& set,
+				  std::chrono::milliseconds timeout) {
+  using namespace std::chrono;
+  if (m_references.size() != m_devices.size() || m_devices.empty())
+    throw RuntimeError(__func__, ": Streams are not started.");
+  const steady_clock::time_point deadline = steady_clock::now() + timeout;
+  auto getRemaining = [&deadline](){
+    return std::max(milliseconds(0),
+		    duration_cast<milliseconds>(deadline - steady_clock::now()));
+  };
+  const uint nDevices = m_devices.size();
+  set.devices.assign(nDevices, DeviceFrames());
+  for (uint i=0; i<nDevices; ++i) {
+    if (!takeFrames(i, m_lastSequences[i], getRemaining(), set.devices[i]))
+      return false;
+  }
+  // Move the lagging devices on until every frame is close to the newest
+  const uint64_t tolerance = getTolerance();
+  while (1) {
+    uint64_t newest = 0;
+    for (const DeviceFrames& device : set.devices)
+      newest = std::max(newest, device.hostTimestamp);
+    bool bAligned = true;
+    for (uint i=0; i<nDevices; ++i) {
+      DeviceFrames& device = set.devices[i];
+      if (device.hostTimestamp + tolerance >= newest)
+	continue;
+      bAligned = false;
+      if (!takeFrames(i, device.sequence, getRemaining(), device))
+	return false;
+    }
+    if (bAligned)
+      break;
+  }
+  for (uint i=0; i<nDevices; ++i)
+    m_lastSequences[i] = set.devices[i].sequence;
+  return true;
+}
+
+void DeviceGroup::printStreamStats() {
+  for (uint i=0; i<m_devices.size(); ++i) {
+    printf("Device %u (%s):\n", i, m_uris[i].c_str());
+    m_devices[i]->printStreamStats();
+  }
+}
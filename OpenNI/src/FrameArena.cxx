@@ -0,0 +1,152 @@
+#include "FrameArena.hpp"
+#include "io.hpp"
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Header in front of each block, one alignment unit so blocks stay aligned.
+struct FrameArena::Block {
+  size_t size;  // Usable size [byte]
+  Block* pNext; // Next free block
+  uint8_t padding[ARENA_ALIGNMENT - sizeof(size_t) - sizeof(Block*)];
+};
+
+static size_t roundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+FrameArena::FrameArena()
+  : m_mutex()
+  , m_pData(NULL)
+  , m_capacity(0)
+  , m_used(0)
+  , m_bHugePages(false)
+  , m_pFree(NULL)
+{}
+
+FrameArena::FrameArena(size_t capacity, uint flags)
+  : FrameArena()
+{
+  reserve(capacity, flags);
+}
+
+FrameArena::~FrameArena() {
+  release();
+}
+
+void FrameArena::reserve(size_t capacity, uint flags) {
+  release();
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (0 == capacity)
+    return;
+  void* pData = MAP_FAILED;
+  bool bPopulated = false;
+#ifdef __linux__
+  if (flags & ARENA_HUGE_PAGES) {
+    // Only succeeds if huge pages are reserved (vm.nr_hugepages)
+    size_t size = roundUp(capacity, HUGE_PAGE_SIZE);
+    pData = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+		 ((flags & ARENA_PREFAULT) ? MAP_POPULATE : 0), -1, 0);
+    if (MAP_FAILED != pData) {
+      capacity = size;
+      m_bHugePages = bPopulated = true;
+    }
+  }
+#endif
+  if (MAP_FAILED == pData) {
+    int mapFlags = MAP_PRIVATE | MAP_ANON;
+#ifdef MAP_NORESERVE
+    // Pages faulted in later are not committed now, like a large new[]
+    if (!(flags & ARENA_PREFAULT))
+      mapFlags |= MAP_NORESERVE;
+#endif
+    pData = mmap(NULL, capacity, PROT_READ | PROT_WRITE, mapFlags, -1, 0);
+    if (MAP_FAILED == pData)
+      throw RuntimeError(__func__, ": Failed to map ", capacity, " byte: ",
+			 std::string(strerror(errno)));
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages, before the first fault
+    if ((flags & ARENA_HUGE_PAGES) &&
+	0 == madvise(pData, capacity, MADV_HUGEPAGE))
+      m_bHugePages = true;
+#endif
+  }
+  if ((flags & ARENA_PREFAULT) && !bPopulated) {
+    // Write to every page, so the kernel backs it now
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    volatile uint8_t* pPage = static_cast<uint8_t *>(pData);
+    for (size_t offset=0; offset<capacity; offset+=pageSize)
+      pPage[offset] = 0;
+  }
+  m_pData = static_cast<uint8_t *>(pData);
+  m_capacity = capacity;
+}
+
+void FrameArena::release() {
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (m_pData)
+    munmap(m_pData, m_capacity);
+  m_pData = NULL;
+  m_capacity = m_used = 0;
+  m_bHugePages = false;
+  m_pFree = NULL;
+}
+
+void* FrameArena::allocate(size_t size) {
+  std::lock_guard<std::mutex> _(m_mutex);
+  // Smallest released block which is large enough
+  Block** ppBest = NULL;
+  for (Block** ppBlock=&m_pFree; *ppBlock; ppBlock=&(*ppBlock)->pNext)
+    if ((*ppBlock)->size >= size &&
+	(!ppBest || (*ppBlock)->size < (*ppBest)->size))
+      ppBest = ppBlock;
+  Block* pBlock = NULL;
+  if (ppBest) {
+    pBlock = *ppBest;
+    *ppBest = pBlock->pNext;
+  } else {
+    const size_t blockSize = getBlockSize(size);
+    if (blockSize > m_capacity - m_used)
+      throw RuntimeError(__func__, ": ", size, " byte do not fit in the ",
+			 "arena (", m_capacity - m_used, " of ", m_capacity,
+			 " byte left).");
+    pBlock = reinterpret_cast<Block *>(m_pData + m_used);
+    pBlock->size = blockSize - sizeof(Block);
+    m_used += blockSize;
+  }
+  pBlock->pNext = NULL;
+  return pBlock + 1;
+}
+
+void FrameArena::deallocate(void* pData) {
+  if (!pData)
+    return;
+  std::lock_guard<std::mutex> _(m_mutex);
+  uint8_t* p = static_cast<uint8_t *>(pData);
+  if (p < m_pData + sizeof(Block) || p >= m_pData + m_used)
+    throw RuntimeError(__func__, ": Block is not from this arena.");
+  Block* pBlock = reinterpret_cast<Block *>(p) - 1;
+  pBlock->pNext = m_pFree;
+  m_pFree = pBlock;
+}
+
+size_t FrameArena::getBlockSize(size_t size) {
+  static_assert(sizeof(Block) == ARENA_ALIGNMENT, "Unexpected Block size");
+  return sizeof(Block) + roundUp(size, ARENA_ALIGNMENT);
+}
+
+size_t FrameArena::getCapacity() const {
+  return m_capacity;
+}
+
+size_t FrameArena::getUsed() const {
+  return m_used;
+}
+
+bool FrameArena::hasHugePages() const {
+  return m_bHugePages;
+}
@@ -0,0 +1,13 @@
+#include "FrameNotifier.hpp"
+
+FrameNotifier::FrameNotifier()
+  : m_mutex()
+  , m_cond()
+{}
+
+FrameNotifier::~FrameNotifier() {}
+
+void FrameNotifier::notify() {
+  { std::lock_guard<std::mutex> _(m_mutex); }
+  m_cond.notify_all();
+}
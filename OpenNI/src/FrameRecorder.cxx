@@ -0,0 +1,242 @@
+#include "FrameRecorder.hpp"
+#include "io.hpp"
+
+FrameRecorder::FrameRecorder()
+  : m_writer()
+  , m_pPool()
+  , m_pCodec()
+  , m_buffer()
+  , m_slots()
+  , m_policy(BACKPRESSURE_BLOCK)
+  , m_freeQueue()
+  , m_encodeQueue()
+  , m_writeQueue()
+  , m_spareSlot(-1)
+  , m_encodeThread()
+  , m_writeThread()
+  , m_mutex()
+  , m_error()
+  , m_nPushed(0)
+  , m_nDropped(0)
+  , m_nWritten(0)
+  , m_nRawBytes(0)
+  , m_nBytes(0)
+{}
+
+FrameRecorder::~FrameRecorder() {
+  try {
+    close();
+  } catch (const std::exception& e) {
+    printf("%s\n", e.what());
+  }
+}
+
+uint FrameRecorder::addStream(const StreamInfo& info) {
+  switch (info.codec) {
+  case CODEC_RAW:
+    break;
+  case CODEC_DEPTH_RLZ:
+    if (2 != info.BPP)
+      throw RuntimeError(__func__, ": Depth codec needs 2 byte/pixel, not ",
+			 info.BPP, ".");
+    break;
+  default:
+    throw RuntimeError(__func__, ": Unknown codec ", info.codec, ".");
+  }
+  return m_writer.addStream(info);
+}
+
+void FrameRecorder::setBackpressurePolicy(BackpressurePolicy policy) {
+  if (isOpen())
+    throw RuntimeError(__func__, ": Recorder is already open.");
+  m_policy = policy;
+}
+
+void FrameRecorder::open(const char* path, uint nSlots, uint nThreads) {
+  if (isOpen())
+    throw RuntimeError(__func__, ": Recorder is already open.");
+  if (0 == nSlots)
+    throw RuntimeError(__func__, ": Queue size must be positive.");
+  size_t slotSize = 0;
+  bool bEncode = false;
+  for (uint i=0; i<m_writer.getNumStreams(); ++i) {
+    const StreamInfo& info = m_writer.getStreamInfo(i);
+    size_t size = size_t(info.width) * info.height * info.BPP;
+    if (slotSize < size)
+      slotSize = size;
+    bEncode |= CODEC_RAW != info.codec;
+  }
+  m_writer.open(path);
+
+  if (bEncode && !m_pCodec) {
+    m_pPool.reset(new ThreadPool(nThreads));
+    m_pCodec.reset(new DepthCodec(m_pPool.get()));
+  }
+  m_buffer.resize(slotSize * nSlots);
+  m_slots.resize(nSlots);
+  m_freeQueue.reset(nSlots);
+  m_encodeQueue.reset(nSlots);
+  m_writeQueue.reset(nSlots);
+  for (uint i=0; i<nSlots; ++i) {
+    m_slots[i].pData = m_buffer.data() + i * slotSize;
+    m_freeQueue.tryPush(i);
+  }
+  m_spareSlot = -1;
+  m_nPushed = m_nDropped = m_nWritten = 0;
+  m_nRawBytes = m_nBytes = 0;
+  m_error = nullptr;
+  m_encodeThread = std::thread(&FrameRecorder::encode, this);
+  m_writeThread = std::thread(&FrameRecorder::write, this);
+}
+
+bool FrameRecorder::isOpen() const {
+  return m_encodeThread.joinable();
+}
+
+void FrameRecorder::close() {
+  if (isOpen()) {
+    m_encodeQueue.close();
+    m_encodeThread.join();
+    m_writeThread.join();
+  }
+  m_writer.close();
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    std::swap(error, m_error);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void FrameRecorder::fail() {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    if (!m_error)
+      m_error = std::current_exception();
+  }
+  m_freeQueue.close();
+  m_encodeQueue.close();
+  m_writeQueue.close();
+}
+
+void FrameRecorder::encode() {
+  uint iSlot;
+  while (m_encodeQueue.pop(iSlot)) {
+    Slot& slot = m_slots[iSlot];
+    try {
+      const StreamInfo& info = m_writer.getStreamInfo(slot.stream);
+      if (CODEC_RAW != info.codec)
+	m_pCodec->encode((const uint16_t*) slot.pData, info.width, info.height,
+			 slot.encoded);
+    } catch (...) {
+      fail();
+      return;
+    }
+    if (!m_writeQueue.push(iSlot))
+      return;
+  }
+  // Drained: let the write stage finish.
+  m_writeQueue.close();
+}
+
+void FrameRecorder::write() {
+  uint iSlot;
+  while (m_writeQueue.pop(iSlot)) {
+    const Slot& slot = m_slots[iSlot];
+    uint64_t size = slot.size;
+    try {
+      const StreamInfo& info = m_writer.getStreamInfo(slot.stream);
+      if (CODEC_RAW == info.codec) {
+	m_writer.writeFrame(slot.stream, slot.pData, slot.size, slot.timestamp,
+			    slot.frameIndex, slot.hostTimestamp);
+      } else {
+	size = slot.encoded.size();
+	m_writer.writeFrame(slot.stream, slot.encoded.data(), size,
+			    slot.timestamp, slot.frameIndex,
+			    slot.hostTimestamp, info.codec);
+      }
+    } catch (...) {
+      fail();
+      return;
+    }
+    ++m_nWritten;
+    m_nRawBytes += slot.size;
+    m_nBytes += size;
+    m_freeQueue.push(iSlot);
+  }
+}
+
+bool FrameRecorder::push(uint stream, const FrameView& frame) {
+  const StreamInfo& info = m_writer.getStreamInfo(stream);
+  if (frame.getWidth() != info.width || frame.getHeight() != info.height ||
+      frame.getBPP() != info.BPP)
+    throw RuntimeError(__func__, ": Frame does not match stream ", stream, ".");
+  if (!isOpen())
+    throw RuntimeError(__func__, ": Recorder is not open.");
+  ++m_nPushed;
+  uint iSlot;
+  if (0 <= m_spareSlot) {
+    iSlot = m_spareSlot;
+    m_spareSlot = -1;
+  } else if (!m_freeQueue.tryPop(iSlot)) {
+    if (BACKPRESSURE_DROP == m_policy && !m_freeQueue.isClosed()) {
+      ++m_nDropped;
+      return false;
+    }
+    if (!m_freeQueue.pop(iSlot))
+      throw RuntimeError(__func__, ": Recorder has stopped.");
+  }
+  // Keep the slot on failure, else the pipeline shrinks for good
+  Slot& slot = m_slots[iSlot];
+  try {
+    frame.copyTo(slot.pData);
+  } catch (...) {
+    m_spareSlot = iSlot;
+    throw;
+  }
+  slot.stream = stream;
+  slot.size = size_t(info.width) * info.height * info.BPP;
+  slot.timestamp = frame.getTimestamp();
+  slot.frameIndex = frame.getFrameIndex();
+  // Time of arrival if the receiver stamped the frame, else of the push.
+  slot.hostTimestamp = (frame.getHostTimestamp()) ?
+    frame.getHostTimestamp() : getSteadyTimestamp().count();
+  if (!m_encodeQueue.push(iSlot)) {
+    m_spareSlot = iSlot;
+    throw RuntimeError(__func__, ": Recorder has stopped.");
+  }
+  return true;
+}
+
+uint FrameRecorder::getNumSlots() const {
+  return m_slots.size();
+}
+
+uint64_t FrameRecorder::getNumPushed() const {
+  return m_nPushed;
+}
+
+uint64_t FrameRecorder::getNumDropped() const {
+  return m_nDropped;
+}
+
+uint64_t FrameRecorder::getNumWritten() const {
+  return m_nWritten;
+}
+
+uint FrameRecorder::getMaxEncodeQueued() const {
+  return m_encodeQueue.getMaxSize();
+}
+
+uint FrameRecorder::getMaxWriteQueued() const {
+  return m_writeQueue.getMaxSize();
+}
+
+uint64_t FrameRecorder::getNumRawBytes() const {
+  return m_nRawBytes;
+}
+
+uint64_t FrameRecorder::getNumBytes() const {
+  return m_nBytes;
+}
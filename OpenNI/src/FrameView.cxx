@@ -0,0 +1,84 @@
+#include "FrameView.hpp"
+#include "io.hpp"
+
+FrameView::FrameView()
+  : m_holder()
+  , m_pData(NULL)
+  , m_width(0)
+  , m_height(0)
+  , m_stride(0)
+  , m_BPP(0)
+  , m_timestamp(0)
+  , m_frameIndex(-1)
+  , m_sequence(0)
+  , m_hostTimestamp(0)
+{}
+
+FrameView::FrameView(std::shared_ptr<const void> holder, const void* pData,
+		     uint width, uint height, uint stride, uint BPP,
+		     uint64_t timestamp, int frameIndex, uint64_t sequence)
+  : m_holder(holder)
+  , m_pData(static_cast<const uint8_t *>(pData))
+  , m_width(width)
+  , m_height(height)
+  , m_stride(stride)
+  , m_BPP(BPP)
+  , m_timestamp(timestamp)
+  , m_frameIndex(frameIndex)
+  , m_sequence(sequence)
+  , m_hostTimestamp(0)
+{}
+
+bool FrameView::isValid() const {
+  return m_pData != NULL;
+}
+
+void FrameView::release() {
+  *this = FrameView();
+}
+
+const void* FrameView::getData() const { return m_pData; }
+
+uint FrameView::getWidth() const { return m_width; }
+
+uint FrameView::getHeight() const { return m_height; }
+
+uint FrameView::getStrideInBytes() const { return m_stride; }
+
+uint FrameView::getBPP() const { return m_BPP; }
+
+uint64_t FrameView::getTimestamp() const { return m_timestamp; }
+
+int FrameView::getFrameIndex() const { return m_frameIndex; }
+
+uint64_t FrameView::getSequenceNumber() const { return m_sequence; }
+
+void FrameView::setSequenceNumber(uint64_t sequence) { m_sequence = sequence; }
+
+uint64_t FrameView::getHostTimestamp() const { return m_hostTimestamp; }
+
+void FrameView::setHostTimestamp(uint64_t timestamp) {
+  m_hostTimestamp = timestamp;
+}
+
+void FrameView::copyTo(void* pDst, int offset, int padding,
+		       ThreadPool* pool, uint dstStride) const {
+  if (!isValid())
+    throw RuntimeError(__func__, ": Frame is not valid.");
+  ::copyFrame(m_pData, pDst, m_width, m_height, m_BPP, offset, padding, pool,
+	      dstStride, m_stride);
+}
+
+void FrameView::convert16BitFrameToJet(uint8_t* pDst,
+				       const uint16_t v_min,
+				       const uint16_t v_max,
+				       const uint format,
+				       ThreadPool* pool, uint dstStride) const {
+  if (!isValid())
+    throw RuntimeError(__func__, ": Frame is not valid.");
+  if (2 != m_BPP)
+    throw RuntimeError(__func__, ": Not a 16 bit frame (BPP: ", m_BPP, ").");
+  ::convert16BitFrameToJet(reinterpret_cast<const uint16_t *>(m_pData), pDst,
+			   m_width, m_height, format, v_min, v_max, pool,
+			   dstStride, m_stride);
+}
@@ -0,0 +1,86 @@
+#include "LatencyHistogram.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+// Values below 2^LATENCY_SUB_BITS have a bucket each. Above, the value
+// v in [2^e, 2^(e+1)) goes to bucket (e - SUB) * 2^SUB + (v >> (e - SUB)),
+// whose top SUB + 1 bits are those of v.
+uint LatencyHistogram::getBucket(uint64_t value) {
+  if (value < (1u << LATENCY_SUB_BITS))
+    return value;
+  uint e = 63 - __builtin_clzll(value);
+  if (LATENCY_MAX_BITS <= e)
+    return LATENCY_N_BUCKETS - 1;
+  uint shift = e - LATENCY_SUB_BITS;
+  return (shift << LATENCY_SUB_BITS) + uint(value >> shift);
+}
+
+uint64_t LatencyHistogram::getBucketMax(uint bucket) {
+  if (bucket < (2u << LATENCY_SUB_BITS))
+    return bucket;
+  uint shift = (bucket >> LATENCY_SUB_BITS) - 1;
+  uint64_t top = bucket - (uint64_t(shift) << LATENCY_SUB_BITS);
+  return ((top + 1) << shift) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+  : m_count(0)
+  , m_sum(0)
+  , m_max(0)
+{
+  for (auto& bucket : m_buckets)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  m_buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+  uint64_t max = m_max.load(std::memory_order_relaxed);
+  while (max < value &&
+	 !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+  m_count.fetch_add(1, std::memory_order_release);
+}
+
+void LatencyHistogram::reset() {
+  for (auto& bucket : m_buckets)
+    bucket.store(0, std::memory_order_relaxed);
+  m_sum.store(0, std::memory_order_relaxed);
+  m_max.store(0, std::memory_order_relaxed);
+  m_count.store(0, std::memory_order_release);
+}
+
+uint64_t LatencyHistogram::getCount() const {
+  return m_count.load(std::memory_order_acquire);
+}
+
+uint64_t LatencyHistogram::getMax() const {
+  return m_max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::getMean() const {
+  uint64_t count = getCount();
+  return (count) ? double(m_sum.load(std::memory_order_relaxed)) / count : 0.0;
+}
+
+uint64_t LatencyHistogram::getPercentile(double percentile) const {
+  // Count the buckets themselves, which may be ahead of m_count.
+  uint64_t counts[LATENCY_N_BUCKETS];
+  uint64_t total = 0;
+  for (uint i=0; i<LATENCY_N_BUCKETS; ++i) {
+    counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (0 == total)
+    return 0;
+  percentile = std::min(100.0, std::max(0.0, percentile));
+  uint64_t rank = std::max<uint64_t>(1, uint64_t(ceil(percentile / 100.0
+						      * total)));
+  uint64_t sum = 0;
+  for (uint i=0; i<LATENCY_N_BUCKETS; ++i) {
+    sum += counts[i];
+    if (rank <= sum)
+      return std::min(getBucketMax(i), getMax());
+  }
+  return getMax();
+}
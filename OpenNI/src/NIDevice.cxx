@@ -1,7 +1,9 @@
 #include "NIDevice.hpp"
 #include "io.hpp"
+#include "ThreadPool.hpp"
 
-#define WAIT_TIMEOUT 500 // [ms]
+#include <cstdlib>
+#include <algorithm>
 
 using namespace openni;
 
@@ -41,6 +43,25 @@ const char* getPixelFormatString(const PixelFormat val) {
   }
 }
 
+uint getBytesPerPixel(const PixelFormat val) {
+  switch (val) {
+  case PIXEL_FORMAT_DEPTH_1_MM:
+  case PIXEL_FORMAT_DEPTH_100_UM:
+  case PIXEL_FORMAT_SHIFT_9_2:
+  case PIXEL_FORMAT_SHIFT_9_3:
+  case PIXEL_FORMAT_GRAY16:
+  case PIXEL_FORMAT_YUV422:
+  case PIXEL_FORMAT_YUYV:
+    return 2;
+  case PIXEL_FORMAT_RGB888:
+    return 3;
+  case PIXEL_FORMAT_GRAY8:
+  case PIXEL_FORMAT_JPEG:
+    return 1;
+  }
+  return 0;
+}
+
 void printSupportedVideoModes(const SensorInfo* info) {
   auto& mode = info->getSupportedVideoModes();
   for (int i=0; i<mode.getSize(); ++i)
@@ -50,100 +71,112 @@ void printSupportedVideoModes(const SensorInfo* info) {
   printf("\n");
 }
 
-Listener::Listener()
-  : m_callbackFcn()
-{};
-
-Listener::~Listener() {};
-
-void Listener::onNewFrame (VideoStream &stream) {
-  m_callbackFcn();
-};
+const char* getRegistrationModeString(const RegistrationMode mode) {
+  switch (mode) {
+  case REGISTRATION_OFF:
+    return "off";
+  case REGISTRATION_AUTO:
+    return "auto";
+  case REGISTRATION_DEVICE:
+    return "device";
+  case REGISTRATION_HOST:
+    return "host";
+  }
+  return "unknown";
+}
 
-void Listener::setCallbackFcn(std::function<void()> fcn) {
-  m_callbackFcn = fcn;
-};
+RegistrationMode parseRegistrationMode(const std::string& val) {
+  const RegistrationMode modes[] = {REGISTRATION_OFF, REGISTRATION_AUTO,
+				    REGISTRATION_DEVICE, REGISTRATION_HOST};
+  for (RegistrationMode mode : modes) {
+    if (val == getRegistrationModeString(mode))
+      return mode;
+  }
+  throw RuntimeError(__func__, ": Unknown registration mode ", val, ".");
+}
 
 Streamer::Streamer()
-  : m_stream()
-  , m_frame()
-  , m_frameMutex()
-  , m_listener()
+  : m_pBackend()
+  , m_frames()
+  , m_consumerMutex()
+  , m_pNotifier(NULL)
   , m_bStreaming(false)
-  , m_time()
+  , m_lastRead(0)
+  , m_stats()
+  , m_clock()
+  , m_lastTimestamp(0)
+  , m_period(0)
+  , m_frameHook()
+  , m_frameFilter()
 {};
 
 Streamer::~Streamer() {
   if (m_bStreaming)
     stop();
-  if (m_frame.isValid())
-    m_frame.release();
-  if (m_stream.isValid())
-    m_stream.destroy();
 }
 
-void Streamer::create(Device &device, const SensorType type,
+void Streamer::create(DeviceBackend& device, const SensorType type,
 		      const int mode, const bool mirroring) {
-  const openni::SensorInfo* info = device.getSensorInfo(type);
-  if (!info)
-    throw RuntimeError(__func__, ": ",
-	  "No sensor for ", getSensorTypeString(type), " found.");
-
-  auto& videomodes = info->getSupportedVideoModes();
-  int nModes = videomodes.getSize();
-  if (mode < 0 || nModes <= mode)
-    throw RuntimeError(__func__, ":", getSensorTypeString(type), ": ",
-		       "Invalid video mode (", mode, "). ",
-		       "Value range [0, ", nModes, ").");
-
-  if (STATUS_OK != m_stream.create(device, type))
-    throw RuntimeError(__func__, ": Failed to create ",
-		       getSensorTypeString(type), " stream.");
-
-  if (STATUS_OK != m_stream.setVideoMode(videomodes[mode]))
-    throw RuntimeError(__func__, ":", getSensorTypeString(type), ": ",
-		       "Failed to set video mode (", mode, ").");
-
-  if (mirroring != m_stream.getMirroringEnabled()){
-    if (STATUS_OK != m_stream.setMirroringEnabled(mirroring))
-      throw RuntimeError(__func__, ":", getSensorTypeString(type), ": Failed ",
-			 "to ", (mirroring)? "en" : "dis", "able mirroring.");
-  }
+  m_pBackend = device.createStream(type, mode, mirroring);
+}
 
-  m_listener.setCallbackFcn([&](){
-      std::lock_guard<std::mutex> _(m_frameMutex);
-      if (m_frame.isValid())
-	m_frame.release();
-      if (STATUS_OK != m_stream.readFrame(&m_frame))
-	throw RuntimeError("Callback:", getSensorTypeString(type),
-			   ": Failed to read frame.");
-      m_time.store(getCurrentTimestamp());
-    });
-  if (STATUS_OK != m_stream.addNewFrameListener(&m_listener))
-    throw RuntimeError(__func__, ":", getSensorTypeString(type),
-		       ": Failed to add event listener.");
+void Streamer::setFrameNotifier(FrameNotifier* pNotifier) {
+  m_pNotifier = pNotifier;
 }
 
-void Streamer::start() {
-  if (!m_stream.isValid())
-    throw RuntimeError(__func__, ": Video stream is not initialized.");
+void Streamer::setFrameHook(FrameCallback hook) {
+  m_frameHook = hook;
+}
 
-  if (STATUS_OK != m_stream.start())
-    throw RuntimeError(__func__, ": Faild to start stream.");
+void Streamer::setFrameFilter(FrameFilter filter) {
+  m_frameFilter = filter;
+}
 
+const StreamBackend& Streamer::getBackend() const {
+  if (!m_pBackend)
+    throw RuntimeError(__func__, ": Video stream is not initialized.");
+  return *m_pBackend;
+}
+
+void Streamer::onNewFrame(const FrameView& frame) {
+  uint64_t host = getSteadyTimestamp().count();
+  FrameView& back = m_frames.getBackBuffer();
+  back = (m_frameFilter) ? m_frameFilter(frame) : frame;
+  // The callback is the only producer, so this is the next sequence number.
+  back.setSequenceNumber(m_frames.getLatestSequence() + 1);
+  back.setHostTimestamp(host);
+  m_clock.update(frame.getTimestamp(), host);
+  m_stats.recordArrival(back, m_clock.toHost(frame.getTimestamp()));
+  uint64_t last = m_lastTimestamp.exchange(frame.getTimestamp());
+  if (last && last < frame.getTimestamp())
+    m_period = frame.getTimestamp() - last;
+  if (m_frameHook)
+    m_frameHook(back);
+  m_frames.publish();
+  if (m_pNotifier)
+    m_pNotifier->notify();
+}
+
+void Streamer::start() {
+  if (!m_pBackend)
+    throw RuntimeError(__func__, ": Video stream is not initialized.");
+  m_stats.reset();
+  m_clock.reset();
+  m_lastTimestamp = 0;
+  m_period = 0;
+  m_pBackend->start([this](const FrameView& frame){ onNewFrame(frame); });
   m_bStreaming = true;
 };
 
 void Streamer::stop() {
   if (m_bStreaming) {
-    m_stream.stop();
-    m_stream.removeNewFrameListener(&m_listener);
+    m_pBackend->stop();
     m_bStreaming = false;
   }
 }
 
 bool Streamer::isStreamValid() const {
-  return m_stream.isValid();
+  return (bool) m_pBackend;
 };
 
 bool Streamer::isStreaming() const {
@@ -151,23 +184,27 @@ bool Streamer::isStreaming() const {
 }
 
 bool Streamer::isFrameValid() const {
-  return m_frame.isValid();
+  return 0 < m_frames.getLatestSequence();
 };
 
+uint64_t Streamer::getSequenceNumber() const {
+  return m_frames.getLatestSequence();
+}
+
+bool Streamer::hasNewFrame() const {
+  return m_lastRead.load() < m_frames.getLatestSequence();
+}
+
 uint Streamer::getWidth() const {
-  if (!m_stream.isValid())
-    throw RuntimeError(__func__, ": Video stream is not initialized.");
-  return m_stream.getVideoMode().getResolutionX();
+  return getBackend().getWidth();
 }
 
 uint Streamer::getHeight() const {
-  if (!m_stream.isValid())
-    throw RuntimeError(__func__, ": Video stream is not initialized.");
-  return m_stream.getVideoMode().getResolutionY();
+  return getBackend().getHeight();
 }
 
 uint Streamer::getNumChannels() const {
-  PixelFormat format = m_stream.getVideoMode().getPixelFormat();
+  PixelFormat format = getBackend().getPixelFormat();
   switch (format) {
   case PIXEL_FORMAT_DEPTH_1_MM:
   case PIXEL_FORMAT_DEPTH_100_UM:
@@ -182,25 +219,52 @@ uint Streamer::getNumChannels() const {
   }
 }
 
+PixelFormat Streamer::getPixelFormat() const {
+  return getBackend().getPixelFormat();
+}
+
 uint Streamer::getMinValue() const {
-  if (!m_stream.isValid())
-    throw RuntimeError(__func__, ": Video stream is not initialized.");
-  return m_stream.getMinPixelValue();
+  return getBackend().getMinValue();
 }
 
 uint Streamer::getMaxValue() const {
-  if (!m_stream.isValid())
-    throw RuntimeError(__func__, ": Video stream is not initialized.");
-  return m_stream.getMaxPixelValue();
+  return getBackend().getMaxValue();
+}
+
+uint64_t Streamer::getLastTimestamp() const {
+  return m_lastTimestamp;
+}
+
+uint64_t Streamer::getFramePeriod() const {
+  return m_period;
+}
+
+FrameView Streamer::getFrameView() {
+  std::lock_guard<std::mutex> _(m_consumerMutex);
+  m_frames.update();
+  FrameView frame = m_frames.getFrontBuffer();
+  if (!frame.isValid())
+    return FrameView();
+  uint64_t lastRead = m_lastRead.load();
+  if (lastRead < frame.getSequenceNumber())
+    m_stats.recordConsume(frame, lastRead);
+  m_lastRead.store(frame.getSequenceNumber());
+  return frame;
 }
 
 void Streamer::copyTo(void* pDst, const uint offset, const uint padding) {
-  std::lock_guard<std::mutex> _(m_frameMutex);
-  uint width = m_frame.getWidth();
-  uint height = m_frame.getHeight();
-  uint BPP = m_frame.getStrideInBytes() / width;
-  const void *pSrc = static_cast<const void *>(m_frame.getData());
-  ::copyFrame(pSrc, pDst, width, height, BPP, offset, padding);
+  FrameView view = getFrameView();
+  if (!view.isValid())
+    throw RuntimeError(__func__, ": No frame has been received.");
+  view.copyTo(pDst, offset, padding);
+}
+
+StreamStats& Streamer::getStats() {
+  return m_stats;
+}
+
+const ClockEstimator& Streamer::getClock() const {
+  return m_clock;
 }
 
 void NIDevice::initONI() {
@@ -213,47 +277,93 @@ void NIDevice::quitONI() {
   OpenNI::shutdown();
 }
 
+std::vector<std::string> NIDevice::enumerateDevices() {
+  Array<DeviceInfo> infos;
+  OpenNI::enumerateDevices(&infos);
+  std::vector<std::string> uris;
+  for (int i=0; i<infos.getSize(); ++i)
+    uris.push_back(infos[i].getUri());
+  return uris;
+}
+
 NIDevice::NIDevice()
-  : m_device()
+  : m_pDevice()
   , m_streamers()
-{}
+  , m_notifier()
+  , m_bTrackSkew(false)
+  , m_skew()
+  , m_registrationMode(REGISTRATION_OFF)
+  , m_registration()
+  , m_bTemporalFilter(false)
+  , m_temporalFilter()
+  , m_pDepthPool()
+  , m_depthBuffers()
+{
+  for (int i=0; i<3; ++i) {
+    m_streamers[i].setFrameNotifier(&m_notifier);
+    m_streamers[i].setFrameHook([this, i](const FrameView& frame){
+	onNewFrame(SensorType(i+1), frame);
+      });
+  }
+}
 
 NIDevice::~NIDevice() {
   stopStreams();
-  if (m_device.isValid())
-    m_device.close();
 }
 
 void NIDevice::openDevice(const char* uri) {
-  if (!m_device.isValid()) {
-    if (STATUS_OK != m_device.open(uri))
-      throw RuntimeError(__func__, ": Failed to open ",
-			 (uri)? uri:"ANY_DEVICE", ".");
-  }
+  if (!m_pDevice)
+    m_pDevice = openDeviceBackend(uri);
+}
+
+DeviceBackend& NIDevice::getDevice() const {
+  if (!m_pDevice)
+    throw RuntimeError(__func__, ": Device is not open.");
+  return *m_pDevice;
+}
+
+// A depth frame and a color frame form a pair when their device timestamps
+// are less than half a frame period apart. Each frame is compared with the
+// latest frame of the other stream when it arrives, so whichever frame of a
+// pair comes second records it.
+void NIDevice::onNewFrame(const SensorType type, const FrameView& frame) {
+  if (!m_bTrackSkew || SENSOR_IR == type)
+    return;
+  const Streamer& self = m_streamers[type-1];
+  const Streamer& other = m_streamers[((SENSOR_DEPTH == type) ?
+				       SENSOR_COLOR : SENSOR_DEPTH) - 1];
+  uint64_t otherTimestamp = other.getLastTimestamp();
+  uint64_t period = std::max(self.getFramePeriod(), other.getFramePeriod());
+  if (0 == otherTimestamp || 0 == period)
+    return;
+  int64_t skew = int64_t(frame.getTimestamp() - otherTimestamp);
+  if (period < 2 * uint64_t(llabs(skew)))
+    return;
+  m_skew.record((SENSOR_DEPTH == type) ? skew : -skew);
 }
 
 void NIDevice::listAllSensorModes() {
   printf("IR Sensor:\n");
-  if (m_device.hasSensor(SENSOR_IR))
-    printSupportedVideoModes(m_device.getSensorInfo(SENSOR_IR));
+  if (getDevice().hasSensor(SENSOR_IR))
+    getDevice().printSensorModes(SENSOR_IR);
   else
     printf("Not available.\n\n");
 
   printf("Depth Sensor:\n");
-  if (m_device.hasSensor(SENSOR_DEPTH))
-    printSupportedVideoModes(m_device.getSensorInfo(SENSOR_DEPTH));
+  if (getDevice().hasSensor(SENSOR_DEPTH))
+    getDevice().printSensorModes(SENSOR_DEPTH);
   else
     printf("Not available.\n\n");
 
   printf("RGB Sensor:\n");
-  if (m_device.hasSensor(SENSOR_COLOR))
-    printSupportedVideoModes(m_device.getSensorInfo(SENSOR_COLOR));
+  if (getDevice().hasSensor(SENSOR_COLOR))
+    getDevice().printSensorModes(SENSOR_COLOR);
   else
     printf("Not avaibale.\n\n");
 }
 
 void NIDevice::createStream(const SensorType type, const int mode, bool mirroring) {
-  m_streamers[type-1].create(m_device, type, mode, mirroring);
+  m_streamers[type-1].create(getDevice(), type, mode, mirroring);
 };
 
 void NIDevice::createDepthStream(const int mode, bool mirroring) {
@@ -280,6 +390,10 @@ uint NIDevice::getNumChannels(SensorType type) const {
   return m_streamers[type-1].getNumChannels();
 }
 
+PixelFormat NIDevice::getPixelFormat(SensorType type) const {
+  return m_streamers[type-1].getPixelFormat();
+}
+
 uint NIDevice::getDepthWidth() const {
   return getWidth(SENSOR_DEPTH);
 }
@@ -340,39 +454,114 @@ int NIDevice::getIRMaxValue() const {
   return getMaxValue(SENSOR_IR);
 }
 
+// Buffers are reused once no frame view refers to them any more.
+FrameView NIDevice::filterDepth(const FrameView& frame) {
+  const uint width = frame.getWidth(), height = frame.getHeight();
+  auto pBuffer = m_depthBuffers.get(size_t(width) * height);
+  if (REGISTRATION_HOST == m_registrationMode) {
+    m_registration.apply(frame, pBuffer->data(), m_pDepthPool.get());
+    if (m_bTemporalFilter)
+      m_temporalFilter.apply(pBuffer->data(), pBuffer->data(), width, height,
+			     0, m_pDepthPool.get());
+  } else {
+    m_temporalFilter.apply(frame, pBuffer->data(), m_pDepthPool.get());
+  }
+  return FrameView(pBuffer, pBuffer->data(), width, height, width * 2, 2,
+		   frame.getTimestamp(), frame.getFrameIndex());
+}
+
+void NIDevice::updateDepthFilter() {
+  Streamer& depth = m_streamers[SENSOR_DEPTH-1];
+  if (REGISTRATION_HOST == m_registrationMode || m_bTemporalFilter) {
+    if (!m_pDepthPool)
+      m_pDepthPool.reset(new ThreadPool());
+    depth.setFrameFilter([this](const FrameView& frame){
+	return filterDepth(frame);
+      });
+  } else {
+    depth.setFrameFilter(FrameFilter());
+  }
+}
+
 void NIDevice::setImageRegistration(const bool enable) {
-  if (enable) {
-    if (m_device.isImageRegistrationModeSupported(IMAGE_REGISTRATION_DEPTH_TO_COLOR)) {
-      if (STATUS_OK != m_device.setImageRegistrationMode(IMAGE_REGISTRATION_DEPTH_TO_COLOR))
-	throw RuntimeError(__func__,
-			   ": Failed to enable depth to color registration.");
-    } else {
-      throw RuntimeError(__func__, ": The device does not support "
-			 "depth to color registration.");
+  setImageRegistrationMode((enable) ? REGISTRATION_AUTO : REGISTRATION_OFF);
+}
+
+void NIDevice::setImageRegistrationMode(const RegistrationMode mode) {
+  Streamer& depth = m_streamers[SENSOR_DEPTH-1];
+  if (depth.isStreaming())
+    throw RuntimeError(__func__, ": Depth stream is already started.");
+  RegistrationMode resolved = mode;
+  if (REGISTRATION_AUTO == mode) {
+    try {
+      getDevice().setImageRegistration(true);
+      resolved = REGISTRATION_DEVICE;
+    } catch (const RuntimeError& e) {
+      printf("%s Registering depth on the host.\n", e.what());
+      resolved = REGISTRATION_HOST;
     }
+  } else if (REGISTRATION_DEVICE == mode) {
+    getDevice().setImageRegistration(true);
   } else {
-    if (STATUS_OK != m_device.setImageRegistrationMode(IMAGE_REGISTRATION_OFF))
-      throw RuntimeError(__func__, ": Failed to disable registration mode.");
+    getDevice().setImageRegistration(false);
   }
+
+  m_registrationMode = resolved;
+  updateDepthFilter();
+}
+
+RegistrationMode NIDevice::getImageRegistrationMode() const {
+  return m_registrationMode;
+}
+
+void NIDevice::setRegistrationCalibration(const CameraIntrinsics& depth,
+					  const CameraIntrinsics& color,
+					  const CameraExtrinsics& extrinsics) {
+  if (m_streamers[SENSOR_DEPTH-1].isStreaming())
+    throw RuntimeError(__func__, ": Depth stream is already started.");
+  m_registration.setCalibration(depth, color, extrinsics);
+}
+
+void NIDevice::setDepthTemporalFilter(const bool enable) {
+  if (m_streamers[SENSOR_DEPTH-1].isStreaming())
+    throw RuntimeError(__func__, ": Depth stream is already started.");
+  m_bTemporalFilter = enable;
+  m_temporalFilter.reset();
+  updateDepthFilter();
+}
+
+bool NIDevice::isDepthTemporalFilterEnabled() const {
+  return m_bTemporalFilter;
+}
+
+DepthTemporalFilter& NIDevice::getDepthTemporalFilter() {
+  return m_temporalFilter;
 }
 
 void NIDevice::setDepthColorSync(const bool enable) {
-  if (STATUS_OK != m_device.setDepthColorSyncEnabled(enable))
-    throw RuntimeError(__func__, ":", "Failed to set depth/color sync mode.");
+  getDevice().setDepthColorSync(enable);
+  m_skew.reset();
+  m_bTrackSkew = enable;
 }
 
 void NIDevice::startStream(SensorType type) {
+  m_skew.reset();
+  if (SENSOR_DEPTH == type)
+    m_temporalFilter.reset();
   m_streamers[type-1].start();
 }
 
 void NIDevice::startStreams() {
+  m_skew.reset();
+  if (m_streamers[SENSOR_DEPTH-1].isStreamValid())
+    m_temporalFilter.reset();
   for (int i=0; i<3; ++i) {
     if (m_streamers[i].isStreamValid())
       m_streamers[i].start();
   }
 }
 
-void NIDevice::waitStreamsToGetReady() const {
+void NIDevice::waitStreamsToGetReady(std::chrono::milliseconds timeout) {
   // Check if any stream is valid
   bool isAnyStreamStreaming = false;
   for (int i=0; i<3; ++i) {
@@ -382,13 +571,50 @@ void NIDevice::waitStreamsToGetReady() const {
   if (!isAnyStreamStreaming)
     throw RuntimeError(__func__, ": No streaming sensor.");
 
-  bool allFramesReady = false;
-  while (!allFramesReady) {
-    for (int i=0; i<3; ++i) {
-      if (m_streamers[i].isStreaming())
-	allFramesReady = (m_streamers[i].isFrameValid())? true : false;
-    }
+  bool allFramesReady = m_notifier.waitFor([this](){
+      for (int i=0; i<3; ++i) {
+	if (m_streamers[i].isStreaming() && !m_streamers[i].isFrameValid())
+	  return false;
+      }
+      return true;
+    }, timeout);
+  if (!allFramesReady)
+    throw RuntimeError(__func__, ": Timeout while waiting for first frames.");
+}
+
+bool NIDevice::waitForFrames(uint sensorMask,
+			     std::chrono::milliseconds timeout) {
+  bool isAnyStreamStreaming = false;
+  for (int i=0; i<3; ++i) {
+    if ((sensorMask & SENSOR_MASK(i+1)) && m_streamers[i].isStreaming())
+      isAnyStreamStreaming = true;
   }
+  if (!isAnyStreamStreaming)
+    throw RuntimeError(__func__, ": No streaming sensor in mask ",
+		       sensorMask, ".");
+
+  return m_notifier.waitFor([this, sensorMask](){
+      for (int i=0; i<3; ++i) {
+	if ((sensorMask & SENSOR_MASK(i+1)) && m_streamers[i].isStreaming()
+	    && !m_streamers[i].hasNewFrame())
+	  return false;
+      }
+      return true;
+    }, timeout);
+}
+
+uint64_t NIDevice::waitForNextFrame(SensorType type, uint64_t lastSeq,
+				    std::chrono::milliseconds timeout) {
+  const Streamer& streamer = m_streamers[type-1];
+  if (!streamer.isStreaming())
+    throw RuntimeError(__func__, ": ", getSensorTypeString(type),
+		       " is not streaming.");
+  uint64_t seq = 0;
+  m_notifier.waitFor([&](){
+      seq = streamer.getSequenceNumber();
+      return lastSeq < seq;
+    }, timeout);
+  return (lastSeq < seq) ? seq : 0;
 }
 
 void NIDevice::stopStream(SensorType type) {
@@ -402,6 +628,68 @@ void NIDevice::stopStreams() {
   }
 }
 
+bool NIDevice::isStreaming(SensorType type) const {
+  return m_streamers[type-1].isStreaming();
+}
+
+uint64_t NIDevice::getFramePeriod(SensorType type) const {
+  return m_streamers[type-1].getFramePeriod();
+}
+
+FrameView NIDevice::getFrameView(SensorType type) {
+  return m_streamers[type-1].getFrameView();
+}
+
+FrameView NIDevice::getDepthFrameView() {
+  return getFrameView(SENSOR_DEPTH);
+}
+
+FrameView NIDevice::getColorFrameView() {
+  return getFrameView(SENSOR_COLOR);
+}
+
+FrameView NIDevice::getIRFrameView() {
+  return getFrameView(SENSOR_IR);
+}
+
+StreamStats& NIDevice::getStreamStats(SensorType type) {
+  return m_streamers[type-1].getStats();
+}
+
+const SkewStats& NIDevice::getSyncSkewStats() const {
+  return m_skew;
+}
+
+uint64_t NIDevice::toHostTime(SensorType type, uint64_t timestamp) const {
+  return m_streamers[type-1].getClock().toHost(timestamp);
+}
+
+void NIDevice::printStreamStats() {
+  const SensorType types[] = {SENSOR_DEPTH, SENSOR_COLOR, SENSOR_IR};
+  for (SensorType type : types) {
+    if (m_streamers[type-1].isStreamValid())
+      m_streamers[type-1].getStats().print(getSensorTypeString(type));
+  }
+  if (m_bTrackSkew)
+    m_skew.print("Depth-color skew");
+}
+
+std::string NIDevice::getStreamStatsSummary() {
+  const SensorType types[] = {SENSOR_DEPTH, SENSOR_COLOR, SENSOR_IR};
+  const char* names[] = {"Depth", "Color", "IR"};
+  std::string summary;
+  for (int i=0; i<3; ++i) {
+    if (!m_streamers[types[i]-1].isStreamValid())
+      continue;
+    if (!summary.empty())
+      summary += " | ";
+    summary += m_streamers[types[i]-1].getStats().getSummary(names[i]);
+  }
+  if (m_bTrackSkew && m_skew.getCount())
+    summary += " | " + m_skew.getSummary("Skew");
+  return summary;
+}
+
 void NIDevice::copyFrame(SensorType type,
 			 void* pDst, int offset, int padding) {
   m_streamers[type-1].copyTo(pDst, offset, padding);
@@ -0,0 +1,165 @@
+#include "OpenNIBackend.hpp"
+#include "NIDevice.hpp"
+#include "io.hpp"
+
+using namespace openni;
+
+Listener::Listener()
+  : m_callbackFcn()
+{};
+
+Listener::~Listener() {};
+
+
+void Listener::onNewFrame (VideoStream &stream) {
+  m_callbackFcn();
+};
+
+void Listener::setCallbackFcn(std::function<void()> fcn) {
+  m_callbackFcn = fcn;
+};
+
+OpenNIStream::OpenNIStream(Device& device, const SensorType type,
+			   const int mode, const bool mirroring)
+  : m_stream()
+  , m_type(type)
+  , m_listener()
+  , m_bStarted(false)
+{
+  const openni::SensorInfo* info = device.getSensorInfo(type);
+  if (!info)
+    throw RuntimeError(__func__, ": ",
+	  "No sensor for ", getSensorTypeString(type), " found.");
+
+  auto& videomodes = info->getSupportedVideoModes();
+  int nModes = videomodes.getSize();
+  if (mode < 0 || nModes <= mode)
+    throw RuntimeError(__func__, ":", getSensorTypeString(type), ": ",
+		       "Invalid video mode (", mode, "). ",
+		       "Value range [0, ", nModes, ").");
+
+  if (STATUS_OK != m_stream.create(device, type))
+    throw RuntimeError(__func__, ": Failed to create ",
+		       getSensorTypeString(type), " stream.");
+
+  if (STATUS_OK != m_stream.setVideoMode(videomodes[mode]))
+    throw RuntimeError(__func__, ":", getSensorTypeString(type), ": ",
+		       "Failed to set video mode (", mode, ").");
+
+  if (mirroring != m_stream.getMirroringEnabled()){
+    if (STATUS_OK != m_stream.setMirroringEnabled(mirroring))
+      throw RuntimeError(__func__, ":", getSensorTypeString(type), ": Failed ",
+			 "to ", (mirroring)? "en" : "dis", "able mirroring.");
+  }
+}
+
+OpenNIStream::~OpenNIStream() {
+  stop();
+  if (m_stream.isValid())
+    m_stream.destroy();
+}
+
+uint OpenNIStream::getWidth() const {
+  return m_stream.getVideoMode().getResolutionX();
+}
+
+uint OpenNIStream::getHeight() const {
+  return m_stream.getVideoMode().getResolutionY();
+}
+
+PixelFormat OpenNIStream::getPixelFormat() const {
+  return m_stream.getVideoMode().getPixelFormat();
+}
+
+int OpenNIStream::getMinValue() const {
+  return m_stream.getMinPixelValue();
+}
+
+int OpenNIStream::getMaxValue() const {
+  return m_stream.getMaxPixelValue();
+}
+
+void OpenNIStream::start(const FrameCallback& callback) {
+  const SensorType type = m_type;
+  m_listener.setCallbackFcn([this, type, callback](){
+      // Copying VideoFrameRef only adds a reference to the driver frame.
+      std::shared_ptr<VideoFrameRef> pFrame = std::make_shared<VideoFrameRef>();
+      if (STATUS_OK != m_stream.readFrame(pFrame.get()))
+	throw RuntimeError("Callback:", getSensorTypeString(type),
+			   ": Failed to read frame.");
+      uint width = pFrame->getWidth();
+      uint height = pFrame->getHeight();
+      uint stride = pFrame->getStrideInBytes();
+      uint BPP = getBytesPerPixel(pFrame->getVideoMode().getPixelFormat());
+      if (0 == BPP)
+	BPP = stride / width;
+      callback(FrameView(pFrame, pFrame->getData(), width, height, stride, BPP,
+			 pFrame->getTimestamp(), pFrame->getFrameIndex()));
+    });
+  if (STATUS_OK != m_stream.addNewFrameListener(&m_listener))
+    throw RuntimeError(__func__, ":", getSensorTypeString(type),
+		       ": Failed to add event listener.");
+  if (STATUS_OK != m_stream.start()) {
+    m_stream.removeNewFrameListener(&m_listener);
+    throw RuntimeError(__func__, ": Faild to start stream.");
+  }
+  m_bStarted = true;
+}
+
+void OpenNIStream::stop() {
+  if (m_bStarted) {
+    m_stream.stop();
+    m_stream.removeNewFrameListener(&m_listener);
+    m_bStarted = false;
+  }
+}
+
+OpenNIBackend::OpenNIBackend(const char* uri)
+  : m_device()
+{
+  if (!uri)
+    uri = openni::ANY_DEVICE;
+  if (STATUS_OK != m_device.open(uri))
+    throw RuntimeError(__func__, ": Failed to open ",
+		       (uri)? uri:"ANY_DEVICE", ".");
+}
+
+OpenNIBackend::~OpenNIBackend() {
+  if (m_device.isValid())
+    m_device.close();
+}
+
+bool OpenNIBackend::hasSensor(SensorType type) {
+  return m_device.hasSensor(type);
+}
+
+void OpenNIBackend::printSensorModes(SensorType type) {
+  printSupportedVideoModes(m_device.getSensorInfo(type));
+}
+
+std::unique_ptr<StreamBackend>
+OpenNIBackend::createStream(SensorType type, int mode, bool mirroring) {
+  return std::unique_ptr<StreamBackend>(new OpenNIStream(m_device, type, mode,
+							 mirroring));
+}
+
+void OpenNIBackend::setImageRegistration(const bool enable) {
+  if (enable) {
+    if (m_device.isImageRegistrationModeSupported(IMAGE_REGISTRATION_DEPTH_TO_COLOR)) {
+      if (STATUS_OK != m_device.setImageRegistrationMode(IMAGE_REGISTRATION_DEPTH_TO_COLOR))
+	throw RuntimeError(__func__,
+			   ": Failed to enable depth to color registration.");
+    } else {
+      throw RuntimeError(__func__, ": The device does not support "
+			 "depth to color registration.");
+    }
+  } else {
+    if (STATUS_OK != m_device.setImageRegistrationMode(IMAGE_REGISTRATION_OFF))
+      throw RuntimeError(__func__, ": Failed to disable registration mode.");
+  }
+}
+
+void OpenNIBackend::setDepthColorSync(const bool enable) {
+  if (STATUS_OK != m_device.setDepthColorSyncEnabled(enable))
+    throw RuntimeError(__func__, ":", "Failed to set depth/color sync mode.");
+}
@@ -0,0 +1,329 @@
+#include "Player.hpp"
+#include "Recording.hpp"
+#include "io.hpp"
+
+#include <algorithm>
+
+#include <unistd.h>
+
+using namespace std::chrono;
+
+RecordingSource::RecordingSource(const RecordingReader& reader,
+				 const std::vector<int>& streams,
+				 ThreadPool* pool)
+  : m_reader(reader)
+  , m_streams(streams)
+  , m_pPool(pool)
+{}
+
+uint RecordingSource::getNumStreams() const {
+  return m_streams.size();
+}
+
+uint64_t RecordingSource::getNumFrames() const {
+  uint64_t nFrames = 0;
+  for (int stream : m_streams)
+    if (0 <= stream)
+      nFrames = std::max(nFrames, m_reader.getNumFrames(stream));
+  return nFrames;
+}
+
+FrameView RecordingSource::getFrame(uint stream, uint64_t iFrame) {
+  int iStream = m_streams.at(stream);
+  if (iStream < 0 || iFrame >= m_reader.getNumFrames(iStream))
+    return FrameView();
+  return m_reader.getFrameView(iStream, iFrame, m_pPool);
+}
+
+FramesSource::FramesSource(const std::vector<Frames*>& frames,
+			   uint64_t nFrames)
+  : m_frames(frames)
+  , m_nFrames(nFrames)
+{}
+
+uint FramesSource::getNumStreams() const {
+  return m_frames.size();
+}
+
+uint64_t FramesSource::getNumFrames() const {
+  return m_nFrames;
+}
+
+FrameView FramesSource::getFrame(uint stream, uint64_t iFrame) {
+  Frames* pFrames = m_frames.at(stream);
+  if (!pFrames || iFrame >= pFrames->getNumFrames())
+    return FrameView();
+  return pFrames->getFrameView(int(iFrame));
+}
+
+// Read one byte of every page of frame, so a mapped recording is read from
+// disk on the prefetch thread rather than while the frame is shown.
+static void touchPages(const FrameView& frame) {
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  const volatile uint8_t* pData =
+    static_cast<const uint8_t *>(frame.getData());
+  const size_t size = size_t(frame.getStrideInBytes()) * frame.getHeight();
+  for (size_t offset=0; offset<size; offset+=pageSize)
+    (void)pData[offset];
+}
+
+Player::Player()
+  : m_pSource(NULL)
+  , m_depth(DEFAULT_PREFETCH_DEPTH)
+  , m_nFrames(0)
+  , m_thread()
+  , m_mutex()
+  , m_fetchCond()
+  , m_readyCond()
+  , m_prefetched()
+  , m_nextFetch(0)
+  , m_generation(0)
+  , m_bStop(false)
+  , m_error()
+  , m_position(0)
+  , m_speed(1.0)
+  , m_bUnthrottled(false)
+  , m_bPaused(false)
+  , m_bLoop(true)
+  , m_nSteps(0)
+  , m_bClockStarted(false)
+  , m_lastTimestamp(0)
+  , m_lastDue()
+  , m_bStalled(false)
+  , m_nStalls(0)
+{}
+
+Player::~Player() {
+  close();
+}
+
+void Player::open(PlaybackSource* pSource, uint depth, bool bPaused) {
+  close();
+  if (!pSource || 0 == pSource->getNumFrames())
+    throw RuntimeError(__func__, ": No frame to play.");
+  std::lock_guard<std::mutex> _(m_mutex);
+  m_pSource = pSource;
+  m_depth = std::max(depth, 1u);
+  m_nFrames = pSource->getNumFrames();
+  m_bStop = false;
+  m_error = std::exception_ptr();
+  m_bPaused = bPaused;
+  m_nSteps = 0;
+  m_nStalls = 0;
+  seekLocked(0);
+  m_thread = std::thread(&Player::prefetch, this);
+}
+
+void Player::close() {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_bStop = true;
+  }
+  m_fetchCond.notify_all();
+  m_readyCond.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+  m_prefetched.clear();
+  m_pSource = NULL;
+}
+
+void Player::prefetch() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop) {
+    if (m_prefetched.size() >= m_depth || m_nextFetch >= m_nFrames) {
+      m_fetchCond.wait(lock);
+      continue;
+    }
+    const uint64_t iFrame = m_nextFetch;
+    const uint64_t generation = m_generation;
+    lock.unlock();
+    PlaybackFrame frame;
+    frame.index = iFrame;
+    frame.timestamp = 0;
+    frame.frames.resize(m_pSource->getNumStreams());
+    try {
+      bool bTimestamp = false;
+      for (uint i=0; i<frame.frames.size(); ++i) {
+	frame.frames[i] = m_pSource->getFrame(i, iFrame);
+	if (!frame.frames[i].isValid())
+	  continue;
+	touchPages(frame.frames[i]);
+	if (!bTimestamp)
+	  frame.timestamp = frame.frames[i].getTimestamp();
+	bTimestamp = true;
+      }
+    } catch (...) {
+      lock.lock();
+      m_error = std::current_exception();
+      m_readyCond.notify_all();
+      return;
+    }
+    lock.lock();
+    // A seek while fetching makes the frame set useless
+    if (generation != m_generation)
+      continue;
+    m_prefetched.push_back(std::move(frame));
+    m_nextFetch = iFrame + 1;
+    if (m_nFrames == m_nextFetch && m_bLoop)
+      m_nextFetch = 0;
+    m_readyCond.notify_all();
+  }
+}
+
+void Player::seekLocked(uint64_t iFrame) {
+  m_position = iFrame;
+  m_prefetched.clear();
+  m_nextFetch = iFrame;
+  ++m_generation;
+  m_bClockStarted = false;
+  m_bStalled = false;
+  m_fetchCond.notify_all();
+  m_readyCond.notify_all();
+}
+
+bool Player::next(PlaybackFrame& frame, milliseconds timeout) {
+  const steady_clock::time_point deadline = steady_clock::now() + timeout;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_bStop) {
+    if (m_error)
+      std::rethrow_exception(m_error);
+    steady_clock::time_point now = steady_clock::now();
+    if (now >= deadline)
+      return false;
+    bool bStep = m_bPaused && 0 < m_nSteps;
+    if ((m_bPaused && !bStep) || m_position >= m_nFrames) {
+      m_readyCond.wait_until(lock, deadline);
+      continue;
+    }
+    if (m_prefetched.empty()) {
+      if (!m_bStalled && m_bClockStarted && !m_bUnthrottled && !bStep)
+	++m_nStalls;
+      m_bStalled = true;
+      m_readyCond.wait_until(lock, deadline);
+      continue;
+    }
+    PlaybackFrame& front = m_prefetched.front();
+    steady_clock::time_point due = now;
+    if (m_bClockStarted && !m_bUnthrottled && !bStep) {
+      int64_t delta = int64_t(front.timestamp - m_lastTimestamp);
+      if (delta <= 0 || MAX_FRAME_GAP < delta)
+	delta = DEFAULT_FRAME_PERIOD;
+      due = m_lastDue + microseconds(int64_t(delta / m_speed));
+    }
+    if (now < due) {
+      // Woken early by seeks and speed changes, which move the due time
+      m_readyCond.wait_until(lock, std::min(due, deadline));
+      continue;
+    }
+    // A late frame restarts the clock instead of rushing the next ones
+    m_lastDue = (now - due > microseconds(MAX_PLAYBACK_LATENESS)) ? now : due;
+    m_lastTimestamp = front.timestamp;
+    m_bClockStarted = true;
+    m_bStalled = false;
+    frame = std::move(front);
+    m_prefetched.pop_front();
+    m_fetchCond.notify_all();
+    if (bStep)
+      --m_nSteps;
+    m_position = frame.index + 1;
+    if (m_nFrames == m_position && m_bLoop)
+      m_position = 0;
+    return true;
+  }
+  return false;
+}
+
+void Player::setSpeed(double speed) {
+  if (speed < MIN_PLAYBACK_SPEED || MAX_PLAYBACK_SPEED < speed)
+    throw RuntimeError(__func__, ": Speed ", speed, " is out of [",
+		       MIN_PLAYBACK_SPEED, ", ", MAX_PLAYBACK_SPEED, "].");
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_speed = speed;
+  }
+  m_readyCond.notify_all();
+}
+
+double Player::getSpeed() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_speed;
+}
+
+void Player::setUnthrottled(bool bUnthrottled) {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_bUnthrottled = bUnthrottled;
+    m_bClockStarted = false;
+  }
+  m_readyCond.notify_all();
+}
+
+bool Player::isUnthrottled() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_bUnthrottled;
+}
+
+void Player::setPaused(bool bPaused) {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_bPaused = bPaused;
+    m_nSteps = 0;
+    m_bClockStarted = false;
+  }
+  m_readyCond.notify_all();
+}
+
+bool Player::isPaused() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_bPaused;
+}
+
+void Player::setLoop(bool bLoop) {
+  std::lock_guard<std::mutex> _(m_mutex);
+  m_bLoop = bLoop;
+  if (bLoop && m_nFrames == m_nextFetch) {
+    m_nextFetch = 0;
+    m_fetchCond.notify_all();
+  }
+  if (bLoop && m_nFrames == m_position)
+    seekLocked(0);
+}
+
+void Player::seek(uint64_t iFrame) {
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (iFrame >= m_nFrames)
+    throw RuntimeError(__func__, ": Invalid frame number ", iFrame, ". (< ",
+		       m_nFrames, ").");
+  seekLocked(iFrame);
+}
+
+void Player::step(int nFrames) {
+  std::lock_guard<std::mutex> _(m_mutex);
+  if (0 == m_nFrames)
+    return;
+  // The frame set shown last is the one before m_position
+  int64_t iFrame = int64_t(m_position) - 1 + nFrames;
+  iFrame %= int64_t(m_nFrames);
+  if (iFrame < 0)
+    iFrame += m_nFrames;
+  m_bPaused = true;
+  if (uint64_t(iFrame) != m_position)
+    seekLocked(iFrame);
+  m_nSteps = 1;
+  m_readyCond.notify_all();
+}
+
+uint64_t Player::getNumFrames() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_nFrames;
+}
+
+uint64_t Player::getPosition() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return (0 < m_position) ? m_position - 1 : m_nFrames - 1;
+}
+
+uint64_t Player::getNumStalls() const {
+  std::lock_guard<std::mutex> _(m_mutex);
+  return m_nStalls;
+}
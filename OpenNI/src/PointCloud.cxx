@@ -0,0 +1,313 @@
+#include "PointCloud.hpp"
+#include "io.hpp"
+#include "simd.hpp"
+#include "ThreadPool.hpp"
+
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+CameraIntrinsics::CameraIntrinsics(float fx, float fy, float cx, float cy,
+				   uint width, uint height, float depthScale)
+  : fx(fx)
+  , fy(fy)
+  , cx(cx)
+  , cy(cy)
+  , width(width)
+  , height(height)
+  , depthScale(depthScale)
+{}
+
+CameraIntrinsics CameraIntrinsics::scaledTo(uint width, uint height) const {
+  float sx = float(width) / this->width, sy = float(height) / this->height;
+  return CameraIntrinsics(fx * sx, fy * sy, cx * sx, cy * sy, width, height,
+			  depthScale);
+}
+
+typedef void (*ProjectRowFcn)(const uint16_t* pDepth, const float* pRayX,
+			      const float rayY, const float scale,
+			      PointXYZ* pDst, const uint n);
+typedef void (*ProjectColorRowFcn)(const uint16_t* pDepth,
+				   const uint8_t* pColor, const float* pRayX,
+				   const float rayY, const float scale,
+				   PointXYZRGBA* pDst, const uint n);
+
+static void projectRowScalar(const uint16_t* pDepth, const float* pRayX,
+			     const float rayY, const float scale,
+			     PointXYZ* pDst, const uint n) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (uint u=0; u<n; ++u) {
+    float z = (pDepth[u]) ? pDepth[u] * scale : nan;
+    pDst[u].x = z * pRayX[u];
+    pDst[u].y = z * rayY;
+    pDst[u].z = z;
+  }
+}
+
+static void projectColorRowScalar(const uint16_t* pDepth,
+				  const uint8_t* pColor, const float* pRayX,
+				  const float rayY, const float scale,
+				  PointXYZRGBA* pDst, const uint n) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (uint u=0; u<n; ++u) {
+    float z = (pDepth[u]) ? pDepth[u] * scale : nan;
+    pDst[u].x = z * pRayX[u];
+    pDst[u].y = z * rayY;
+    pDst[u].z = z;
+    pDst[u].color[0] = 0xFF;
+    pDst[u].color[1] = pColor[3 * u];
+    pDst[u].color[2] = pColor[3 * u + 1];
+    pDst[u].color[3] = pColor[3 * u + 2];
+  }
+}
+
+#ifdef SIMD_X86
+// The vector kernels compute x, y and z of 4 or 8 points in separate
+// registers and transpose them into points. PointXYZ is stored with
+// overlapping 16 byte stores whose last 4 bytes land on the x of the next
+// point, which is written afterwards; the loops stop early enough that this
+// never goes past the row, and the remainder is handled by the next
+// narrower kernel.
+
+// z = d * scale, or NaN where d is 0.
+__attribute__((target("ssse3")))
+static inline __m128 getDepth4(const uint16_t* pDepth, const __m128 scale,
+			       const __m128 nan) {
+  __m128i d = _mm_loadl_epi64((const __m128i*)pDepth);
+  __m128 z = _mm_cvtepi32_ps(_mm_unpacklo_epi16(d, _mm_setzero_si128()));
+  __m128 invalid = _mm_cmpeq_ps(z, _mm_setzero_ps());
+  return _mm_or_ps(_mm_andnot_ps(invalid, _mm_mul_ps(z, scale)),
+		   _mm_and_ps(invalid, nan));
+}
+
+__attribute__((target("ssse3")))
+static inline void storeXYZ4(float* pDst, __m128 x, __m128 y, __m128 z) {
+  __m128 w = _mm_setzero_ps();
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  _mm_storeu_ps(pDst, x);
+  _mm_storeu_ps(pDst + 3, y);
+  _mm_storeu_ps(pDst + 6, z);
+  _mm_storeu_ps(pDst + 9, w);
+}
+
+__attribute__((target("ssse3")))
+static inline void storeXYZRGBA4(float* pDst, __m128 x, __m128 y, __m128 z,
+				 __m128 w) {
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  _mm_storeu_ps(pDst, x);
+  _mm_storeu_ps(pDst + 4, y);
+  _mm_storeu_ps(pDst + 8, z);
+  _mm_storeu_ps(pDst + 12, w);
+}
+
+// RGB888 of 4 pixels (12 of the 16 loaded bytes) to A, R, G, B.
+__attribute__((target("ssse3")))
+static inline __m128 getColor4(const uint8_t* pColor) {
+  const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5,
+					-1, 6, 7, 8, -1, 9, 10, 11);
+  __m128i src = _mm_loadu_si128((const __m128i*)pColor);
+  return _mm_castsi128_ps(_mm_or_si128(_mm_shuffle_epi8(src, shuffle),
+				       _mm_set1_epi32(0xFF)));
+}
+
+__attribute__((target("ssse3")))
+static void projectRowSSSE3(const uint16_t* pDepth, const float* pRayX,
+			    const float rayY, const float scale,
+			    PointXYZ* pDst, const uint n) {
+  const __m128 vScale = _mm_set1_ps(scale);
+  const __m128 vRayY = _mm_set1_ps(rayY);
+  const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  uint u = 0;
+  for (; u + 5 <= n; u += 4) {
+    __m128 z = getDepth4(pDepth + u, vScale, nan);
+    __m128 x = _mm_mul_ps(z, _mm_loadu_ps(pRayX + u));
+    __m128 y = _mm_mul_ps(z, vRayY);
+    storeXYZ4(reinterpret_cast<float*>(pDst + u), x, y, z);
+  }
+  projectRowScalar(pDepth + u, pRayX + u, rayY, scale, pDst + u, n - u);
+}
+
+__attribute__((target("ssse3")))
+static void projectColorRowSSSE3(const uint16_t* pDepth,
+				 const uint8_t* pColor, const float* pRayX,
+				 const float rayY, const float scale,
+				 PointXYZRGBA* pDst, const uint n) {
+  const __m128 vScale = _mm_set1_ps(scale);
+  const __m128 vRayY = _mm_set1_ps(rayY);
+  const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  uint u = 0;
+  for (; u + 6 <= n; u += 4) {
+    __m128 z = getDepth4(pDepth + u, vScale, nan);
+    __m128 x = _mm_mul_ps(z, _mm_loadu_ps(pRayX + u));
+    __m128 y = _mm_mul_ps(z, vRayY);
+    storeXYZRGBA4(reinterpret_cast<float*>(pDst + u), x, y, z,
+		  getColor4(pColor + 3 * u));
+  }
+  projectColorRowScalar(pDepth + u, pColor + 3 * u, pRayX + u, rayY, scale,
+			pDst + u, n - u);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 getDepth8(const uint16_t* pDepth, const __m256 scale,
+			       const __m256 nan) {
+  __m128i d = _mm_loadu_si128((const __m128i*)pDepth);
+  __m256 z = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(d));
+  __m256 invalid = _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_EQ_OQ);
+  return _mm256_blendv_ps(_mm256_mul_ps(z, scale), nan, invalid);
+}
+
+__attribute__((target("avx2")))
+static void projectRowAVX2(const uint16_t* pDepth, const float* pRayX,
+			   const float rayY, const float scale,
+			   PointXYZ* pDst, const uint n) {
+  const __m256 vScale = _mm256_set1_ps(scale);
+  const __m256 vRayY = _mm256_set1_ps(rayY);
+  const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  uint u = 0;
+  for (; u + 9 <= n; u += 8) {
+    __m256 z = getDepth8(pDepth + u, vScale, nan);
+    __m256 x = _mm256_mul_ps(z, _mm256_loadu_ps(pRayX + u));
+    __m256 y = _mm256_mul_ps(z, vRayY);
+    float* p = reinterpret_cast<float*>(pDst + u);
+    storeXYZ4(p, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+	      _mm256_castps256_ps128(z));
+    storeXYZ4(p + 12, _mm256_extractf128_ps(x, 1),
+	      _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+  }
+  projectRowSSSE3(pDepth + u, pRayX + u, rayY, scale, pDst + u, n - u);
+}
+
+__attribute__((target("avx2")))
+static void projectColorRowAVX2(const uint16_t* pDepth,
+				const uint8_t* pColor, const float* pRayX,
+				const float rayY, const float scale,
+				PointXYZRGBA* pDst, const uint n) {
+  const __m256 vScale = _mm256_set1_ps(scale);
+  const __m256 vRayY = _mm256_set1_ps(rayY);
+  const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  uint u = 0;
+  for (; u + 10 <= n; u += 8) {
+    __m256 z = getDepth8(pDepth + u, vScale, nan);
+    __m256 x = _mm256_mul_ps(z, _mm256_loadu_ps(pRayX + u));
+    __m256 y = _mm256_mul_ps(z, vRayY);
+    float* p = reinterpret_cast<float*>(pDst + u);
+    storeXYZRGBA4(p, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+		  _mm256_castps256_ps128(z), getColor4(pColor + 3 * u));
+    storeXYZRGBA4(p + 16, _mm256_extractf128_ps(x, 1),
+		  _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1),
+		  getColor4(pColor + 3 * u + 12));
+  }
+  projectColorRowSSSE3(pDepth + u, pColor + 3 * u, pRayX + u, rayY, scale,
+		       pDst + u, n - u);
+}
+#endif
+
+static ProjectRowFcn selectProjectRow() {
+#ifdef SIMD_X86
+  switch (getSIMDLevel()) {
+  case SIMD_AVX2:
+    return projectRowAVX2;
+  case SIMD_SSSE3:
+    return projectRowSSSE3;
+  default:
+    break;
+  }
+#endif
+  return projectRowScalar;
+}
+
+static ProjectColorRowFcn selectProjectColorRow() {
+#ifdef SIMD_X86
+  switch (getSIMDLevel()) {
+  case SIMD_AVX2:
+    return projectColorRowAVX2;
+  case SIMD_SSSE3:
+    return projectColorRowSSSE3;
+  default:
+    break;
+  }
+#endif
+  return projectColorRowScalar;
+}
+
+DepthProjector::DepthProjector(const CameraIntrinsics& intrinsics)
+  : m_intrinsics(intrinsics)
+  , m_width(0)
+  , m_height(0)
+  , m_rayX()
+  , m_rayY()
+{}
+
+void DepthProjector::setIntrinsics(const CameraIntrinsics& intrinsics) {
+  m_intrinsics = intrinsics;
+  m_width = m_height = 0;
+}
+
+const CameraIntrinsics& DepthProjector::getIntrinsics() const {
+  return m_intrinsics;
+}
+
+void DepthProjector::prepare(uint width, uint height) {
+  if (width == m_width && height == m_height)
+    return;
+  CameraIntrinsics intrinsics = m_intrinsics.scaledTo(width, height);
+  m_rayX.resize(width);
+  m_rayY.resize(height);
+  for (uint u=0; u<width; ++u)
+    m_rayX[u] = (u - intrinsics.cx) / intrinsics.fx;
+  for (uint v=0; v<height; ++v)
+    m_rayY[v] = (v - intrinsics.cy) / intrinsics.fy;
+  m_width = width;
+  m_height = height;
+}
+
+void DepthProjector::project(const uint16_t* pDepth, PointXYZ* pDst,
+			     uint width, uint height, ThreadPool* pool) {
+  static const ProjectRowFcn fcn = selectProjectRow();
+  prepare(width, height);
+  const float scale = m_intrinsics.depthScale;
+  auto projectRows = [&](uint v0, uint v1){
+    for (uint v=v0; v<v1; ++v) {
+      size_t offset = size_t(v) * width;
+      fcn(pDepth + offset, m_rayX.data(), m_rayY[v], scale, pDst + offset,
+	  width);
+    }
+  };
+  if (pool)
+    pool->parallelFor(0, height, projectRows);
+  else
+    projectRows(0, height);
+}
+
+void DepthProjector::project(const uint16_t* pDepth, const uint8_t* pColor,
+			     PointXYZRGBA* pDst, uint width, uint height,
+			     ThreadPool* pool) {
+  static const ProjectColorRowFcn fcn = selectProjectColorRow();
+  prepare(width, height);
+  const float scale = m_intrinsics.depthScale;
+  auto projectRows = [&](uint v0, uint v1){
+    for (uint v=v0; v<v1; ++v) {
+      size_t offset = size_t(v) * width;
+      fcn(pDepth + offset, pColor + 3 * offset, m_rayX.data(), m_rayY[v],
+	  scale, pDst + offset, width);
+    }
+  };
+  if (pool)
+    pool->parallelFor(0, height, projectRows);
+  else
+    projectRows(0, height);
+}
+
+void DepthProjector::project(RGBDFrames& frames, int iFrame,
+			     PointXYZRGBA* pDst, ThreadPool* pool) {
+  uint width = frames.getDepthWidth(), height = frames.getDepthHeight();
+  if (width != frames.getColorWidth() || height != frames.getColorHeight())
+    throw RuntimeError(__func__, ": Color frame ", frames.getColorWidth(),
+		       "x", frames.getColorHeight(), " is not registered to ",
+		       "depth frame ", width, "x", height, ".");
+  project(frames.getDepthFrame(iFrame), frames.getColorFrame(iFrame), pDst,
+	  width, height, pool);
+}
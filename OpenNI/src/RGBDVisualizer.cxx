@@ -1,4 +1,48 @@
 #include "RGBDVisualizer.hpp"
+#include "StreamStats.hpp"
+#include "io.hpp"
+
+#include <thread>
+#include <algorithm>
+
+TextureLock::TextureLock(SDL_Texture* pTexture, const SDL_Rect& rect)
+  : m_pTexture(NULL)
+  , m_pPixels(NULL)
+  , m_pitch(0)
+{
+  if (rect.w <= 0 || rect.h <= 0)
+    return;
+  void* pPixels = NULL;
+  if (SDL_LockTexture(pTexture, &rect, &pPixels, &m_pitch))
+    throw RuntimeError(__func__, ": Failed to lock texture: ", SDL_GetError());
+  m_pTexture = pTexture;
+  m_pPixels = static_cast<uint8_t *>(pPixels);
+}
+
+TextureLock::TextureLock(TextureLock&& other)
+  : m_pTexture(other.m_pTexture)
+  , m_pPixels(other.m_pPixels)
+  , m_pitch(other.m_pitch)
+{
+  other.m_pTexture = NULL;
+  other.m_pPixels = NULL;
+}
+
+TextureLock::~TextureLock() {
+  unlock();
+}
+
+uint8_t* TextureLock::getPixels() const { return m_pPixels; }
+
+uint TextureLock::getPitch() const { return uint(m_pitch); }
+
+void TextureLock::unlock() {
+  if (!m_pTexture)
+    return;
+  SDL_UnlockTexture(m_pTexture);
+  m_pTexture = NULL;
+  m_pPixels = NULL;
+}
 
 void RGBDVisualizer::initSDL(Uint32 flag) {
   SDL_Init(flag);
@@ -18,10 +62,14 @@ RGBDVisualizer::RGBDVisualizer()
   , m_depthH(0)
   , m_colorW(0)
   , m_colorH(0)
-  , m_channel(4)
-  , m_pColorBuff(NULL)
-  , m_pDepthBuff(NULL)
+  , m_mutex()
+  , m_cond()
+  , m_published()
+  , m_bStopped(false)
+  , m_pEventHandler(NULL)
+  , m_titleMutex()
   , m_windowTitle()
+  , m_bTitleChanged(false)
 {}
 
 RGBDVisualizer::~RGBDVisualizer() {
@@ -31,26 +79,25 @@ RGBDVisualizer::~RGBDVisualizer() {
     SDL_DestroyTexture(m_pTexture);
   if (m_pWindow)
     SDL_DestroyWindow(m_pWindow);
-  if (m_pDepthBuff)
-    delete[] m_pDepthBuff;
-  if (m_pColorBuff)
-    delete[] m_pColorBuff;
 }
 
-void RGBDVisualizer::initWindow(uint depthW, uint depthH, uint colorW, uint colorH) {
+void RGBDVisualizer::initWindow(uint depthW, uint depthH, uint colorW, uint colorH,
+				bool bVSync) {
   m_depthW = depthW; m_depthH = depthH;
   m_colorW = colorW; m_colorH = colorH;
-  createWindow();
-  createConversionBuffers();
+  createWindow(bVSync);
 }
 
-void RGBDVisualizer::createWindow() {
+void RGBDVisualizer::createWindow(bool bVSync) {
   // Check the size
   uint width = m_depthW + m_colorW;
   uint height = (m_depthH > m_colorH) ? m_depthH : m_colorH;
   // Create window, renderer and texture
   m_pWindow = SDL_CreateWindow("RGBDVisualizer", 0, 0, width, height, 0);
-  m_pRenderer = SDL_CreateRenderer(m_pWindow, -1, SDL_RENDERER_ACCELERATED);
+  Uint32 flags = SDL_RENDERER_ACCELERATED;
+  if (bVSync)
+    flags |= SDL_RENDERER_PRESENTVSYNC;
+  m_pRenderer = SDL_CreateRenderer(m_pWindow, -1, flags);
   m_pTexture = SDL_CreateTexture(m_pRenderer,
 
 				 SDL_PIXELFORMAT_BGRA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
@@ -58,49 +105,143 @@ void RGBDVisualizer::createWindow() {
   m_depthRect.x = m_depthRect.y = m_colorRect.y = 0;
   m_depthRect.w = m_colorRect.x = m_depthW; m_depthRect.h = m_depthH;
   m_colorRect.w = m_colorW; m_colorRect.h = m_colorH;
+  // Streaming textures start undefined: clear until the first frames
+  SDL_Rect all = {0, 0, int(width), int(height)};
+  TextureLock lock(m_pTexture, all);
+  for (uint h=0; h<height; ++h)
+    memset(lock.getPixels() + size_t(h) * lock.getPitch(), 0, width * 4);
 }
 
-void RGBDVisualizer::createConversionBuffers() {
-  size_t nDepthPix = (size_t) m_depthW * m_depthH * m_channel;
-  size_t nColorPix = (size_t) m_colorW * m_colorH * m_channel;
-  m_pDepthBuff = new uint8_t[nDepthPix];
-  m_pColorBuff = new uint8_t[nColorPix];
-  //memset_s(m_pDepthBuff, nDepthPix, 0, nDepthPix);
-  //memset_s(m_pColorBuff, nColorPix, 0, nColorPix);
-  memset(m_pDepthBuff, 0, nDepthPix);
-  memset(m_pColorBuff, 0, nColorPix);
-}
-
-uint8_t* RGBDVisualizer::getColorBuffer() const {
-  return m_pColorBuff;
+TextureLock RGBDVisualizer::lockDepthRegion() {
+  return TextureLock(m_pTexture, m_depthRect);
 }
 
-uint8_t* RGBDVisualizer::getDepthBuffer() const {
-  return m_pDepthBuff;
+TextureLock RGBDVisualizer::lockColorRegion() {
+  return TextureLock(m_pTexture, m_colorRect);
 }
 
 void RGBDVisualizer::refreshWindow() {
-  updateTexture();
   render();
 }
 
-void RGBDVisualizer::updateTexture() {
-  SDL_UpdateTexture(m_pTexture, &m_depthRect, (const void*)m_pDepthBuff, m_depthW * m_channel);
-  SDL_UpdateTexture(m_pTexture, &m_colorRect, (const void*)m_pColorBuff, m_colorW * m_channel);
+void RGBDVisualizer::publish(VisualizerRegion region, const FrameView& frame,
+			     uint16_t v_min, uint16_t v_max,
+			     StreamStats* pStats) {
+  Published next = {frame, v_min, v_max, pStats,
+		    uint64_t(getSteadyTimestamp().count()), true};
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    std::swap(m_published[region], next);
+  }
+  m_cond.notify_one();
+  // The replaced view is released here, outside the lock
+}
+
+bool RGBDVisualizer::takePublished(Published (&pending)[N_VISUALIZER_REGIONS],
+				   std::chrono::milliseconds timeout) {
+  auto hasNew = [&](){
+    for (const Published& published : m_published)
+      if (published.bNew)
+	return true;
+    return bool(m_bStopped);
+  };
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!m_cond.wait_for(lock, timeout, hasNew))
+    return false;
+  bool bNew = false;
+  for (uint i=0; i<N_VISUALIZER_REGIONS; ++i) {
+    if (!m_published[i].bNew)
+      continue;
+    std::swap(pending[i], m_published[i]);
+    m_published[i].bNew = false;
+    bNew = true;
+  }
+  return bNew;
+}
+
+void RGBDVisualizer::run(uint maxFPS, ThreadPool* pool) {
+  using namespace std::chrono;
+  const microseconds period(maxFPS ? 1000000 / maxFPS : 0);
+  const microseconds pollInterval = milliseconds(EVENT_POLL_INTERVAL);
+  auto next = steady_clock::now();
+  while (!isStopped()) {
+    // Keep handling events while waiting for the next presentation
+    auto wait = duration_cast<microseconds>(next - steady_clock::now());
+    if (0 < wait.count()) {
+      std::this_thread::sleep_for(std::min(wait, pollInterval));
+      continue;
+    }
+    Published pending[N_VISUALIZER_REGIONS] = {};
+    if (!takePublished(pending, milliseconds(EVENT_POLL_INTERVAL)))
+      continue;
+    uint64_t converted[N_VISUALIZER_REGIONS] = {};
+    for (uint i=0; i<N_VISUALIZER_REGIONS; ++i) {
+      Published& published = pending[i];
+      if (!published.bNew)
+	continue;
+      const FrameView& frame = published.frame;
+      TextureLock region = (REGION_DEPTH == i) ?
+	lockDepthRegion() : lockColorRegion();
+      if (2 == frame.getBPP())
+	frame.convert16BitFrameToJet(region.getPixels(), published.v_min,
+				     published.v_max, 1, pool,
+				     region.getPitch());
+      else
+	frame.copyTo(region.getPixels(), 1, 1, pool, region.getPitch());
+      region.unlock();
+      published.frame.release();
+      converted[i] = getSteadyTimestamp().count();
+      if (published.pStats)
+	published.pStats->record(STAGE_CONVERT, published.published,
+				 converted[i]);
+    }
+    render();
+    uint64_t presented = getSteadyTimestamp().count();
+    for (uint i=0; i<N_VISUALIZER_REGIONS; ++i)
+      if (pending[i].bNew && pending[i].pStats)
+	pending[i].pStats->record(STAGE_PRESENT, converted[i], presented);
+    // Frames published until then replace each other
+    next = std::max(next + period, steady_clock::now());
+  }
+}
+
+void RGBDVisualizer::stop() {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_bStopped = true;
+  }
+  m_cond.notify_all();
+}
+
+void RGBDVisualizer::resetStop() {
+  std::lock_guard<std::mutex> _(m_mutex);
+  m_bStopped = false;
 }
 
 void RGBDVisualizer::render() {
+  {
+    std::lock_guard<std::mutex> _(m_titleMutex);
+    if (m_bTitleChanged) {
+      SDL_SetWindowTitle(m_pWindow, m_windowTitle);
+      m_bTitleChanged = false;
+    }
+  }
   SDL_RenderClear(m_pRenderer);
   SDL_RenderCopy(m_pRenderer, m_pTexture, NULL, NULL);
   SDL_RenderPresent(m_pRenderer);
 }
 
 void RGBDVisualizer::setWindowTitle(const char* format, ...) const {
+  std::lock_guard<std::mutex> _(m_titleMutex);
   va_list argptr;
   va_start(argptr, format);
-  vsnprintf((char *)m_windowTitle, MAX_WINDOW_TITLE_LENGTH, format, argptr);
+  vsnprintf(m_windowTitle, MAX_WINDOW_TITLE_LENGTH, format, argptr);
   va_end(argptr);
-  SDL_SetWindowTitle(m_pWindow, m_windowTitle);
+  m_bTitleChanged = true;
+}
+
+void RGBDVisualizer::setEventHandler(EventHandler* pHandler) {
+  m_pEventHandler = pHandler;
 }
 
 void RGBDVisualizer::delay(Uint32 mSec) const {
@@ -109,17 +250,24 @@ void RGBDVisualizer::delay(Uint32 mSec) const {
 
 bool RGBDVisualizer::isStopped() const {
   SDL_Event e;
-  if (SDL_PollEvent(&e)) {
+  while (SDL_PollEvent(&e)) {
     switch (e.type) {
     case SDL_QUIT:
-      return true;
+      m_bStopped = true;
+      break;
     case SDL_KEYUP:
       switch (e.key.keysym.sym) {
       case SDLK_ESCAPE:
       case SDLK_q:
-	return true;
+	m_bStopped = true;
       }
+      break;
+    case SDL_KEYDOWN:
+      if (m_pEventHandler && SDLK_ESCAPE != e.key.keysym.sym &&
+	  SDLK_q != e.key.keysym.sym)
+	m_pEventHandler->onKeyDown(e.key.keysym);
+      break;
     }
   }
-  return false;
+  return m_bStopped;
 }
@@ -0,0 +1,394 @@
+#include "Recording.hpp"
+#include "DepthCodec.hpp"
+#include "io.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Chunks and the index are aligned to this size in byte.
+#define RECORDING_ALIGNMENT 8
+
+static_assert(sizeof(RecordingHeader) == 16, "Unexpected RecordingHeader size");
+static_assert(sizeof(StreamInfo) == 32, "Unexpected StreamInfo size");
+static_assert(sizeof(ChunkHeader) == 48, "Unexpected ChunkHeader size");
+static_assert(sizeof(IndexEntry) == 16, "Unexpected IndexEntry size");
+static_assert(sizeof(IndexFooter) == 24, "Unexpected IndexFooter size");
+
+static uint64_t align(uint64_t size) {
+  return (size + RECORDING_ALIGNMENT - 1) / RECORDING_ALIGNMENT
+    * RECORDING_ALIGNMENT;
+}
+
+RecordingWriter::RecordingWriter()
+  : m_pFile(NULL)
+  , m_path()
+  , m_streams()
+  , m_index()
+  , m_nFrames(0)
+  , m_nBytes(0)
+{}
+
+RecordingWriter::~RecordingWriter() {
+  try {
+    close();
+  } catch (const std::exception& e) {
+    printf("%s\n", e.what());
+  }
+}
+
+uint RecordingWriter::addStream(const StreamInfo& info) {
+  if (m_pFile)
+    throw RuntimeError(__func__, ": Streams must be added before open().");
+  m_streams.push_back(info);
+  return m_streams.size() - 1;
+}
+
+uint RecordingWriter::getNumStreams() const {
+  return m_streams.size();
+}
+
+const StreamInfo& RecordingWriter::getStreamInfo(uint stream) const {
+  if (stream >= m_streams.size())
+    throw RuntimeError(__func__, ": Invalid stream ", stream, ".");
+  return m_streams[stream];
+}
+
+void RecordingWriter::write(const void* pData, size_t size) {
+  if (size != std::fwrite(pData, 1, size, m_pFile))
+    throw RuntimeError(__func__, ": Failed to write to ", m_path, ": ",
+		       std::string(strerror(errno)));
+  m_nBytes += size;
+}
+
+void RecordingWriter::open(const char* path) {
+  if (m_pFile)
+    throw RuntimeError(__func__, ": ", m_path, " is already open.");
+  if (m_streams.empty())
+    throw RuntimeError(__func__, ": No stream is added.");
+  m_pFile = std::fopen(path, "wb");
+  if (!m_pFile)
+    throw RuntimeError(__func__, ": Failed to open ", path, ": ",
+		       std::string(strerror(errno)));
+  m_path = path;
+  m_nFrames = m_nBytes = 0;
+  m_index.assign(m_streams.size(), std::vector<IndexEntry>());
+
+  RecordingHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+  header.version = RECORDING_VERSION;
+  header.nStreams = m_streams.size();
+  write(&header, sizeof(header));
+  write(m_streams.data(), sizeof(StreamInfo) * m_streams.size());
+}
+
+bool RecordingWriter::isOpen() const {
+  return m_pFile != NULL;
+}
+
+void RecordingWriter::writeIndex() {
+  IndexFooter footer;
+  memset(&footer, 0, sizeof(footer));
+  footer.indexOffset = m_nBytes;
+  footer.nStreams = m_streams.size();
+  memcpy(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  for (auto& index : m_index) {
+    uint64_t nFrames = index.size();
+    write(&nFrames, sizeof(nFrames));
+  }
+  for (auto& index : m_index)
+    write(index.data(), sizeof(IndexEntry) * index.size());
+  write(&footer, sizeof(footer));
+}
+
+void RecordingWriter::close() {
+  if (!m_pFile)
+    return;
+  try {
+    writeIndex();
+  } catch (...) {
+    std::fclose(m_pFile);
+    m_pFile = NULL;
+    throw;
+  }
+  m_index.clear();
+  int ret = std::fclose(m_pFile);
+  m_pFile = NULL;
+  if (ret)
+    throw RuntimeError(__func__, ": Failed to close ", m_path, ": ",
+		       std::string(strerror(errno)));
+}
+
+void RecordingWriter::writeFrame(const uint stream, const void* pData,
+				 const uint64_t size, const uint64_t timestamp,
+				 const int64_t frameIndex,
+				 const uint64_t hostTimestamp,
+				 const uint codec) {
+  if (!m_pFile)
+    throw RuntimeError(__func__, ": File is not open.");
+  if (stream >= m_streams.size())
+    throw RuntimeError(__func__, ": Invalid stream ", stream, ".");
+  IndexEntry entry;
+  entry.offset = m_nBytes;
+  entry.timestamp = timestamp;
+  ChunkHeader chunk;
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.magic = CHUNK_MAGIC;
+  chunk.stream = stream;
+  chunk.codec = codec;
+  chunk.size = size;
+  chunk.timestamp = timestamp;
+  chunk.frameIndex = frameIndex;
+  chunk.hostTimestamp = hostTimestamp;
+  write(&chunk, sizeof(chunk));
+  write(pData, size);
+  const uint8_t padding[RECORDING_ALIGNMENT] = {0};
+  if (align(size) != size)
+    write(padding, align(size) - size);
+  m_index[stream].push_back(entry);
+  ++m_nFrames;
+}
+
+uint64_t RecordingWriter::getNumFrames() const {
+  return m_nFrames;
+}
+
+uint64_t RecordingWriter::getNumBytes() const {
+  return m_nBytes;
+}
+
+struct RecordingReader::Mapping {
+  void* pData;
+  size_t size;
+  Mapping(void* p, size_t n) : pData(p), size(n) {};
+  ~Mapping() { munmap(pData, size); };
+};
+
+RecordingReader::RecordingReader()
+  : m_pMapping()
+  , m_path()
+  , m_streams()
+  , m_index()
+  , m_nFrames()
+  , m_scannedIndex()
+{}
+
+RecordingReader::~RecordingReader() {
+  close();
+}
+
+const uint8_t* RecordingReader::getPointer(uint64_t offset,
+					   uint64_t size) const {
+  if (offset > m_pMapping->size || size > m_pMapping->size - offset)
+    return NULL;
+  return static_cast<const uint8_t *>(m_pMapping->pData) + offset;
+}
+
+void RecordingReader::open(const char* path) {
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    throw RuntimeError(__func__, ": Failed to open ", path, ": ",
+		       std::string(strerror(errno)));
+  struct stat st;
+  if (fstat(fd, &st)) {
+    ::close(fd);
+    throw RuntimeError(__func__, ": Failed to stat ", path, ".");
+  }
+  size_t size = st.st_size;
+  void* pData = (size) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+  ::close(fd);
+  if (!pData || MAP_FAILED == pData)
+    throw RuntimeError(__func__, ": Failed to map ", path, ".");
+  m_pMapping = std::make_shared<Mapping>(pData, size);
+  m_path = path;
+
+  const RecordingHeader* pHeader = reinterpret_cast<const RecordingHeader *>(
+    getPointer(0, sizeof(RecordingHeader)));
+  if (!pHeader || memcmp(pHeader->magic, RECORDING_MAGIC,
+			 sizeof(RECORDING_MAGIC))) {
+    close();
+    throw RuntimeError(__func__, ": ", path, " is not a recording.");
+  }
+  if (RECORDING_VERSION != pHeader->version) {
+    uint version = pHeader->version;
+    close();
+    throw RuntimeError(__func__, ": Unsupported version ", version, ".");
+  }
+  uint nStreams = pHeader->nStreams;
+  uint64_t offset = sizeof(RecordingHeader);
+  const StreamInfo* pInfo = reinterpret_cast<const StreamInfo *>(
+    getPointer(offset, sizeof(StreamInfo) * nStreams));
+  if (!pInfo) {
+    close();
+    throw RuntimeError(__func__, ": ", path, " is truncated.");
+  }
+  m_streams.assign(pInfo, pInfo + nStreams);
+  offset += sizeof(StreamInfo) * nStreams;
+
+  const IndexFooter* pFooter = NULL;
+  if (size >= sizeof(IndexFooter))
+    pFooter = reinterpret_cast<const IndexFooter *>(
+      getPointer(size - sizeof(IndexFooter), sizeof(IndexFooter)));
+  if (!pFooter || memcmp(pFooter->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) ||
+      pFooter->nStreams != nStreams || !readIndex(pFooter->indexOffset))
+    scanChunks(offset);
+}
+
+bool RecordingReader::readIndex(uint64_t offset) {
+  uint nStreams = m_streams.size();
+  const uint64_t* pCount = reinterpret_cast<const uint64_t *>(
+    getPointer(offset, sizeof(uint64_t) * nStreams));
+  if (!pCount)
+    return false;
+  offset += sizeof(uint64_t) * nStreams;
+  m_index.resize(nStreams);
+  m_nFrames.assign(pCount, pCount + nStreams);
+  for (uint i=0; i<nStreams; ++i) {
+    if (m_nFrames[i] > m_pMapping->size / sizeof(IndexEntry))
+      return false;
+    m_index[i] = reinterpret_cast<const IndexEntry *>(
+      getPointer(offset, sizeof(IndexEntry) * m_nFrames[i]));
+    if (!m_index[i])
+      return false;
+    offset += sizeof(IndexEntry) * m_nFrames[i];
+  }
+  return true;
+}
+
+void RecordingReader::scanChunks(uint64_t offset) {
+  uint nStreams = m_streams.size();
+  m_scannedIndex.assign(nStreams, std::vector<IndexEntry>());
+  while (1) {
+    const ChunkHeader* pChunk = reinterpret_cast<const ChunkHeader *>(
+      getPointer(offset, sizeof(ChunkHeader)));
+    if (!pChunk || CHUNK_MAGIC != pChunk->magic || pChunk->stream >= nStreams
+	|| !getPointer(offset + sizeof(ChunkHeader), pChunk->size))
+      break;
+    IndexEntry entry;
+    entry.offset = offset;
+    entry.timestamp = pChunk->timestamp;
+    m_scannedIndex[pChunk->stream].push_back(entry);
+    offset += sizeof(ChunkHeader) + align(pChunk->size);
+  }
+  m_index.resize(nStreams);
+  m_nFrames.resize(nStreams);
+  for (uint i=0; i<nStreams; ++i) {
+    m_index[i] = m_scannedIndex[i].data();
+    m_nFrames[i] = m_scannedIndex[i].size();
+  }
+}
+
+bool RecordingReader::isOpen() const {
+  return (bool)m_pMapping;
+}
+
+void RecordingReader::close() {
+  m_pMapping.reset();
+  m_streams.clear();
+  m_index.clear();
+  m_nFrames.clear();
+  m_scannedIndex.clear();
+}
+
+uint RecordingReader::getNumStreams() const {
+  return m_streams.size();
+}
+
+const StreamInfo& RecordingReader::getStreamInfo(uint stream) const {
+  if (stream >= m_streams.size())
+    throw RuntimeError(__func__, ": Invalid stream ", stream, ".");
+  return m_streams[stream];
+}
+
+int RecordingReader::findStream(uint sensorType) const {
+  for (uint i=0; i<m_streams.size(); ++i) {
+    if (m_streams[i].sensorType == sensorType)
+      return i;
+  }
+  return -1;
+}
+
+uint64_t RecordingReader::getNumFrames(uint stream) const {
+  if (stream >= m_streams.size())
+    throw RuntimeError(__func__, ": Invalid stream ", stream, ".");
+  return m_nFrames[stream];
+}
+
+const ChunkHeader& RecordingReader::getChunkHeader(uint stream,
+						   uint64_t iFrame) const {
+  if (iFrame >= getNumFrames(stream))
+    throw RuntimeError(__func__, ": Invalid frame number ", iFrame,
+		       ". (< ", getNumFrames(stream), ").");
+  const ChunkHeader* pChunk = reinterpret_cast<const ChunkHeader *>(
+    getPointer(m_index[stream][iFrame].offset, sizeof(ChunkHeader)));
+  if (!pChunk || CHUNK_MAGIC != pChunk->magic ||
+      !getPointer(m_index[stream][iFrame].offset + sizeof(ChunkHeader),
+		  pChunk->size))
+    throw RuntimeError(__func__, ": Broken chunk. (stream ", stream,
+		       ", frame ", iFrame, ").");
+  return *pChunk;
+}
+
+const void* RecordingReader::getFrameData(uint stream, uint64_t iFrame) const {
+  const ChunkHeader* pChunk = &getChunkHeader(stream, iFrame);
+  return reinterpret_cast<const uint8_t *>(pChunk + 1);
+}
+
+uint64_t RecordingReader::findFrame(uint stream, uint64_t timestamp) const {
+  uint64_t nFrames = getNumFrames(stream);
+  const IndexEntry* pBegin = m_index[stream];
+  const IndexEntry* pEnd = pBegin + nFrames;
+  const IndexEntry* pFound = std::lower_bound(
+    pBegin, pEnd, timestamp, [](const IndexEntry& entry, uint64_t t){
+      return entry.timestamp < t;
+    });
+  return pFound - pBegin;
+}
+
+void RecordingReader::readFrame(uint stream, uint64_t iFrame,
+				void* pDst, ThreadPool* pool) const {
+  const StreamInfo& info = getStreamInfo(stream);
+  const ChunkHeader& chunk = getChunkHeader(stream, iFrame);
+  uint64_t frameSize = uint64_t(info.width) * info.height * info.BPP;
+  switch (chunk.codec) {
+  case CODEC_RAW:
+    if (chunk.size != frameSize)
+      throw RuntimeError(__func__, ": Unexpected frame size ", chunk.size,
+			 ". (expected ", frameSize, ").");
+    memcpy(pDst, &chunk + 1, frameSize);
+    break;
+  case CODEC_DEPTH_RLZ:
+    if (2 != info.BPP)
+      throw RuntimeError(__func__, ": Depth codec in a ", info.BPP,
+			 " byte/pixel stream.");
+    DepthCodec(pool).decode(&chunk + 1, chunk.size, (uint16_t*) pDst,
+			    info.width, info.height);
+    break;
+  default:
+    throw RuntimeError(__func__, ": Unknown codec ", chunk.codec, ".");
+  }
+}
+
+FrameView RecordingReader::getFrameView(uint stream, uint64_t iFrame,
+					ThreadPool* pool) const {
+  const StreamInfo& info = getStreamInfo(stream);
+  const ChunkHeader& chunk = getChunkHeader(stream, iFrame);
+  if (CODEC_RAW == chunk.codec)
+    return FrameView(m_pMapping, &chunk + 1, info.width, info.height,
+		     info.width * info.BPP, info.BPP, chunk.timestamp,
+		     chunk.frameIndex, iFrame + 1);
+  std::shared_ptr<std::vector<uint8_t> > pBuffer =
+    std::make_shared<std::vector<uint8_t> >(size_t(info.width) * info.height
+					    * info.BPP);
+  readFrame(stream, iFrame, pBuffer->data(), pool);
+  return FrameView(pBuffer, pBuffer->data(), info.width, info.height,
+		   info.width * info.BPP, info.BPP, chunk.timestamp,
+		   chunk.frameIndex, iFrame + 1);
+}
@@ -0,0 +1,314 @@
+#include "Registration.hpp"
+#include "io.hpp"
+#include "FrameView.hpp"
+#include "ThreadPool.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+CameraExtrinsics::CameraExtrinsics()
+  : R{1, 0, 0, 0, 1, 0, 0, 0, 1}
+  , t{-DEFAULT_DEPTH_COLOR_BASELINE, 0, 0}
+{}
+
+CameraExtrinsics::CameraExtrinsics(const float R[9], const float t[3]) {
+  memcpy(this->R, R, sizeof(this->R));
+  memcpy(this->t, t, sizeof(this->t));
+}
+
+// Constants of the mapping of one frame
+struct MapParams {
+  float offset[3]; // Color camera projection of t
+  float shift;     // From the pixel center to the top left of the splat
+  float zScale;    // [m] -> depth unit
+  int splat;
+  int width, height;
+};
+
+typedef void (*MapRowFcn)(const uint16_t* pRow, const float* pTableX,
+			  const float* pTableY, const float* pTableZ,
+			  const MapParams& p, RegistrationTarget* pTarget,
+			  const uint n, int& rowMin, int& rowMax);
+
+static void mapRowScalar(const uint16_t* pRow, const float* pTableX,
+			 const float* pTableY, const float* pTableZ,
+			 const MapParams& p, RegistrationTarget* pTarget,
+			 const uint n, int& rowMin, int& rowMax) {
+  for (uint u=0; u<n; ++u) {
+    pTarget[u].depth = 0;
+    float z = pRow[u] * pTableZ[u] + p.offset[2];
+    if (0 == pRow[u] || z <= 0.0f)
+      continue;
+    float invZ = 1.0f / z;
+    float x = (pRow[u] * pTableX[u] + p.offset[0]) * invZ + p.shift;
+    float y = (pRow[u] * pTableY[u] + p.offset[1]) * invZ + p.shift;
+    if (!(-p.splat < x && x < p.width && -p.splat < y && y < p.height))
+      continue;
+    // x, y > -splat, so truncation of the shifted value is floor.
+    pTarget[u].x = int16_t(int(x + p.splat) - p.splat);
+    pTarget[u].y = int16_t(int(y + p.splat) - p.splat);
+    pTarget[u].depth = uint16_t(std::min(65535.0f, z * p.zScale + 0.5f));
+    rowMin = std::min(rowMin, int(pTarget[u].y));
+    rowMax = std::max(rowMax, pTarget[u].y + p.splat - 1);
+  }
+}
+
+#ifdef SIMD_X86
+__attribute__((target("avx2")))
+static void mapRowAVX2(const uint16_t* pRow, const float* pTableX,
+		       const float* pTableY, const float* pTableZ,
+		       const MapParams& p, RegistrationTarget* pTarget,
+		       const uint n, int& rowMin, int& rowMax) {
+  const __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+  const __m256 offsetX = _mm256_set1_ps(p.offset[0]);
+  const __m256 offsetY = _mm256_set1_ps(p.offset[1]);
+  const __m256 offsetZ = _mm256_set1_ps(p.offset[2]);
+  const __m256 shift = _mm256_set1_ps(p.shift);
+  const __m256 zScale = _mm256_set1_ps(p.zScale);
+  const __m256 maxDepth = _mm256_set1_ps(65535.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 splat = _mm256_set1_ps(float(p.splat));
+  const __m256 width = _mm256_set1_ps(float(p.width));
+  const __m256 height = _mm256_set1_ps(float(p.height));
+  const __m256i iSplat = _mm256_set1_epi32(p.splat);
+  const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+  __m256i vMin = _mm256_set1_epi32(p.height);
+  __m256i vMax = _mm256_set1_epi32(-1);
+  uint u = 0;
+  for (; u + 8 <= n; u += 8) {
+    __m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32
+				  (_mm_loadu_si128((const __m128i*)(pRow + u))));
+    __m256 z = _mm256_add_ps(_mm256_mul_ps(d, _mm256_loadu_ps(pTableZ + u)),
+			     offsetZ);
+    __m256 invZ = _mm256_div_ps(one, z);
+    __m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps
+		     (d, _mm256_loadu_ps(pTableX + u)), offsetX), invZ), shift);
+    __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps
+		     (d, _mm256_loadu_ps(pTableY + u)), offsetY), invZ), shift);
+    // d > 0, z > 0 and -splat < x < width, -splat < y < height
+    __m256 valid = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ),
+				 _mm256_cmp_ps(z, zero, _CMP_GT_OQ));
+    x = _mm256_add_ps(x, splat);
+    y = _mm256_add_ps(y, splat);
+    valid = _mm256_and_ps(valid, _mm256_and_ps
+			  (_mm256_cmp_ps(zero, x, _CMP_LT_OQ),
+			   _mm256_cmp_ps(x, _mm256_add_ps(width, splat),
+					 _CMP_LT_OQ)));
+    valid = _mm256_and_ps(valid, _mm256_and_ps
+			  (_mm256_cmp_ps(zero, y, _CMP_LT_OQ),
+			   _mm256_cmp_ps(y, _mm256_add_ps(height, splat),
+					 _CMP_LT_OQ)));
+    __m256i iValid = _mm256_castps_si256(valid);
+    __m256i ix = _mm256_sub_epi32(_mm256_cvttps_epi32(x), iSplat);
+    __m256i iy = _mm256_sub_epi32(_mm256_cvttps_epi32(y), iSplat);
+    __m256i depth = _mm256_cvttps_epi32(_mm256_min_ps(maxDepth, _mm256_add_ps
+					  (_mm256_mul_ps(z, zScale), half)));
+    depth = _mm256_and_si256(depth, iValid);
+    vMin = _mm256_min_epi32(vMin, _mm256_blendv_epi8(vMin, iy, iValid));
+    vMax = _mm256_max_epi32(vMax, _mm256_blendv_epi8
+			    (vMax, _mm256_add_epi32(iy, _mm256_sub_epi32
+				   (iSplat, _mm256_set1_epi32(1))), iValid));
+    // Interleave (x | y << 16, depth) pairs into RegistrationTarget.
+    __m256i xy = _mm256_or_si256(_mm256_and_si256(ix, lowMask),
+				 _mm256_slli_epi32(iy, 16));
+    __m256i lo = _mm256_unpacklo_epi32(xy, depth);
+    __m256i hi = _mm256_unpackhi_epi32(xy, depth);
+    _mm256_storeu_si256((__m256i*)(pTarget + u),
+			_mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(pTarget + u + 4),
+			_mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  int32_t mins[8], maxs[8];
+  _mm256_storeu_si256((__m256i*)mins, vMin);
+  _mm256_storeu_si256((__m256i*)maxs, vMax);
+  for (int i=0; i<8; ++i) {
+    rowMin = std::min(rowMin, int(mins[i]));
+    rowMax = std::max(rowMax, int(maxs[i]));
+  }
+  mapRowScalar(pRow + u, pTableX + u, pTableY + u, pTableZ + u, p,
+	       pTarget + u, n - u, rowMin, rowMax);
+}
+#endif
+
+static MapRowFcn selectMapRow() {
+#ifdef SIMD_X86
+  if (SIMD_AVX2 == getSIMDLevel())
+    return mapRowAVX2;
+#endif
+  return mapRowScalar;
+}
+
+DepthRegistration::DepthRegistration(const CameraIntrinsics& depth,
+				     const CameraIntrinsics& color,
+				     const CameraExtrinsics& extrinsics)
+  : m_depth(depth)
+  , m_color(color)
+  , m_extrinsics(extrinsics)
+  , m_width(0)
+  , m_height(0)
+  , m_splatSize(0)
+  , m_tableX()
+  , m_tableY()
+  , m_tableZ()
+  , m_offset{0, 0, 0}
+  , m_targets()
+  , m_rowMin()
+  , m_rowMax()
+{}
+
+void DepthRegistration::setCalibration(const CameraIntrinsics& depth,
+				       const CameraIntrinsics& color,
+				       const CameraExtrinsics& extrinsics) {
+  m_depth = depth;
+  m_color = color;
+  m_extrinsics = extrinsics;
+  m_width = m_height = 0;
+}
+
+void DepthRegistration::setSplatSize(uint size) {
+  m_splatSize = size;
+  m_width = m_height = 0;
+}
+
+// A depth pixel with ray r and raw depth d is at p = d * scale * r in the
+// depth camera and at R * p + t in the color camera, where it projects to
+// (fx * X + cx * Z, fy * Y + cy * Z, Z) / Z. Everything but d is constant
+// per pixel, so the table holds the projection of scale * R * r, and the
+// point maps to (d * table + offset) / (d * table_z + offset_z).
+void DepthRegistration::prepare(uint width, uint height) {
+  if (width == m_width && height == m_height)
+    return;
+  const CameraIntrinsics d = m_depth.scaledTo(width, height);
+  const CameraIntrinsics c = m_color.scaledTo(width, height);
+  const float* R = m_extrinsics.R;
+  const float* t = m_extrinsics.t;
+  const size_t nPixels = size_t(width) * height;
+  m_tableX.resize(nPixels);
+  m_tableY.resize(nPixels);
+  m_tableZ.resize(nPixels);
+  size_t i = 0;
+  for (uint v=0; v<height; ++v) {
+    float ry = (v - d.cy) / d.fy;
+    for (uint u=0; u<width; ++u, ++i) {
+      float rx = (u - d.cx) / d.fx;
+      float X = d.depthScale * (R[0] * rx + R[1] * ry + R[2]);
+      float Y = d.depthScale * (R[3] * rx + R[4] * ry + R[5]);
+      float Z = d.depthScale * (R[6] * rx + R[7] * ry + R[8]);
+      m_tableX[i] = c.fx * X + c.cx * Z;
+      m_tableY[i] = c.fy * Y + c.cy * Z;
+      m_tableZ[i] = Z;
+    }
+  }
+  m_offset[0] = c.fx * t[0] + c.cx * t[2];
+  m_offset[1] = c.fy * t[1] + c.cy * t[2];
+  m_offset[2] = t[2];
+  m_targets.resize(nPixels);
+  m_rowMin.resize(height);
+  m_rowMax.resize(height);
+  m_width = width;
+  m_height = height;
+}
+
+void DepthRegistration::apply(const uint16_t* pDepth, uint16_t* pDst,
+			      uint width, uint height, uint strideBytes,
+			      ThreadPool* pool) {
+  static const MapRowFcn mapRow = selectMapRow();
+  prepare(width, height);
+  if (0 == strideBytes)
+    strideBytes = width * 2;
+  MapParams p;
+  p.splat = (m_splatSize) ? m_splatSize :
+    std::max(1, int(ceil(m_color.fx / m_color.width
+			 / (m_depth.fx / m_depth.width) - 1e-3f)));
+  p.offset[0] = m_offset[0];
+  p.offset[1] = m_offset[1];
+  p.offset[2] = m_offset[2];
+  p.shift = 0.5f - 0.5f * (p.splat - 1);
+  p.zScale = 1.0f / m_depth.depthScale;
+  p.width = width;
+  p.height = height;
+  const uint8_t* pSrc = reinterpret_cast<const uint8_t*>(pDepth);
+  auto run = [&](const std::function<void(uint, uint)>& fcn){
+    if (pool)
+      pool->parallelFor(0, height, fcn);
+    else
+      fcn(0, height);
+  };
+
+  // Map every input pixel and note which output rows each input row hits.
+  run([&](uint v0, uint v1){
+      for (uint v=v0; v<v1; ++v) {
+	size_t offset = size_t(v) * width;
+	m_rowMin[v] = height;
+	m_rowMax[v] = -1;
+	mapRow(reinterpret_cast<const uint16_t*>(pSrc + v * strideBytes),
+	       &m_tableX[offset], &m_tableY[offset], &m_tableZ[offset], p,
+	       &m_targets[offset], width, m_rowMin[v], m_rowMax[v]);
+      }
+    });
+
+  // Splat into the output rows of the band, scanning the input rows which
+  // hit them. Registration shifts rows by a few pixels only, so a band
+  // reads little more than its own input rows. Empty pixels are 0, which
+  // the comparison of depth - 1 treats as the farthest depth.
+  run([&](uint y0, uint y1){
+      memset(pDst + size_t(y0) * width, 0, size_t(y1 - y0) * width * 2);
+      for (uint v=0; v<height; ++v) {
+	if (m_rowMax[v] < int(y0) || int(y1) <= m_rowMin[v])
+	  continue;
+	const RegistrationTarget* pTarget = &m_targets[size_t(v) * width];
+	if (1 == p.splat) {
+	  for (uint u=0; u<width; ++u) {
+	    const RegistrationTarget& target = pTarget[u];
+	    if (0 == target.depth || target.y < int(y0) ||
+		int(y1) <= target.y || target.x < 0)
+	      continue;
+	    uint16_t& out = pDst[size_t(target.y) * width + target.x];
+	    if (target.depth <= uint16_t(out - 1))
+	      out = target.depth;
+	  }
+	  continue;
+	}
+	for (uint u=0; u<width; ++u) {
+	  const RegistrationTarget& target = pTarget[u];
+	  if (0 == target.depth)
+	    continue;
+	  int yEnd = std::min(int(y1), target.y + p.splat);
+	  int xEnd = std::min(int(width), target.x + p.splat);
+	  for (int y=std::max(int(y0), int(target.y)); y<yEnd; ++y) {
+	    uint16_t* pOut = pDst + size_t(y) * width;
+	    for (int x=std::max(0, int(target.x)); x<xEnd; ++x) {
+	      if (target.depth <= uint16_t(pOut[x] - 1))
+		pOut[x] = target.depth;
+	    }
+	  }
+	}
+      }
+    });
+}
+
+void DepthRegistration::apply(const FrameView& depth, uint16_t* pDst,
+			      ThreadPool* pool) {
+  if (2 != depth.getBPP())
+    throw RuntimeError(__func__, ": Depth frame has ", depth.getBPP(),
+		       " byte per pixel.");
+  apply(static_cast<const uint16_t*>(depth.getData()), pDst,
+	depth.getWidth(), depth.getHeight(), depth.getStrideInBytes(), pool);
+}
+
+void DepthRegistration::apply(RGBDFrames& frames, ThreadPool* pool) {
+  const uint width = frames.getDepthWidth(), height = frames.getDepthHeight();
+  std::vector<uint16_t> registered(size_t(width) * height);
+  for (uint i=0; i<frames.getNumFrames(); ++i) {
+    uint16_t* pDepth = frames.getDepthFrame(i);
+    apply(pDepth, registered.data(), width, height, 0, pool);
+    memcpy(pDepth, registered.data(), registered.size() * 2);
+  }
+}
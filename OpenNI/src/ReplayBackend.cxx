@@ -0,0 +1,235 @@
+#include "ReplayBackend.hpp"
+#include "NIDevice.hpp"
+#include "pngio.hpp"
+#include "TUMDataset.hpp"
+#include "io.hpp"
+
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <fstream>
+
+#include <sys/stat.h>
+
+using namespace openni;
+using namespace std::chrono;
+
+#define DEFAULT_PERIOD  33333 // Loop gap of single frame recordings [us]
+
+ReplayBackend::ReplayBackend(const DeviceURI& uri)
+  : ThreadedDeviceBackend()
+  , m_reader()
+  , m_sources()
+  , m_speed(uri.get("speed", 1.0))
+  , m_bLoop(0.0 != uri.get("loop", 1.0))
+{
+  if (m_speed < 0)
+    throw RuntimeError(__func__, ": Invalid speed ", m_speed, ".");
+
+  struct stat st;
+  if (0 != stat(uri.path.c_str(), &st))
+    throw RuntimeError(__func__, ": Failed to open ", uri.path, ". ",
+		       std::string(strerror(errno)));
+  if (S_ISDIR(st.st_mode))
+    openTUM(uri.path);
+  else
+    openRecording(uri.path);
+
+  if (m_sources.empty())
+    throw RuntimeError(__func__, ": No frames found in ", uri.path, ".");
+}
+
+ReplayBackend::~ReplayBackend() {
+  stopThread();
+}
+
+void ReplayBackend::openRecording(const std::string& path) {
+  m_reader.open(path.c_str());
+  for (uint i=0; i<m_reader.getNumStreams(); ++i) {
+    const StreamInfo& info = m_reader.getStreamInfo(i);
+    SensorType type = (SensorType) info.sensorType;
+    if (findSource(type) || 0 == m_reader.getNumFrames(i))
+      continue;
+    m_sources.push_back(Source{type, info, int(i), {}});
+  }
+}
+
+void ReplayBackend::openTUM(const std::string& directory) {
+  addTUMSource(directory, SENSOR_DEPTH, "depth.txt");
+  addTUMSource(directory, SENSOR_COLOR, "rgb.txt");
+}
+
+void ReplayBackend::addTUMSource(const std::string& directory,
+				 SensorType type, const char* list) {
+  const std::string path = directory + "/" + list;
+  if (!std::ifstream(path))
+    return;
+
+  // Lines of "timestamp filename", timestamp in seconds.
+  Source source{type, StreamInfo(), -1, {}};
+  for (const TUMEntry& entry : readTUMList(path)) {
+    if (entry.values.empty())
+      throw RuntimeError(__func__, ": No file name in ", list, " at ",
+			 entry.timestamp, ".");
+    source.files.emplace_back(uint64_t(llround(entry.timestamp * 1e6)),
+			      directory + "/" + entry.values[0]);
+  }
+  if (source.files.empty())
+    return;
+
+  std::vector<uint8_t> data;
+  uint width, height, BPP;
+  readPNG(source.files[0].second.c_str(), data, width, height, BPP);
+  const uint expected = (SENSOR_DEPTH == type) ? 2 : 3;
+  if (expected != BPP)
+    throw RuntimeError(__func__, ": ", source.files[0].second, " has ", BPP,
+		       " byte per pixel. ", expected, " expected.");
+
+  StreamInfo& info = source.info;
+  info.sensorType = type;
+  info.pixelFormat = (SENSOR_DEPTH == type) ?
+    PIXEL_FORMAT_DEPTH_1_MM : PIXEL_FORMAT_RGB888;
+  info.width = width;
+  info.height = height;
+  info.BPP = BPP;
+  info.minValue = 0;
+  info.maxValue = (SENSOR_DEPTH == type) ? 10000 : 255;
+  info.codec = CODEC_RAW;
+  m_sources.push_back(source);
+}
+
+const ReplayBackend::Source* ReplayBackend::findSource(SensorType type) const {
+  for (const Source& source : m_sources) {
+    if (type == source.type)
+      return &source;
+  }
+  return NULL;
+}
+
+uint64_t ReplayBackend::getNumFrames(const Source& source) const {
+  if (0 <= source.stream)
+    return m_reader.getNumFrames(source.stream);
+  return source.files.size();
+}
+
+uint64_t ReplayBackend::getTimestamp(const Source& source,
+				     uint64_t iFrame) const {
+  if (0 <= source.stream)
+    return m_reader.getChunkHeader(source.stream, iFrame).timestamp;
+  return source.files[iFrame].first;
+}
+
+FrameView ReplayBackend::readFrame(const Source& source,
+				   uint64_t iFrame) const {
+  if (0 <= source.stream)
+    return m_reader.getFrameView(source.stream, iFrame);
+
+  const std::string& path = source.files[iFrame].second;
+  std::shared_ptr<std::vector<uint8_t> > pBuffer =
+    std::make_shared<std::vector<uint8_t> >();
+  uint width, height, BPP;
+  readPNG(path.c_str(), *pBuffer, width, height, BPP);
+  const StreamInfo& info = source.info;
+  if (width != info.width || height != info.height || BPP != info.BPP)
+    throw RuntimeError(__func__, ": ", path, " has a different size (",
+		       width, "x", height, "x", BPP, ") than the first frame.");
+  if (SENSOR_DEPTH == source.type) {
+    uint16_t* pDepth = (uint16_t*) pBuffer->data();
+    for (size_t i=0, n=size_t(width)*height; i<n; ++i)
+      pDepth[i] = (pDepth[i] + TUM_DEPTH_SCALE / 2) / TUM_DEPTH_SCALE;
+  }
+  return FrameView(pBuffer, pBuffer->data(), width, height, width * BPP, BPP,
+		   source.files[iFrame].first, int(iFrame));
+}
+
+bool ReplayBackend::hasSensor(SensorType type) {
+  return NULL != findSource(type);
+}
+
+void ReplayBackend::printSensorModes(SensorType type) {
+  const Source* source = findSource(type);
+  if (!source)
+    return;
+  uint64_t nFrames = getNumFrames(*source);
+  uint64_t duration = getTimestamp(*source, nFrames-1) - getTimestamp(*source, 0);
+  int fps = (0 < duration) ? int(llround((nFrames - 1) * 1e6 / duration)) : 0;
+  printf("  %2d, W:%5d, H:%5d, FPS:%3d, %s\n\n", 0, source->info.width,
+	 source->info.height, fps,
+	 getPixelFormatString((PixelFormat) source->info.pixelFormat));
+}
+
+std::unique_ptr<StreamBackend>
+ReplayBackend::createStream(SensorType type, int mode, bool mirroring) {
+  const Source* source = findSource(type);
+  if (!source)
+    throw RuntimeError(__func__, ": ",
+		       "No sensor for ", getSensorTypeString(type), " found.");
+  if (0 != mode)
+    throw RuntimeError(__func__, ":", getSensorTypeString(type), ": ",
+		       "Invalid video mode (", mode, "). Value range [0, 1).");
+  if (mirroring)
+    throw RuntimeError(__func__, ": Mirroring is not supported.");
+  const StreamInfo& info = source->info;
+  return createThreadedStream(type, info.width, info.height,
+			      (PixelFormat) info.pixelFormat,
+			      info.minValue, info.maxValue);
+}
+
+void ReplayBackend::run() {
+  // Merge the streams by timestamp. Each loop continues the timestamps one
+  // mean frame period after the end of the previous one.
+  const uint nSources = m_sources.size();
+  uint64_t first = std::numeric_limits<uint64_t>::max();
+  uint64_t last = 0, nMax = 0;
+  for (const Source& source : m_sources) {
+    uint64_t nFrames = getNumFrames(source);
+    first = std::min(first, getTimestamp(source, 0));
+    last = std::max(last, getTimestamp(source, nFrames-1));
+    nMax = std::max(nMax, nFrames);
+  }
+  const uint64_t period = (1 < nMax) ? (last - first) / (nMax - 1) : DEFAULT_PERIOD;
+
+  std::vector<uint64_t> next(nSources, 0);
+  uint64_t offset = 0; // Added to the recorded timestamps [us]
+  const steady_clock::time_point start = steady_clock::now();
+  while (!isStopping()) {
+    int iSource = -1;
+    uint64_t timestamp = std::numeric_limits<uint64_t>::max();
+    for (uint i=0; i<nSources; ++i) {
+      if (next[i] < getNumFrames(m_sources[i]) &&
+	  getTimestamp(m_sources[i], next[i]) < timestamp) {
+	iSource = i;
+	timestamp = getTimestamp(m_sources[i], next[i]);
+      }
+    }
+    if (iSource < 0) {
+      if (!m_bLoop)
+	break;
+      offset += last - first + period;
+      std::fill(next.begin(), next.end(), 0);
+      continue;
+    }
+
+    const Source& source = m_sources[iSource];
+    const uint64_t iFrame = next[iSource]++;
+    const uint64_t time = timestamp - first + offset;
+    if (0 < m_speed) {
+      duration<double> elapsed(1e-6 * time / m_speed);
+      if (!sleepUntil(start + duration_cast<steady_clock::duration>(elapsed)))
+	break;
+    }
+    if (!isStreamStarted(source.type))
+      continue;
+
+    // Wrap the view to continue the timestamps across loops.
+    std::shared_ptr<FrameView> pFrame =
+      std::make_shared<FrameView>(readFrame(source, iFrame));
+    deliver(source.type, FrameView(pFrame, pFrame->getData(),
+				   pFrame->getWidth(), pFrame->getHeight(),
+				   pFrame->getStrideInBytes(), pFrame->getBPP(),
+				   time, pFrame->getFrameIndex()));
+  }
+}
@@ -0,0 +1,155 @@
+#include "StreamStats.hpp"
+#include "io.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+
+const char* getLatencyStageString(const LatencyStage stage) {
+  switch (stage) {
+  case STAGE_DRIVER:
+    return "driver->callback";
+  case STAGE_CONSUME:
+    return "callback->consume";
+  case STAGE_CONVERT:
+    return "consume->convert";
+  case STAGE_PRESENT:
+    return "convert->present";
+  default:
+    return "Unknown stage";
+  }
+}
+
+StreamStats::StreamStats()
+  : m_latencies()
+  , m_nArrived(0)
+  , m_nConsumed(0)
+  , m_nDropped(0)
+{}
+
+void StreamStats::reset() {
+  for (auto& latency : m_latencies)
+    latency.reset();
+  m_nArrived = 0;
+  m_nConsumed = 0;
+  m_nDropped = 0;
+}
+
+void StreamStats::recordArrival(const FrameView& frame, uint64_t captured) {
+  ++m_nArrived;
+  record(STAGE_DRIVER, captured, frame.getHostTimestamp());
+}
+
+void StreamStats::recordConsume(const FrameView& frame,
+				uint64_t lastSequence) {
+  ++m_nConsumed;
+  if (lastSequence + 1 < frame.getSequenceNumber())
+    m_nDropped += frame.getSequenceNumber() - lastSequence - 1;
+  record(STAGE_CONSUME, frame.getHostTimestamp(),
+	 getSteadyTimestamp().count());
+}
+
+void StreamStats::record(const LatencyStage stage, uint64_t latency) {
+  m_latencies[stage].record(latency);
+}
+
+void StreamStats::record(const LatencyStage stage, uint64_t begin,
+			 uint64_t end) {
+  record(stage, (begin < end) ? end - begin : 0);
+}
+
+const LatencyHistogram& StreamStats::getLatency(const LatencyStage stage)
+  const {
+  return m_latencies[stage];
+}
+
+uint64_t StreamStats::getNumArrived() const {
+  return m_nArrived;
+}
+
+uint64_t StreamStats::getNumConsumed() const {
+  return m_nConsumed;
+}
+
+uint64_t StreamStats::getNumDropped() const {
+  return m_nDropped;
+}
+
+double StreamStats::getDropRate() const {
+  uint64_t nArrived = getNumArrived();
+  return (nArrived) ? double(getNumDropped()) / nArrived : 0.0;
+}
+
+void StreamStats::print(const char* name) const {
+  printf("%s: arrived %llu, consumed %llu, dropped %llu (%.1f%%)\n", name,
+	 (unsigned long long)getNumArrived(),
+	 (unsigned long long)getNumConsumed(),
+	 (unsigned long long)getNumDropped(), 100.0 * getDropRate());
+  for (int i=0; i<N_LATENCY_STAGES; ++i) {
+    const LatencyHistogram& latency = m_latencies[i];
+    if (0 == latency.getCount())
+      continue;
+    printf("  %-18s: p50 %8.3f ms, p99 %8.3f ms, max %8.3f ms\n",
+	   getLatencyStageString(LatencyStage(i)),
+	   latency.getPercentile(50) * 1e-3, latency.getPercentile(99) * 1e-3,
+	   latency.getMax() * 1e-3);
+  }
+}
+
+std::string StreamStats::getSummary(const char* name) const {
+  std::string summary = std::string(name) + " p99";
+  char value[32];
+  for (int i=0; i<N_LATENCY_STAGES; ++i) {
+    const LatencyHistogram& latency = m_latencies[i];
+    if (0 == latency.getCount())
+      continue;
+    snprintf(value, sizeof(value), " %.1f", latency.getPercentile(99) * 1e-3);
+    summary += value;
+  }
+  snprintf(value, sizeof(value), " ms, drop %.1f%%", 100.0 * getDropRate());
+  return summary + value;
+}
+
+SkewStats::SkewStats()
+  : m_magnitude()
+  , m_sum(0)
+{}
+
+void SkewStats::reset() {
+  m_magnitude.reset();
+  m_sum = 0;
+}
+
+void SkewStats::record(int64_t skew) {
+  m_sum += skew;
+  m_magnitude.record(uint64_t(llabs(skew)));
+}
+
+uint64_t SkewStats::getCount() const {
+  return m_magnitude.getCount();
+}
+
+double SkewStats::getMean() const {
+  uint64_t count = getCount();
+  return (count) ? double(m_sum.load()) / count : 0.0;
+}
+
+const LatencyHistogram& SkewStats::getMagnitude() const {
+  return m_magnitude;
+}
+
+void SkewStats::print(const char* name) const {
+  printf("%s: %llu pairs, mean %+.3f ms\n", name,
+	 (unsigned long long)getCount(), getMean() * 1e-3);
+  if (0 == getCount())
+    return;
+  printf("  %-18s: p50 %8.3f ms, p99 %8.3f ms, max %8.3f ms\n", "|skew|",
+	 m_magnitude.getPercentile(50) * 1e-3,
+	 m_magnitude.getPercentile(99) * 1e-3, m_magnitude.getMax() * 1e-3);
+}
+
+std::string SkewStats::getSummary(const char* name) const {
+  char summary[64];
+  snprintf(summary, sizeof(summary), "%s p99 %.1f ms", name,
+	   m_magnitude.getPercentile(99) * 1e-3);
+  return summary;
+}
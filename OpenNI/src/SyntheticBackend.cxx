@@ -0,0 +1,196 @@
+#include "SyntheticBackend.hpp"
+#include "NIDevice.hpp"
+#include "io.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace openni;
+using namespace std::chrono;
+
+// Scene in pixel and mm
+#define BALL_DEPTH   1200 // Depth of the front of the ball [mm]
+#define BALL_SIZE    300  // Depth of the ball [mm]
+#define WALL_DEPTH   2500 // Depth of the wall at the image center [mm]
+#define IR_INTENSITY 1.44e9 // IR value times squared depth [mm^2]
+
+namespace {
+  // Where each pixel is: in the invalid border, on the ball, in the
+  // shadow of the ball or on the wall.
+  enum Surface { BORDER, BALL, SHADOW, WALL };
+
+  struct Scene {
+    int width, height, border, shadow, radius;
+    double cx, cy;
+
+    Scene(uint w, uint h, uint64_t iFrame, double fps)
+      : width(w)
+      , height(h)
+      , border(w / 80)
+      , shadow(w / 64)
+      , radius(h / 6)
+      , cx(w / 2 + 0.3 * w * sin(iFrame / fps))
+      , cy(h / 2)
+    {};
+
+    Surface hit(int x, int y, double& dz) const {
+      if (x < border)
+	return BORDER;
+      double dx = x - cx, dy = y - cy;
+      double r2 = double(radius) * radius;
+      double d2 = dx * dx + dy * dy;
+      if (d2 < r2) {
+	dz = sqrt(1.0 - d2 / r2);
+	return BALL;
+      }
+      if ((dx + shadow) * (dx + shadow) + dy * dy < r2)
+	return SHADOW;
+      return WALL;
+    };
+
+    double wallDepth(int x, int y) const {
+      return WALL_DEPTH + (2.0 * (y - height / 2) * 480 +
+			   1.0 * (x - width / 2) * 640) / height;
+    };
+
+    double depth(int x, int y, Surface surface, double dz) const {
+      if (BALL == surface)
+	return BALL_DEPTH + BALL_SIZE * (1.0 - dz);
+      if (WALL == surface)
+	return wallDepth(x, y);
+      return 0.0;
+    };
+  };
+}
+
+SyntheticBackend::SyntheticBackend(const DeviceURI& uri)
+  : ThreadedDeviceBackend()
+  , m_width(DEFAULT_SYNTHETIC_WIDTH)
+  , m_height(DEFAULT_SYNTHETIC_HEIGHT)
+  , m_fps(DEFAULT_SYNTHETIC_FPS)
+  , m_buffers()
+{
+  if (!uri.path.empty()) {
+    if (3 != sscanf(uri.path.c_str(), "%ux%u@%lf", &m_width, &m_height, &m_fps))
+      throw RuntimeError(__func__, ": Invalid mode ", uri.path,
+			 ". (expected WIDTHxHEIGHT@FPS)");
+  }
+  if (0 == m_width || 0 == m_height || m_fps < 0)
+    throw RuntimeError(__func__, ": Invalid mode ", uri.path, ".");
+}
+
+SyntheticBackend::~SyntheticBackend() {
+  stopThread();
+}
+
+bool SyntheticBackend::hasSensor(SensorType type) {
+  return true;
+}
+
+void SyntheticBackend::printSensorModes(SensorType type) {
+  PixelFormat format = (SENSOR_DEPTH == type) ? PIXEL_FORMAT_DEPTH_1_MM :
+    (SENSOR_COLOR == type) ? PIXEL_FORMAT_RGB888 : PIXEL_FORMAT_GRAY16;
+  printf("  %2d, W:%5d, H:%5d, FPS:%3d, %s\n\n", 0, m_width, m_height,
+	 int(m_fps), getPixelFormatString(format));
+}
+
+std::unique_ptr<StreamBackend>
+SyntheticBackend::createStream(SensorType type, int mode, bool mirroring) {
+  if (0 != mode)
+    throw RuntimeError(__func__, ":", getSensorTypeString(type), ": ",
+		       "Invalid video mode (", mode, "). Value range [0, 1).");
+  if (mirroring)
+    throw RuntimeError(__func__, ": Mirroring is not supported.");
+  switch (type) {
+  case SENSOR_DEPTH:
+    return createThreadedStream(type, m_width, m_height,
+				PIXEL_FORMAT_DEPTH_1_MM, 0, 10000);
+  case SENSOR_COLOR:
+    return createThreadedStream(type, m_width, m_height,
+				PIXEL_FORMAT_RGB888, 0, 255);
+  default:
+    return createThreadedStream(type, m_width, m_height,
+				PIXEL_FORMAT_GRAY16, 0, 1023);
+  }
+}
+
+void SyntheticBackend::renderDepth(uint16_t* pDst, uint64_t iFrame) const {
+  Scene scene(m_width, m_height, iFrame, m_fps ? m_fps : DEFAULT_SYNTHETIC_FPS);
+  for (int y=0; y<scene.height; ++y) {
+    for (int x=0; x<scene.width; ++x, ++pDst) {
+      double dz = 0.0;
+      Surface surface = scene.hit(x, y, dz);
+      *pDst = uint16_t(scene.depth(x, y, surface, dz));
+    }
+  }
+}
+
+void SyntheticBackend::renderColor(uint8_t* pDst, uint64_t iFrame) const {
+  Scene scene(m_width, m_height, iFrame, m_fps ? m_fps : DEFAULT_SYNTHETIC_FPS);
+  for (int y=0; y<scene.height; ++y) {
+    for (int x=0; x<scene.width; ++x, pDst+=3) {
+      double dz = 0.0;
+      switch (scene.hit(x, y, dz)) {
+      case BALL:
+	pDst[0] = uint8_t(80 + 175 * dz);
+	pDst[1] = pDst[2] = uint8_t(40 * dz);
+	break;
+      default:
+	pDst[0] = uint8_t(255 * x / scene.width);
+	pDst[1] = uint8_t(255 * y / scene.height);
+	pDst[2] = 128;
+      }
+    }
+  }
+}
+
+void SyntheticBackend::renderIR(uint16_t* pDst, uint64_t iFrame) const {
+  Scene scene(m_width, m_height, iFrame, m_fps ? m_fps : DEFAULT_SYNTHETIC_FPS);
+  for (int y=0; y<scene.height; ++y) {
+    for (int x=0; x<scene.width; ++x, ++pDst) {
+      double dz = 0.0;
+      Surface surface = scene.hit(x, y, dz);
+      double z = (BALL == surface) ? scene.depth(x, y, surface, dz) :
+	scene.wallDepth(x, y);
+      *pDst = uint16_t(std::min(1023.0, IR_INTENSITY / (z * z)));
+    }
+  }
+}
+
+void SyntheticBackend::run() {
+  const steady_clock::time_point start = steady_clock::now();
+  for (uint64_t iFrame=0; !isStopping(); ++iFrame) {
+    uint64_t timestamp;
+    if (0 < m_fps) {
+      duration<double> elapsed(iFrame / m_fps);
+      if (!sleepUntil(start + duration_cast<steady_clock::duration>(elapsed)))
+	break;
+      timestamp = uint64_t(1e6 * elapsed.count());
+    } else {
+      timestamp = duration_cast<microseconds>(steady_clock::now() - start)
+	.count();
+    }
+    const size_t nPixels = size_t(m_width) * m_height;
+    if (isStreamStarted(SENSOR_DEPTH)) {
+      auto pBuffer = m_buffers[SENSOR_DEPTH-1].get(nPixels * 2);
+      renderDepth((uint16_t*) pBuffer->data(), iFrame);
+      deliver(SENSOR_DEPTH, FrameView(pBuffer, pBuffer->data(), m_width,
+				      m_height, m_width * 2, 2, timestamp,
+				      iFrame));
+    }
+    if (isStreamStarted(SENSOR_COLOR)) {
+      auto pBuffer = m_buffers[SENSOR_COLOR-1].get(nPixels * 3);
+      renderColor(pBuffer->data(), iFrame);
+      deliver(SENSOR_COLOR, FrameView(pBuffer, pBuffer->data(), m_width,
+				      m_height, m_width * 3, 3, timestamp,
+				      iFrame));
+    }
+    if (isStreamStarted(SENSOR_IR)) {
+      auto pBuffer = m_buffers[SENSOR_IR-1].get(nPixels * 2);
+      renderIR((uint16_t*) pBuffer->data(), iFrame);
+      deliver(SENSOR_IR, FrameView(pBuffer, pBuffer->data(), m_width,
+				   m_height, m_width * 2, 2, timestamp,
+				   iFrame));
+    }
+  }
+}
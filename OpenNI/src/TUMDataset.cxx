@@ -0,0 +1,177 @@
+#include "TUMDataset.hpp"
+#include "StreamAssociator.hpp"
+#include "io.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+// Parse a line of a TUM list. Return false for lines without an entry.
+static bool parseTUMLine(std::string& line, TUMEntry& entry,
+			 const std::string& path) {
+  std::replace(line.begin(), line.end(), ',', ' ');
+  std::replace(line.begin(), line.end(), '\t', ' ');
+  std::istringstream fields(line);
+  std::string value;
+  if (!(fields >> value) || '#' == value[0])
+    return false;
+  char* end = NULL;
+  entry.timestamp = strtod(value.c_str(), &end);
+  if (*end)
+    throw RuntimeError(__func__, ": Invalid line in ", path, ": ", line);
+  entry.values.clear();
+  while (fields >> value)
+    entry.values.push_back(value);
+  return true;
+}
+
+std::vector<TUMEntry> readTUMList(const std::string& path) {
+  std::ifstream file(path);
+  if (!file)
+    throw RuntimeError(__func__, ": Failed to open ", path, ".");
+  std::vector<TUMEntry> entries;
+  std::string line;
+  TUMEntry entry;
+  while (std::getline(file, line))
+    if (parseTUMLine(line, entry, path))
+      entries.push_back(entry);
+  std::stable_sort(entries.begin(), entries.end(),
+		   [](const TUMEntry& a, const TUMEntry& b){
+		     return a.timestamp < b.timestamp;
+		   });
+  return entries;
+}
+
+TUMListReader::TUMListReader()
+  : m_path()
+  , m_file()
+  , m_last(0.0)
+  , m_bStarted(false)
+{}
+
+void TUMListReader::open(const std::string& path) {
+  close();
+  m_file.open(path);
+  if (!m_file)
+    throw RuntimeError(__func__, ": Failed to open ", path, ".");
+  m_path = path;
+}
+
+bool TUMListReader::isOpen() const {
+  return m_file.is_open();
+}
+
+void TUMListReader::close() {
+  if (m_file.is_open())
+    m_file.close();
+  m_file.clear();
+  m_bStarted = false;
+}
+
+bool TUMListReader::read(TUMEntry& entry) {
+  std::string line;
+  while (std::getline(m_file, line)) {
+    if (!parseTUMLine(line, entry, m_path))
+      continue;
+    if (m_bStarted && entry.timestamp < m_last)
+      throw RuntimeError(__func__, ": ", m_path, " is not sorted at ",
+			 entry.timestamp, ".");
+    m_last = entry.timestamp;
+    m_bStarted = true;
+    return true;
+  }
+  return false;
+}
+
+// TUM timestamp in [us] for StreamAssociator.
+static uint64_t toMicroseconds(const double timestamp) {
+  return uint64_t(llround(std::max(timestamp, 0.0) * 1e6));
+}
+
+std::vector<TUMAssociation>
+associateTUMLists(const std::vector<TUMEntry>& base,
+		  const std::vector<std::vector<TUMEntry> >& lists,
+		  const double maxDiff) {
+  // Lists are sorted, so the association never needs to give up waiting.
+  StreamAssociator<uint> associator(lists.size() + 1,
+				    toMicroseconds(maxDiff), 0);
+  std::vector<size_t> next(lists.size() + 1, 0);
+  std::vector<TUMAssociation> associations;
+  StreamAssociator<uint>::Tuple tuple;
+  // Push the earliest entry first, so only undecided entries are kept.
+  for (;;) {
+    int stream = -1;
+    double earliest = 0.0;
+    for (uint i=0; i<next.size(); ++i) {
+      const std::vector<TUMEntry>& list = 0 == i ? base : lists[i - 1];
+      if (next[i] < list.size() &&
+	  (stream < 0 || list[next[i]].timestamp < earliest)) {
+	stream = int(i);
+	earliest = list[next[i]].timestamp;
+      }
+    }
+    if (stream < 0) {
+      associator.flush();
+    } else {
+      const std::vector<TUMEntry>& list = 0 == stream ? base : lists[stream - 1];
+      associator.push(uint(stream), toMicroseconds(earliest),
+		      uint(next[stream]++));
+      if (list.size() == next[stream])
+	associator.end(uint(stream));
+    }
+    while (associator.pop(tuple)) {
+      TUMAssociation association{tuple[0].value, {}};
+      for (uint i=1; i<tuple.size(); ++i)
+	association.matches.push_back(tuple[i].value);
+      associations.push_back(association);
+    }
+    if (stream < 0)
+      return associations;
+  }
+}
+
+size_t associateTUMFiles(const std::string& basePath,
+			 const std::vector<std::string>& listPaths,
+			 std::function<void(const std::vector<TUMEntry>&)> fcn,
+			 const double maxDiff) {
+  const uint nStreams = listPaths.size() + 1;
+  std::vector<TUMListReader> readers(nStreams);
+  std::vector<TUMEntry> heads(nStreams);
+  std::vector<bool> bHeads(nStreams);
+  StreamAssociator<TUMEntry> associator(nStreams, toMicroseconds(maxDiff), 0);
+  for (uint i=0; i<nStreams; ++i) {
+    readers[i].open(0 == i ? basePath : listPaths[i - 1]);
+    bHeads[i] = readers[i].read(heads[i]);
+    if (!bHeads[i])
+      associator.end(i);
+  }
+  StreamAssociator<TUMEntry>::Tuple tuple;
+  std::vector<TUMEntry> entries(nStreams);
+  size_t nAssociations = 0;
+  for (;;) {
+    int stream = -1;
+    for (uint i=0; i<nStreams; ++i)
+      if (bHeads[i] &&
+	  (stream < 0 || heads[i].timestamp < heads[stream].timestamp))
+	stream = int(i);
+    if (stream < 0) {
+      associator.flush();
+    } else {
+      associator.push(uint(stream), toMicroseconds(heads[stream].timestamp),
+		      heads[stream]);
+      bHeads[stream] = readers[stream].read(heads[stream]);
+      if (!bHeads[stream])
+	associator.end(uint(stream));
+    }
+    while (associator.pop(tuple)) {
+      for (uint i=0; i<nStreams; ++i)
+	entries[i] = std::move(tuple[i].value);
+      fcn(entries);
+      ++nAssociations;
+    }
+    if (stream < 0)
+      return nAssociations;
+  }
+}
@@ -0,0 +1,245 @@
+#include "TemporalFilter.hpp"
+#include "io.hpp"
+#include "FrameView.hpp"
+#include "ThreadPool.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Number of set bits of each nibble.
+static const uint8_t nibbleBits[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+				       1, 2, 2, 3, 2, 3, 3, 4};
+
+// Parameters of the row kernels, in the fixed point of the average.
+struct FilterParams {
+  int32_t weight;     // alpha * 256
+  int32_t delta;      // [mm / 16]
+  uint8_t windowMask; // History bits of the hole window
+  uint8_t minValid;
+};
+
+static inline uint countBits(uint8_t bits) {
+  return nibbleBits[bits & 0x0f] + nibbleBits[bits >> 4];
+}
+
+// Filter n pixels. The average restarts at the depth if the pixel has no
+// valid frame in its history or moved by more than delta. The kernels must
+// give identical results.
+static void filterRowScalar(const uint16_t* pSrc, uint16_t* pDst,
+			    int32_t* pAverage, uint8_t* pHistory, uint n,
+			    const FilterParams& p) {
+  for (uint i=0; i<n; ++i) {
+    const int32_t depth = pSrc[i];
+    const uint8_t last = pHistory[i];
+    int32_t average = pAverage[i];
+    uint8_t history = uint8_t(last << 1);
+    if (depth) {
+      const int32_t diff = (depth << 4) - average;
+      if (0 == last || p.delta < std::abs(diff))
+	average = depth << 4;
+      else
+	average += (diff * p.weight + 128) >> 8;
+      pAverage[i] = average;
+      history |= 1;
+    }
+    pHistory[i] = history;
+    const bool bFill =
+      depth || countBits(history & p.windowMask) >= p.minValid;
+    pDst[i] = (bFill) ? uint16_t((average + 8) >> 4) : 0;
+  }
+}
+
+#ifdef SIMD_X86
+// 8 pixels per iteration: depth and average in 32 bit lanes, the history in
+// bytes, whose bits are counted with a nibble lookup.
+__attribute__((target("avx2")))
+static void filterRowAVX2(const uint16_t* pSrc, uint16_t* pDst,
+			  int32_t* pAverage, uint8_t* pHistory, uint n,
+			  const FilterParams& p) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i weight = _mm256_set1_epi32(p.weight);
+  const __m256i delta = _mm256_set1_epi32(p.delta);
+  const __m256i round8 = _mm256_set1_epi32(128);
+  const __m256i round4 = _mm256_set1_epi32(8);
+  const __m128i windowMask = _mm_set1_epi8(char(p.windowMask));
+  const __m128i minCount = _mm_set1_epi8(char(p.minValid - 1));
+  const __m128i nibbles = _mm_loadu_si128((const __m128i*)nibbleBits);
+  const __m128i low4 = _mm_set1_epi8(0x0f);
+  const __m128i one = _mm_set1_epi8(1);
+  uint i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i depth =
+      _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(pSrc + i)));
+    __m256i average = _mm256_loadu_si256((const __m256i*)(pAverage + i));
+    __m128i last = _mm_loadl_epi64((const __m128i*)(pHistory + i));
+    __m256i valid = _mm256_cmpgt_epi32(depth, zero);
+
+    __m256i depth4 = _mm256_slli_epi32(depth, 4);
+    __m256i diff = _mm256_sub_epi32(depth4, average);
+    __m256i restart =
+      _mm256_or_si256(_mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(last), zero),
+		      _mm256_cmpgt_epi32(_mm256_abs_epi32(diff), delta));
+    __m256i step = _mm256_srai_epi32(_mm256_add_epi32(
+	_mm256_mullo_epi32(diff, weight), round8), 8);
+    __m256i next = _mm256_blendv_epi8(_mm256_add_epi32(average, step),
+				      depth4, restart);
+    average = _mm256_blendv_epi8(average, next, valid);
+    _mm256_storeu_si256((__m256i*)(pAverage + i), average);
+
+    // Validity as 0xff / 0 bytes, in pixel order
+    __m128i valid8 = _mm_packs_epi16(
+	_mm_packs_epi32(_mm256_castsi256_si128(valid),
+			_mm256_extracti128_si256(valid, 1)),
+	_mm_setzero_si128());
+    __m128i history = _mm_or_si128(_mm_add_epi8(last, last),
+				   _mm_and_si128(valid8, one));
+    _mm_storel_epi64((__m128i*)(pHistory + i), history);
+
+    __m128i window = _mm_and_si128(history, windowMask);
+    __m128i count = _mm_add_epi8(
+	_mm_shuffle_epi8(nibbles, _mm_and_si128(window, low4)),
+	_mm_shuffle_epi8(nibbles, _mm_and_si128(_mm_srli_epi16(window, 4),
+						low4)));
+    __m256i fill = _mm256_or_si256(
+	valid, _mm256_cvtepi8_epi32(_mm_cmpgt_epi8(count, minCount)));
+    __m256i out = _mm256_and_si256(
+	_mm256_srai_epi32(_mm256_add_epi32(average, round4), 4), fill);
+    _mm_storeu_si128((__m128i*)(pDst + i),
+		     _mm_packus_epi32(_mm256_castsi256_si128(out),
+				      _mm256_extracti128_si256(out, 1)));
+  }
+  filterRowScalar(pSrc + i, pDst + i, pAverage + i, pHistory + i, n - i, p);
+}
+#endif
+
+typedef void (*FilterRowFcn)(const uint16_t*, uint16_t*, int32_t*, uint8_t*,
+			     uint, const FilterParams&);
+
+static FilterRowFcn selectFilterRow() {
+#ifdef SIMD_X86
+  if (SIMD_AVX2 == getSIMDLevel())
+    return filterRowAVX2;
+#endif
+  return filterRowScalar;
+}
+
+DepthTemporalFilter::DepthTemporalFilter(float alpha, uint delta,
+					 uint window, uint minValid)
+  : m_alpha(DEFAULT_TEMPORAL_ALPHA)
+  , m_delta(DEFAULT_TEMPORAL_DELTA)
+  , m_window(DEFAULT_HOLE_WINDOW)
+  , m_minValid(DEFAULT_HOLE_MIN_VALID)
+  , m_width(0)
+  , m_height(0)
+  , m_average()
+  , m_history()
+{
+  setParameters(alpha, delta, window, minValid);
+}
+
+void DepthTemporalFilter::setParameters(float alpha, uint delta,
+					uint window, uint minValid) {
+  if (!(0.0f < alpha && alpha <= 1.0f))
+    throw RuntimeError(__func__, ": Alpha ", alpha, " is out of (0, 1].");
+  if (delta > 0xffff)
+    throw RuntimeError(__func__, ": Delta ", delta, " is out of [0, 65535].");
+  if (window < 1 || TEMPORAL_HISTORY_SIZE < window)
+    throw RuntimeError(__func__, ": Hole window ", window, " is out of [1, ",
+		       TEMPORAL_HISTORY_SIZE, "].");
+  if (minValid < 1 || window < minValid)
+    throw RuntimeError(__func__, ": Minimum of valid frames ", minValid,
+		       " is out of [1, ", window, "].");
+  m_alpha = alpha;
+  m_delta = delta;
+  m_window = window;
+  m_minValid = minValid;
+}
+
+float DepthTemporalFilter::getAlpha() const {
+  return m_alpha;
+}
+
+uint DepthTemporalFilter::getDelta() const {
+  return m_delta;
+}
+
+uint DepthTemporalFilter::getHoleWindow() const {
+  return m_window;
+}
+
+uint DepthTemporalFilter::getHoleMinValid() const {
+  return m_minValid;
+}
+
+void DepthTemporalFilter::reset() {
+  m_width = m_height = 0;
+  m_average.clear();
+  m_history.clear();
+}
+
+void DepthTemporalFilter::apply(const uint16_t* pDepth, uint16_t* pDst,
+				uint width, uint height, uint strideBytes,
+				ThreadPool* pool) {
+  if (width != m_width || height != m_height) {
+    m_width = width;
+    m_height = height;
+    m_average.assign(size_t(width) * height, 0);
+    m_history.assign(size_t(width) * height, 0);
+  }
+  const size_t srcRow = strideBytes ? strideBytes : size_t(width) * 2;
+  // In place, the output rows have the stride of the input
+  const size_t dstRow = (pDst == pDepth) ? srcRow : size_t(width) * 2;
+  FilterParams params;
+  params.weight = std::max(1, int32_t(std::lround(m_alpha * 256)));
+  params.delta = int32_t(m_delta) << 4;
+  params.windowMask = uint8_t((1u << m_window) - 1);
+  params.minValid = uint8_t(m_minValid);
+  const FilterRowFcn filterRow = selectFilterRow();
+  const uint8_t* pSrcBuff = reinterpret_cast<const uint8_t *>(pDepth);
+  uint8_t* pDstBuff = reinterpret_cast<uint8_t *>(pDst);
+  auto filterRows = [&](uint h0, uint h1){
+    for (uint h=h0; h<h1; ++h) {
+      const size_t offset = size_t(h) * width;
+      filterRow(reinterpret_cast<const uint16_t *>(pSrcBuff + h * srcRow),
+		reinterpret_cast<uint16_t *>(pDstBuff + h * dstRow),
+		&m_average[offset], &m_history[offset], width, params);
+    }
+  };
+  if (pool)
+    pool->parallelFor(0, height, filterRows);
+  else
+    filterRows(0, height);
+}
+
+void DepthTemporalFilter::apply(const FrameView& depth, uint16_t* pDst,
+				ThreadPool* pool) {
+  if (2 != depth.getBPP())
+    throw RuntimeError(__func__, ": Depth frame has ", depth.getBPP(),
+		       " byte per pixel.");
+  apply(static_cast<const uint16_t*>(depth.getData()), pDst,
+	depth.getWidth(), depth.getHeight(), depth.getStrideInBytes(), pool);
+}
+
+void DepthTemporalFilter::apply(RGBDFrames& frames, ThreadPool* pool) {
+  const uint width = frames.getDepthWidth(), height = frames.getDepthHeight();
+  for (uint i=0; i<frames.getNumFrames(); ++i) {
+    uint16_t* pDepth = frames.getDepthFrame(i);
+    apply(pDepth, pDepth, width, height, 0, pool);
+  }
+}
+
+void DepthTemporalFilter::getConfidence(uint8_t* pDst) const {
+  for (size_t i=0; i<m_history.size(); ++i)
+    pDst[i] = countBits(m_history[i]);
+}
+
+const std::vector<uint8_t>& DepthTemporalFilter::getHistory() const {
+  return m_history;
+}
@@ -0,0 +1,100 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(uint nThreads)
+  : m_workers()
+  , m_runMutex()
+  , m_mutex()
+  , m_taskCond()
+  , m_doneCond()
+  , m_task()
+  , m_begin(0)
+  , m_end(0)
+  , m_nBands(0)
+  , m_nextBand(0)
+  , m_nPending(0)
+  , m_bStop(false)
+  , m_error()
+{
+  if (0 == nThreads)
+    nThreads = std::thread::hardware_concurrency();
+  for (uint i=1; i<nThreads; ++i)
+    m_workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> _(m_mutex);
+    m_bStop = true;
+  }
+  m_taskCond.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+uint ThreadPool::getNumThreads() const {
+  return m_workers.size() + 1;
+}
+
+bool ThreadPool::runBand(std::unique_lock<std::mutex>& lock) {
+  if (m_nextBand >= m_nBands)
+    return false;
+  uint band = m_nextBand++;
+  uint n = m_end - m_begin;
+  uint bandBegin = m_begin + uint(uint64_t(n) * band / m_nBands);
+  uint bandEnd = m_begin + uint(uint64_t(n) * (band + 1) / m_nBands);
+  lock.unlock();
+  std::exception_ptr error;
+  try {
+    m_task(bandBegin, bandEnd);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  lock.lock();
+  if (error && !m_error)
+    m_error = error;
+  if (0 == --m_nPending)
+    m_doneCond.notify_all();
+  return true;
+}
+
+void ThreadPool::work() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (1) {
+    m_taskCond.wait(lock, [this](){
+	return m_bStop || m_nextBand < m_nBands;
+      });
+    if (m_bStop)
+      return;
+    runBand(lock);
+  }
+}
+
+void ThreadPool::parallelFor(uint begin, uint end,
+			     const std::function<void(uint, uint)>& fcn) {
+  if (end <= begin)
+    return;
+  uint nBands = getNumThreads();
+  if (nBands > end - begin)
+    nBands = end - begin;
+  if (1 == nBands) {
+    fcn(begin, end);
+    return;
+  }
+  std::lock_guard<std::mutex> _(m_runMutex);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_task = fcn;
+  m_begin = begin; m_end = end;
+  m_nBands = m_nPending = nBands;
+  m_nextBand = 0;
+  m_error = nullptr;
+  m_taskCond.notify_all();
+  while (runBand(lock)) {}
+  m_doneCond.wait(lock, [this](){ return 0 == m_nPending; });
+  m_nBands = m_nextBand = 0;
+  m_task = nullptr;
+  std::exception_ptr error = m_error;
+  m_error = nullptr;
+  lock.unlock();
+  if (error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,722 @@
+#include "io.hpp"
+#include "simd.hpp"
+#include "ThreadPool.hpp"
+#include "DepthCodec.hpp"
+#include "PointCloud.hpp"
+#include "Registration.hpp"
+#include "TemporalFilter.hpp"
+#include "LatencyHistogram.hpp"
+#include "FrameArena.hpp"
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/resource.h>
+
+#define DEFAULT_REPEAT    30
+#define DEFAULT_RING_SIZE 30 // Frames in the ring of the Frames benchmarks
+
+using namespace std::chrono;
+
+struct Resolution {
+  uint width, height;
+};
+
+const Resolution RESOLUTIONS[] = {{320, 240}, {640, 480}, {1280, 1024}};
+
+//!
+//! Timing of one kernel at one resolution and thread count.
+//! Times are per call in ns, bytes are read plus written per call.
+//!
+struct Result {
+  std::string kernel;
+  uint width, height, nThreads;
+  uint nRepeat;
+  double mean, stddev, min;
+  double bytes;
+
+  double getNsPerPixel() const { return mean / (double(width) * height); };
+  double getGBps() const { return bytes / mean; };
+};
+
+//!
+//! Collect results, print them as they come and write them as CSV or JSON
+//! at the end, so runs of different commits can be compared.
+//!
+class Report {
+  std::string m_label;
+  uint m_nRepeat;
+  std::vector<Result> m_results;
+
+public:
+  Report(const std::string& label, uint nRepeat)
+    : m_label(label)
+    , m_nRepeat(nRepeat)
+    , m_results()
+  {};
+
+  uint getNumRepeat() const { return m_nRepeat; };
+
+  void add(const std::string& kernel, uint width, uint height, uint nThreads,
+	   const std::vector<double>& samples, double bytes) {
+    Result r;
+    r.kernel = kernel;
+    r.width = width;
+    r.height = height;
+    r.nThreads = nThreads;
+    r.nRepeat = samples.size();
+    r.mean = r.stddev = 0.0;
+    r.min = *std::min_element(samples.begin(), samples.end());
+    for (double t : samples)
+      r.mean += t;
+    r.mean /= samples.size();
+    for (double t : samples)
+      r.stddev += (t - r.mean) * (t - r.mean);
+    if (1 < samples.size())
+      r.stddev = sqrt(r.stddev / (samples.size() - 1));
+    r.bytes = bytes;
+    m_results.push_back(r);
+    printf("%-30s %4dx%-4d %2d %9.3f ms %5.1f%% %8.3f ns/pixel %7.2f GB/s\n",
+	   kernel.c_str(), width, height, nThreads, r.mean * 1e-6,
+	   100.0 * r.stddev / r.mean, r.getNsPerPixel(), r.getGBps());
+  };
+
+  void writeCSV(const char* path) const {
+    std::FILE* pFile = std::fopen(path, "w");
+    if (!pFile)
+      throw RuntimeError(__func__, ": Failed to open ", path, ". ",
+			 std::string(strerror(errno)));
+    fprintf(pFile, "label,simd,kernel,width,height,threads,repeat,"
+	    "mean_ns,stddev_ns,min_ns,ns_per_pixel,gb_per_s\n");
+    for (const Result& r : m_results)
+      fprintf(pFile, "%s,%s,\"%s\",%u,%u,%u,%u,%.1f,%.1f,%.1f,%.4f,%.4f\n",
+	      m_label.c_str(), getSIMDLevelString(getSIMDLevel()),
+	      r.kernel.c_str(), r.width, r.height, r.nThreads, r.nRepeat,
+	      r.mean, r.stddev, r.min, r.getNsPerPixel(), r.getGBps());
+    std::fclose(pFile);
+  };
+
+  void writeJSON(const char* path) const {
+    std::FILE* pFile = std::fopen(path, "w");
+    if (!pFile)
+      throw RuntimeError(__func__, ": Failed to open ", path, ". ",
+			 std::string(strerror(errno)));
+    fprintf(pFile, "{\n  \"label\": \"%s\",\n  \"simd\": \"%s\",\n"
+	    "  \"hardware_threads\": %u,\n  \"results\": [",
+	    m_label.c_str(), getSIMDLevelString(getSIMDLevel()),
+	    std::thread::hardware_concurrency());
+    for (size_t i=0; i<m_results.size(); ++i) {
+      const Result& r = m_results[i];
+      fprintf(pFile, "%s\n    {\"kernel\": \"%s\", \"width\": %u, "
+	      "\"height\": %u, \"threads\": %u, \"repeat\": %u, "
+	      "\"mean_ns\": %.1f, \"stddev_ns\": %.1f, \"min_ns\": %.1f, "
+	      "\"ns_per_pixel\": %.4f, \"gb_per_s\": %.4f}",
+	      (i) ? "," : "", r.kernel.c_str(), r.width, r.height, r.nThreads,
+	      r.nRepeat, r.mean, r.stddev, r.min, r.getNsPerPixel(),
+	      r.getGBps());
+    }
+    fprintf(pFile, "\n  ]\n}\n");
+    std::fclose(pFile);
+  };
+};
+
+// Reference implementation: one jet() call per pixel.
+void convertWithJet(const uint16_t* pSrc, uint8_t* pDst,
+		    const uint width, const uint height,
+		    const uint16_t v_min, const uint16_t v_max) {
+  for (size_t i=0; i<size_t(width) * height; ++i) {
+    jet(pSrc[i], pDst[1], pDst[2], pDst[3], v_min, v_max);
+    pDst += 4;
+  }
+}
+
+// Reference implementation: byte by byte copy with offset/padding.
+void copyBytes(const uint8_t* pSrc, uint8_t* pDst,
+	       const uint width, const uint height,
+	       const uint BPP, const int offset, const int padding) {
+  pDst += offset;
+  for (size_t i=0; i<size_t(width) * height; ++i) {
+    for (uint b=0; b<BPP; ++b)
+      *pDst++ = *pSrc++;
+    pDst += padding;
+  }
+}
+
+//! Time nRepeat calls of fcn after one warm-up call. Return ns per call.
+std::vector<double> measure(const std::function<void()>& fcn,
+			    const uint nRepeat) {
+  std::vector<double> samples(nRepeat);
+  fcn();
+  for (uint i=0; i<nRepeat; ++i) {
+    auto start = steady_clock::now();
+    fcn();
+    samples[i] = duration_cast<nanoseconds>(steady_clock::now() - start)
+      .count();
+  }
+  return samples;
+}
+
+void check(const void* pRef, const void* pDst, size_t size,
+	   const std::string& kernel, uint nThreads) {
+  if (memcmp(pRef, pDst, size))
+    throw RuntimeError(__func__, ": Output of ", kernel, " (", nThreads,
+		       " threads) differs from the reference.");
+}
+
+void benchJet(Report& report, const uint width, const uint height,
+	      const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  const double bytes = nPixels * (2 + 4);
+  const uint16_t v_min = DEFAULT_DEPTH_MIN, v_max = DEFAULT_DEPTH_MAX;
+  std::vector<uint16_t> src(nPixels);
+  std::vector<uint8_t> ref(nPixels * 4, 0), dst(nPixels * 4, 0);
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> dist(0, v_max + 2000);
+  for (size_t i=0; i<nPixels; ++i)
+    src[i] = (i % 7) ? dist(rng) : 0;
+
+  report.add("jet (per pixel)", width, height, 1, measure([&](){
+	convertWithJet(src.data(), ref.data(), width, height, v_min, v_max);
+      }, report.getNumRepeat()), bytes);
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    std::fill(dst.begin(), dst.end(), 0);
+    report.add("convert16BitFrameToJet", width, height, nThreads, measure([&](){
+	  convert16BitFrameToJet(src.data(), dst.data(), width, height, 1,
+				 v_min, v_max, pPool);
+	}, report.getNumRepeat()), bytes);
+    check(ref.data(), dst.data(), ref.size(), "convert16BitFrameToJet",
+	  nThreads);
+  }
+}
+
+void benchCopyFrame(Report& report, const uint width, const uint height,
+		    const uint BPP, const int offset, const int padding,
+		    const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  const size_t dstSize = nPixels * (BPP + padding) + offset;
+  const double bytes = nPixels * BPP + dstSize;
+  std::vector<uint8_t> src(nPixels * BPP);
+  std::vector<uint8_t> ref(dstSize, 0), dst(dstSize, 0);
+  std::mt19937 rng(0);
+  for (size_t i=0; i<src.size(); ++i)
+    src[i] = rng();
+
+  char name[32];
+  snprintf(name, sizeof(name), "byte copy(%d,%d,%d)", BPP, offset, padding);
+  report.add(name, width, height, 1, measure([&](){
+	copyBytes(src.data(), ref.data(), width, height, BPP, offset, padding);
+      }, report.getNumRepeat()), bytes);
+  snprintf(name, sizeof(name), "copyFrame(%d,%d,%d)", BPP, offset, padding);
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    std::fill(dst.begin(), dst.end(), 0);
+    report.add(name, width, height, nThreads, measure([&](){
+	  copyFrame(src.data(), dst.data(), width, height, BPP, offset, padding,
+		    pPool);
+	}, report.getNumRepeat()), bytes);
+    check(ref.data(), dst.data(), ref.size(), name, nThreads);
+  }
+}
+
+// Capture path of the recorder: copy each new frame into the next slot of
+// a ring of frames, and playback path: convert the slots for display.
+void benchFrames(Report& report, const uint width, const uint height,
+		 const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  const uint16_t v_min = DEFAULT_DEPTH_MIN, v_max = DEFAULT_DEPTH_MAX;
+  std::vector<uint16_t> src(nPixels);
+  std::vector<uint8_t> ref(nPixels * 4, 0), dst(nPixels * 4, 0);
+  std::mt19937 rng(0);
+  for (size_t i=0; i<nPixels; ++i)
+    src[i] = rng() % (v_max + 2000);
+  convertWithJet(src.data(), ref.data(), width, height, v_min, v_max);
+
+  Frames frames;
+  frames.allocate(width, height, 2, DEFAULT_RING_SIZE);
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    report.add("Frames::getFrame+copyFrame", width, height, nThreads,
+	       measure([&](){
+		   copyFrame(src.data(), frames.getFrame(), width, height, 2,
+			     0, 0, pPool);
+		   frames.incrementFrameIndex();
+		 }, report.getNumRepeat()), nPixels * 2 * 2);
+    uint iFrame = 0;
+    report.add("Frames::convert16BitFrameToJet", width, height, nThreads,
+	       measure([&](){
+		   frames.convert16BitFrameToJet(dst.data(), iFrame, v_min,
+						 v_max, 1, pPool);
+		   iFrame = (iFrame + 1) % DEFAULT_RING_SIZE;
+		 }, report.getNumRepeat()), nPixels * (2 + 4));
+    check(ref.data(), dst.data(), ref.size(),
+	  "Frames::convert16BitFrameToJet", nThreads);
+  }
+  frames.deallocate();
+}
+
+// Playback path with typed frames: kernels chosen at compile time instead
+// of the byte loops of copyFrame.
+void benchFrameBuffer(Report& report, const uint width, const uint height,
+		      const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  std::mt19937 rng(0);
+  FrameBuffer<RGB888> colorFrames;
+  FrameBuffer<Gray8> grayFrames;
+  colorFrames.allocateFrames(width, height, 1);
+  grayFrames.allocateFrames(width, height, 1);
+  uint8_t* pColor = reinterpret_cast<uint8_t *>(colorFrames.getFrame(0));
+  uint8_t* pGray = reinterpret_cast<uint8_t *>(grayFrames.getFrame(0));
+  for (size_t i=0; i<nPixels * 3; ++i)
+    pColor[i] = rng();
+  for (size_t i=0; i<nPixels; ++i)
+    pGray[i] = rng();
+  // The byte copy with padding writes one byte past the last pixel
+  std::vector<uint8_t> colorRef(nPixels * 4 + 1, 0), grayRef(nPixels * 4, 0);
+  std::vector<BGRA8888> dst(nPixels);
+  copyBytes(pColor, colorRef.data(), width, height, 3, 1, 1);
+  for (size_t i=0; i<nPixels; ++i)
+    for (uint b=1; b<4; ++b)
+      grayRef[4 * i + b] = pGray[i];
+
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    std::fill(dst.begin(), dst.end(), BGRA8888{0, 0, 0, 0});
+    report.add("FrameBuffer<RGB888>::convertTo", width, height, nThreads,
+	       measure([&](){
+		   colorFrames.convertTo(dst.data(), 0, pPool);
+		 }, report.getNumRepeat()), nPixels * (3 + 4));
+    check(colorRef.data(), dst.data(), nPixels * 4,
+	  "FrameBuffer<RGB888>::convertTo", nThreads);
+    std::fill(dst.begin(), dst.end(), BGRA8888{0, 0, 0, 0});
+    report.add("FrameBuffer<Gray8>::convertTo", width, height, nThreads,
+	       measure([&](){
+		   grayFrames.convertTo(dst.data(), 0, pPool);
+		 }, report.getNumRepeat()), nPixels * (1 + 4));
+    check(grayRef.data(), dst.data(), grayRef.size(),
+	  "FrameBuffer<Gray8>::convertTo", nThreads);
+  }
+}
+
+uint64_t getPageFaults() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+  return uint64_t(usage.ru_minflt) + usage.ru_majflt;
+}
+
+// First pass of the capture path over a fresh ring, where every slot is
+// touched for the first time: the system allocator faults the pages in
+// during the copies, a prefaulted FrameArena before them.
+void benchRingFirstPass(Report& report, const uint width, const uint height) {
+  const size_t nPixels = size_t(width) * height;
+  const size_t ringSize = nPixels * 2 * DEFAULT_RING_SIZE;
+  std::vector<uint16_t> src(nPixels);
+  std::mt19937 rng(0);
+  for (size_t i=0; i<nPixels; ++i)
+    src[i] = rng();
+
+  auto run = [&](const char* name, FrameArena* pArena){
+    FrameBuffer<Depth16> frames;
+    frames.allocateFrames(width, height, DEFAULT_RING_SIZE, pArena);
+    std::vector<double> samples(DEFAULT_RING_SIZE);
+    const uint64_t nFaults = getPageFaults();
+    for (uint i=0; i<DEFAULT_RING_SIZE; ++i) {
+      auto start = steady_clock::now();
+      copyFrame(src.data(), frames.getFrame(i), width, height, 2);
+      samples[i] = duration_cast<nanoseconds>(steady_clock::now() - start)
+	.count();
+    }
+    const uint64_t nRingFaults = getPageFaults() - nFaults;
+    report.add(name, width, height, 1, samples, nPixels * 2 * 2);
+    printf("%-30s %4dx%-4d %10llu faults\n", name, width, height,
+	   (unsigned long long)nRingFaults);
+  };
+  run("ring first pass (malloc)", NULL);
+  FrameArena arena(FrameArena::getBlockSize(ringSize), ARENA_PREFAULT);
+  run("ring first pass (arena)", &arena);
+  arena.reserve(FrameArena::getBlockSize(ringSize),
+		ARENA_HUGE_PAGES | ARENA_PREFAULT);
+  run(arena.hasHugePages() ? "ring first pass (arena, huge)" :
+      "ring first pass (arena, 4k)", &arena);
+}
+
+// Synthetic depth [mm]: a slanted floor, a box in front of it with a
+// shadow of invalid pixels on its left, sensor noise and sparse holes.
+void makeDepth(uint16_t* pDst, const uint width, const uint height) {
+  std::mt19937 rng(0);
+  std::normal_distribution<float> noise(0.0f, 1.5f);
+  std::uniform_real_distribution<float> hole(0.0f, 1.0f);
+  const uint x0 = width / 3, x1 = 2 * width / 3;
+  const uint y0 = height / 4, y1 = 3 * height / 4;
+  const uint shadow = width / 80;
+  for (uint y=0; y<height; ++y) {
+    for (uint x=0; x<width; ++x) {
+      float z = 3000.0f - 2.5f * y + 0.3f * x;
+      if (y0 <= y && y < y1 && x0 <= x && x < x1)
+	z = 1200.0f + 0.2f * (x - x0);
+      z += noise(rng) * z / 1000.0f;
+      bool bHole = (y0 <= y && y < y1 && x0 - shadow <= x && x < x0) ||
+	hole(rng) < 0.02f;
+      pDst[size_t(y) * width + x] = bHole ? 0 : uint16_t(z);
+    }
+  }
+}
+
+void benchDepthCodec(Report& report, const uint width, const uint height,
+		     const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  std::vector<uint16_t> src(nPixels), dst(nPixels);
+  std::vector<uint8_t> encoded;
+  makeDepth(src.data(), width, height);
+
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    DepthCodec codec((1 < nThreads) ? &pool : NULL);
+    codec.encode(src.data(), width, height, encoded);
+    const double bytes = nPixels * 2 + encoded.size();
+    report.add("DepthCodec::encode", width, height, nThreads, measure([&](){
+	  codec.encode(src.data(), width, height, encoded);
+	}, report.getNumRepeat()), bytes);
+    std::fill(dst.begin(), dst.end(), 0);
+    report.add("DepthCodec::decode", width, height, nThreads, measure([&](){
+	  codec.decode(encoded.data(), encoded.size(), dst.data(),
+		       width, height);
+	}, report.getNumRepeat()), bytes);
+    check(src.data(), dst.data(), nPixels * 2, "DepthCodec", nThreads);
+  }
+  // Of makeDepth(): see `dataset --format recording` for real sequences
+  printf("%-30s %4dx%-4d %10zu byte (x%.2f)\n", "DepthCodec ratio (synth)",
+	 width, height, encoded.size(), double(nPixels * 2) / encoded.size());
+}
+
+// Reference implementation: one division per coordinate.
+void projectNaive(const uint16_t* pDepth, const uint8_t* pColor,
+		  PointXYZRGBA* pDst, const uint width, const uint height,
+		  const CameraIntrinsics& intrinsics) {
+  CameraIntrinsics c = intrinsics.scaledTo(width, height);
+  for (uint v=0; v<height; ++v) {
+    for (uint u=0; u<width; ++u, ++pDepth, pColor += 3, ++pDst) {
+      float z = (*pDepth) ? *pDepth * c.depthScale : NAN;
+      pDst->x = (u - c.cx) * z / c.fx;
+      pDst->y = (v - c.cy) * z / c.fy;
+      pDst->z = z;
+      pDst->color[0] = 0xFF;
+      memcpy(pDst->color + 1, pColor, 3);
+    }
+  }
+}
+
+template <typename Point>
+void checkCloud(const PointXYZRGBA* pRef, const Point* pDst, size_t nPoints,
+		const std::string& kernel, uint nThreads) {
+  for (size_t i=0; i<nPoints; ++i) {
+    const float ref[] = {pRef[i].x, pRef[i].y, pRef[i].z};
+    const float dst[] = {pDst[i].x, pDst[i].y, pDst[i].z};
+    for (int c=0; c<3; ++c) {
+      if (std::isnan(ref[c]) != std::isnan(dst[c]) ||
+	  1e-5f * (1.0f + fabsf(ref[c])) < fabsf(ref[c] - dst[c]))
+	throw RuntimeError(__func__, ": Point ", i, " of ", kernel, " (",
+			   nThreads, " threads) differs from the reference.");
+    }
+  }
+}
+
+void benchPointCloud(Report& report, const uint width, const uint height,
+		     const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  std::vector<uint16_t> depth(nPixels);
+  std::vector<uint8_t> color(nPixels * 3);
+  std::vector<PointXYZRGBA> ref(nPixels), dstRGBA(nPixels);
+  std::vector<PointXYZ> dst(nPixels);
+  makeDepth(depth.data(), width, height);
+  std::mt19937 rng(0);
+  for (uint8_t& val : color)
+    val = rng();
+  DepthProjector projector;
+  report.add("projection (naive)", width, height, 1, measure([&](){
+	projectNaive(depth.data(), color.data(), ref.data(), width, height,
+		     projector.getIntrinsics());
+      }, report.getNumRepeat()), nPixels * (2 + 3 + 16));
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    report.add("DepthProjector XYZ", width, height, nThreads, measure([&](){
+	  projector.project(depth.data(), dst.data(), width, height, pPool);
+	}, report.getNumRepeat()), nPixels * (2 + 12));
+    checkCloud(ref.data(), dst.data(), nPixels, "DepthProjector XYZ",
+	       nThreads);
+    report.add("DepthProjector XYZRGBA", width, height, nThreads,
+	       measure([&](){
+		   projector.project(depth.data(), color.data(), dstRGBA.data(),
+				     width, height, pPool);
+		 }, report.getNumRepeat()), nPixels * (2 + 3 + 16));
+    checkCloud(ref.data(), dstRGBA.data(), nPixels, "DepthProjector XYZRGBA",
+	       nThreads);
+    for (size_t i=0; i<nPixels; ++i) {
+      if (memcmp(ref[i].color, dstRGBA[i].color, 4))
+	throw RuntimeError(__func__, ": Color of point ", i, " (", nThreads,
+			   " threads) differs from the reference.");
+    }
+  }
+}
+
+// Registration with the default calibration. Without baseline it must
+// reproduce the input.
+void benchRegistration(Report& report, const uint width, const uint height,
+		       const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  std::vector<uint16_t> src(nPixels), dst(nPixels);
+  makeDepth(src.data(), width, height);
+  const float R[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1}, t[3] = {0, 0, 0};
+  DepthRegistration identity(CameraIntrinsics(), CameraIntrinsics(),
+			     CameraExtrinsics(R, t));
+  identity.apply(src.data(), dst.data(), width, height);
+  check(src.data(), dst.data(), nPixels * 2, "DepthRegistration", 1);
+
+  DepthRegistration registration;
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    report.add("DepthRegistration", width, height, nThreads, measure([&](){
+	  registration.apply(src.data(), dst.data(), width, height, 0, pPool);
+	}, report.getNumRepeat()), nPixels * 2 * 2);
+  }
+}
+
+// Frame k of a flickering sequence: noise on the depth and pixels dropping
+// out at random, as raw depth near the range limits does.
+void makeFlickeringDepth(const uint16_t* pDepth, uint16_t* pDst,
+			 const size_t nPixels, const uint k) {
+  std::mt19937 rng(k);
+  std::uniform_int_distribution<int> noise(-3, 3);
+  std::uniform_real_distribution<float> hole(0.0f, 1.0f);
+  for (size_t i=0; i<nPixels; ++i)
+    pDst[i] = (pDepth[i] && 0.2f <= hole(rng)) ? pDepth[i] + noise(rng) : 0;
+}
+
+// Straightforward DepthTemporalFilter with the same fixed point.
+struct TemporalFilterReference {
+  std::vector<int32_t> average;
+  std::vector<uint8_t> history;
+
+  void apply(const uint16_t* pSrc, uint16_t* pDst, const uint width,
+	     const uint height, const uint stride) {
+    const int32_t weight = std::lround(DEFAULT_TEMPORAL_ALPHA * 256);
+    const uint mask = (1u << DEFAULT_HOLE_WINDOW) - 1;
+    average.resize(size_t(width) * height, 0);
+    history.resize(size_t(width) * height, 0);
+    for (uint y=0; y<height; ++y) {
+      for (uint x=0; x<width; ++x) {
+	const size_t i = size_t(y) * width + x;
+	const int32_t depth = pSrc[size_t(y) * stride + x];
+	const bool bRestart = 0 == history[i] ||
+	  DEFAULT_TEMPORAL_DELTA * 16 < std::abs(depth * 16 - average[i]);
+	history[i] = uint8_t(history[i] << 1);
+	if (depth) {
+	  average[i] = (bRestart) ? depth * 16 :
+	    average[i] + (((depth * 16 - average[i]) * weight + 128) >> 8);
+	  history[i] |= 1;
+	}
+	uint nValid = 0;
+	for (uint b=0; b<TEMPORAL_HISTORY_SIZE; ++b)
+	  nValid += (history[i] & mask) >> b & 1;
+	pDst[i] = (depth || DEFAULT_HOLE_MIN_VALID <= nValid) ?
+	  (average[i] + 8) >> 4 : 0;
+      }
+    }
+  }
+};
+
+// Temporal filter over a flickering sequence against the reference, with
+// an odd width to cover the remainder of the vector loop, then in place.
+void benchTemporalFilter(Report& report, const uint width, const uint height,
+			 const std::vector<uint>& threadCounts) {
+  const size_t nPixels = size_t(width) * height;
+  const uint nFrames = 2 * TEMPORAL_HISTORY_SIZE;
+  std::vector<uint16_t> depth(nPixels), src(nPixels);
+  std::vector<uint16_t> ref(nPixels), dst(nPixels);
+  makeDepth(depth.data(), width, height);
+  for (uint nThreads : threadCounts) {
+    ThreadPool pool(nThreads);
+    ThreadPool* pPool = (1 < nThreads) ? &pool : NULL;
+    const uint w = width - 3;
+    DepthTemporalFilter filter;
+    TemporalFilterReference reference;
+    for (uint k=0; k<nFrames; ++k) {
+      makeFlickeringDepth(depth.data(), src.data(), nPixels, k);
+      reference.apply(src.data(), ref.data(), w, height, width);
+      filter.apply(src.data(), dst.data(), w, height, width * 2, pPool);
+      check(ref.data(), dst.data(), size_t(w) * height * 2,
+	    "DepthTemporalFilter", nThreads);
+    }
+    std::vector<uint8_t> confidence(size_t(w) * height);
+    filter.getConfidence(confidence.data());
+    for (size_t i=0; i<confidence.size(); ++i)
+      if (confidence[i] != __builtin_popcount(reference.history[i]))
+	throw RuntimeError(__func__, ": Confidence of DepthTemporalFilter (",
+			   nThreads, " threads) differs from the reference.");
+
+    filter.reset();
+    report.add("DepthTemporalFilter", width, height, nThreads, measure([&](){
+	  filter.apply(src.data(), src.data(), width, height, 0, pPool);
+	}, report.getNumRepeat()), nPixels * (2 + 4 + 1) * 2);
+  }
+}
+
+// Cost of one record() and accuracy of the percentiles against sorting.
+void benchLatencyHistogram(const uint nRepeat) {
+  const uint nValues = 1 << 20;
+  std::vector<uint64_t> values(nValues);
+  std::mt19937 rng(0);
+  std::lognormal_distribution<double> dist(8.0, 1.0); // ~3 ms [us]
+  for (uint64_t& value : values)
+    value = uint64_t(dist(rng));
+
+  LatencyHistogram histogram;
+  std::vector<double> samples = measure([&](){
+      histogram.reset();
+      for (uint64_t value : values)
+	histogram.record(value);
+    }, nRepeat);
+  std::sort(values.begin(), values.end());
+  printf("%-30s %9u %12.3f ns/value\n", "LatencyHistogram::record", nValues,
+	 *std::min_element(samples.begin(), samples.end()) / nValues);
+  const double percentiles[] = {50.0, 99.0, 100.0};
+  for (double p : percentiles) {
+    uint64_t ref = values[std::max(1.0, ceil(p / 100.0 * nValues)) - 1];
+    uint64_t val = histogram.getPercentile(p);
+    if (val < ref || ref + ref / 32 + 1 < val)
+      throw RuntimeError(__func__, ": p", p, " is ", val, ", expected ", ref,
+			 ".");
+  }
+}
+
+// 1, 2, 4, ... up to the number of hardware threads, which is included.
+std::vector<uint> getDefaultThreadCounts() {
+  uint nMax = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<uint> counts;
+  for (uint n=1; n<nMax; n*=2)
+    counts.push_back(n);
+  counts.push_back(nMax);
+  return counts;
+}
+
+std::vector<uint> parseThreadCounts(const std::string& val) {
+  std::vector<uint> counts;
+  std::istringstream list(val);
+  std::string item;
+  while (std::getline(list, item, ',')) {
+    int n = std::stoi(item);
+    if (n < 1)
+      throw RuntimeError(__func__, ": Invalid thread count ", item, ".");
+    counts.push_back(n);
+  }
+  return counts;
+}
+
+struct Option {
+  bool printHelp = false;
+  uint nRepeat = DEFAULT_REPEAT;
+  std::vector<uint> threadCounts = getDefaultThreadCounts();
+  std::string csv;
+  std::string json;
+  std::string label;
+};
+
+void printHelp() {
+  printf("%-30s:%s\n", "--help", "Show this message and quit.");
+  printf("%-30s:%s\n", "--repeat N", "Timed calls per kernel.");
+  printf("%-30s:%s\n", "--threads N,N,...",
+	 "Thread counts. (1, 2, 4, ... hardware threads)");
+  printf("%-30s:%s\n", "--csv PATH", "Write the results as CSV.");
+  printf("%-30s:%s\n", "--json PATH", "Write the results as JSON.");
+  printf("%-30s:%s\n", "--label TEXT",
+	 "Name of the run in CSV/JSON, e.g. the commit.");
+}
+
+Option parseArguments(int argc, char *argv[]) {
+  Option opt;
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--help") {
+      opt.printHelp = true;
+      break;
+    } else if (arg == "--repeat") {
+      if (++i == argc) goto fail2;
+      opt.nRepeat = std::max(1, std::stoi(argv[i]));
+    } else if (arg == "--threads") {
+      if (++i == argc) goto fail2;
+      opt.threadCounts = parseThreadCounts(argv[i]);
+    } else if (arg == "--csv") {
+      if (++i == argc) goto fail2;
+      opt.csv = argv[i];
+    } else if (arg == "--json") {
+      if (++i == argc) goto fail2;
+      opt.json = argv[i];
+    } else if (arg == "--label") {
+      if (++i == argc) goto fail2;
+      opt.label = argv[i];
+    } else {
+      throw RuntimeError(__func__, ": Unexpected option ", arg, " was given.");
+    }
+    continue;
+  fail2:
+    throw RuntimeError(__func__, ": Parameter for ", arg, " is missing.");
+  }
+  return opt;
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    Option opt = parseArguments(argc, argv);
+    if (opt.printHelp) {
+      printHelp();
+      return 0;
+    }
+    Report report(opt.label, opt.nRepeat);
+    printf("SIMD: %s, hardware threads: %u\n",
+	   getSIMDLevelString(getSIMDLevel()),
+	   std::thread::hardware_concurrency());
+    printf("%-30s %-9s %2s %12s %6s %17s %12s\n", "kernel", "size", "T",
+	   "mean", "cv", "speed", "throughput");
+    for (const Resolution& res : RESOLUTIONS) {
+      benchJet(report, res.width, res.height, opt.threadCounts);
+      benchCopyFrame(report, res.width, res.height, 3, 1, 1,
+		     opt.threadCounts);
+      benchCopyFrame(report, res.width, res.height, 3, 0, 0,
+		     opt.threadCounts);
+      benchCopyFrame(report, res.width, res.height, 2, 0, 0,
+		     opt.threadCounts);
+      benchFrames(report, res.width, res.height, opt.threadCounts);
+      benchFrameBuffer(report, res.width, res.height, opt.threadCounts);
+      benchRingFirstPass(report, res.width, res.height);
+      benchDepthCodec(report, res.width, res.height, opt.threadCounts);
+      benchPointCloud(report, res.width, res.height, opt.threadCounts);
+      benchRegistration(report, res.width, res.height, opt.threadCounts);
+      benchTemporalFilter(report, res.width, res.height, opt.threadCounts);
+    }
+    benchLatencyHistogram(opt.nRepeat);
+    if (!opt.csv.empty())
+      report.writeCSV(opt.csv.c_str());
+    if (!opt.json.empty())
+      report.writeJSON(opt.json.c_str());
+  } catch (const std::exception& e) {
+    printf("%s\n", e.what());
+    return -1;
+  }
+  return 0;
+}
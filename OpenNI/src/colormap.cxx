@@ -0,0 +1,62 @@
+#include "colormap.hpp"
+#include "io.hpp"
+
+#include <map>
+#include <mutex>
+#include <cstring>
+
+#define COLORMAP_CACHE_SIZE 16
+
+JetColormap::JetColormap(const uint16_t v_min, const uint16_t v_max)
+  : m_vMin(v_min)
+  , m_vMax(v_max)
+  , m_last(0)
+  , m_table()
+{
+  // [0]: below v_min, [1, n]: v_min ... v_max, [n+1]: above v_max
+  int n = (v_min <= v_max) ? int(v_max) - v_min + 1 : 0;
+  m_last = n + 1;
+  m_table.resize(n + 2);
+  uint8_t pixel[4] = {0, 0, 0, 0};
+  memcpy(&m_table[0], pixel, 4);
+  for (int i=0; i<n; ++i) {
+    jet(uint16_t(v_min + i), pixel[1], pixel[2], pixel[3], v_min, v_max);
+    memcpy(&m_table[i + 1], pixel, 4);
+  }
+  pixel[1] = pixel[2] = pixel[3] = 255;
+  memcpy(&m_table[m_last], pixel, 4);
+}
+
+std::shared_ptr<const JetColormap> JetColormap::get(const uint16_t v_min,
+						     const uint16_t v_max) {
+  static std::mutex mutex;
+  static std::map<uint32_t, std::shared_ptr<const JetColormap> > cache;
+  uint32_t key = (uint32_t(v_min) << 16) | v_max;
+  std::lock_guard<std::mutex> _(mutex);
+  auto it = cache.find(key);
+  if (it != cache.end())
+    return it->second;
+  if (cache.size() >= COLORMAP_CACHE_SIZE)
+    cache.erase(cache.begin());
+  std::shared_ptr<const JetColormap> map(new JetColormap(v_min, v_max));
+  cache[key] = map;
+  return map;
+}
+
+uint16_t JetColormap::getMinValue() const { return m_vMin; }
+
+uint16_t JetColormap::getMaxValue() const { return m_vMax; }
+
+void JetColormap::apply(const uint16_t* pSrc, uint8_t* pDst,
+			const size_t nPixels) const {
+  const uint8_t alpha[4] = {0xFF, 0, 0, 0};
+  uint32_t mask;
+  memcpy(&mask, alpha, 4);
+  for (size_t i=0; i<nPixels; ++i) {
+    uint32_t pixel;
+    memcpy(&pixel, pDst, 4);
+    pixel = (pixel & mask) | lookup(pSrc[i]);
+    memcpy(pDst, &pixel, 4);
+    pDst += 4;
+  }
+}
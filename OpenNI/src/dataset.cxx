@@ -0,0 +1,458 @@
+#include "io.hpp"
+#include "npyio.hpp"
+#include "pngio.hpp"
+#include "Recording.hpp"
+#include "DepthCodec.hpp"
+#include "TUMDataset.hpp"
+#include "ThreadPool.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <exception>
+
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#define DEFAULT_SEQUENCE    "rgbd_dataset_freiburg3_long_office_household"
+#define DEFAULT_NPY_OUTPUT       DEFAULT_SEQUENCE "_npy" // Next to the sequence
+#define DEFAULT_RECORDING_OUTPUT DEFAULT_SEQUENCE ".rec"
+#define DEFAULT_NUM_THREADS 0
+#define DEFAULT_BATCH_SIZE  64 // Samples in memory per batch, twice at most
+#define GROUNDTRUTH_SIZE    7  // tx ty tz qx qy qz qw
+
+enum DatasetFormat {
+  DATASET_NPY,       // Directory of .npy files, like create_dataset.py
+  DATASET_RECORDING, // Recording file and a ground truth list
+};
+
+//! Associated entries of one sample.
+struct SampleFiles {
+  double timestamp; // Ground truth timestamp [s]
+  float groundtruth[GROUNDTRUTH_SIZE];
+  uint64_t colorTimestamp, depthTimestamp; // [us]
+  std::string color, depth;
+};
+
+//! Images of one sample, laid out for the output.
+struct Sample {
+  std::vector<uint8_t> color;   // npy: R, G and B planes. Else RGB888
+  std::vector<uint8_t> depth;   // npy: TUM values. Else 1 mm
+  std::vector<uint8_t> encoded; // Depth payload of CODEC_DEPTH_RLZ
+  std::vector<uint8_t> buffer;
+};
+
+//! Output files of the builder.
+struct Output {
+  DatasetFormat format;
+  std::string path;
+  uint width, height;
+  bool bCompress;
+  NpyWriter timestamps, groundtruth, color, depth;
+  RecordingWriter recording;
+  std::ofstream groundtruthList;
+  uint64_t nRawBytes[2], nBytes[2]; // Frame data of depth and color [byte]
+};
+
+//!
+//! Associate the ground truth, rgb and depth lists like create_dataset.py.
+//! File names are relative to the directory of their list.
+//!
+std::vector<SampleFiles> associateSamples(const std::string& groundtruthFile,
+					  const std::string& colorFile,
+					  const std::string& depthFile,
+					  double maxDiff) {
+  auto getDirectory = [](const std::string& path){
+    size_t pos = path.find_last_of('/');
+    return (std::string::npos == pos) ? std::string() :
+      path.substr(0, pos + 1);
+  };
+  const std::string colorDir = getDirectory(colorFile);
+  const std::string depthDir = getDirectory(depthFile);
+  std::vector<SampleFiles> samples;
+  // The lists are associated while read, so only the samples are kept.
+  associateTUMFiles(groundtruthFile, {colorFile, depthFile},
+		    [&](const std::vector<TUMEntry>& entries){
+    const TUMEntry& pose = entries[0];
+    const TUMEntry& color = entries[1];
+    const TUMEntry& depth = entries[2];
+    if (pose.values.size() < GROUNDTRUTH_SIZE || color.values.empty() ||
+	depth.values.empty())
+      throw RuntimeError(__func__, ": Missing values at ", pose.timestamp,
+			 ".");
+    SampleFiles sample;
+    sample.timestamp = pose.timestamp;
+    for (uint i=0; i<GROUNDTRUTH_SIZE; ++i)
+      sample.groundtruth[i] = strtof(pose.values[i].c_str(), NULL);
+    sample.colorTimestamp = uint64_t(llround(color.timestamp * 1e6));
+    sample.depthTimestamp = uint64_t(llround(depth.timestamp * 1e6));
+    sample.color = colorDir + color.values[0];
+    sample.depth = depthDir + depth.values[0];
+    samples.push_back(sample);
+  }, maxDiff);
+  return samples;
+}
+
+//! Decode the images of files and lay them out for output.
+void decodeSample(const SampleFiles& files, Output& output, DepthCodec& codec,
+		  Sample& sample) {
+  uint width, height, BPP;
+  readPNG(files.color.c_str(), sample.buffer, width, height, BPP);
+  if (3 != BPP || output.width != width || output.height != height)
+    throw RuntimeError(__func__, ": ", files.color, " is ", width, "x", height,
+		       "x", BPP, ". ", output.width, "x", output.height,
+		       "x3 expected.");
+  const size_t nPixels = size_t(width) * height;
+  if (DATASET_NPY == output.format) {
+    // Channel planes, as numpy's transpose(2, 0, 1)
+    sample.color.resize(nPixels * 3);
+    uint8_t* pR = sample.color.data();
+    uint8_t* pG = pR + nPixels;
+    uint8_t* pB = pG + nPixels;
+    const uint8_t* pSrc = sample.buffer.data();
+    for (size_t i=0; i<nPixels; ++i) {
+      pR[i] = pSrc[3 * i];
+      pG[i] = pSrc[3 * i + 1];
+      pB[i] = pSrc[3 * i + 2];
+    }
+  } else {
+    sample.color.swap(sample.buffer);
+  }
+
+  readPNG(files.depth.c_str(), sample.depth, width, height, BPP);
+  if (2 != BPP || output.width != width || output.height != height)
+    throw RuntimeError(__func__, ": ", files.depth, " is ", width, "x", height,
+		       "x", BPP, ". ", output.width, "x", output.height,
+		       "x2 expected.");
+  if (DATASET_RECORDING == output.format) {
+    uint16_t* pDepth = reinterpret_cast<uint16_t *>(sample.depth.data());
+    for (size_t i=0; i<nPixels; ++i)
+      pDepth[i] = (pDepth[i] + TUM_DEPTH_SCALE / 2) / TUM_DEPTH_SCALE;
+    if (output.bCompress)
+      codec.encode(pDepth, width, height, sample.encoded);
+  }
+}
+
+void openOutput(Output& output, uint64_t nSamples) {
+  const uint64_t w = output.width, h = output.height;
+  if (DATASET_NPY == output.format) {
+    if (mkdir(output.path.c_str(), 0755) && EEXIST != errno)
+      throw RuntimeError(__func__, ": Failed to create ", output.path, ": ",
+			 std::string(strerror(errno)));
+    const std::string dir = output.path + "/";
+    output.timestamps.open((dir + "timestamps.npy").c_str(), "<f8", 8,
+			   {nSamples});
+    output.groundtruth.open((dir + "groundtruth.npy").c_str(), "<f4", 4,
+			    {nSamples, GROUNDTRUTH_SIZE});
+    output.color.open((dir + "rgb.npy").c_str(), "|u1", 1,
+		      {nSamples, 3, h, w});
+    output.depth.open((dir + "depth.npy").c_str(), "<u2", 2,
+		      {nSamples, 1, h, w});
+    return;
+  }
+  StreamInfo depth = {RECORDING_SENSOR_DEPTH, RECORDING_FORMAT_DEPTH_1_MM,
+		      output.width, output.height, 2, 0, 10000,
+		      output.bCompress ? CODEC_DEPTH_RLZ : CODEC_RAW};
+  StreamInfo color = {RECORDING_SENSOR_COLOR, RECORDING_FORMAT_RGB888,
+		      output.width, output.height, 3, 0, 255, CODEC_RAW};
+  output.recording.addStream(depth);
+  output.recording.addStream(color);
+  output.recording.open(output.path.c_str());
+  const std::string list = output.path + ".groundtruth.txt";
+  output.groundtruthList.open(list);
+  if (!output.groundtruthList)
+    throw RuntimeError(__func__, ": Failed to open ", list, ".");
+  output.groundtruthList << "# timestamp tx ty tz qx qy qz qw\n";
+  output.groundtruthList << std::fixed;
+  output.groundtruthList.precision(6);
+}
+
+void writeSample(Output& output, const SampleFiles& files,
+		 const Sample& sample, uint64_t index) {
+  if (DATASET_NPY == output.format) {
+    output.timestamps.write(&files.timestamp, sizeof(files.timestamp));
+    output.groundtruth.write(files.groundtruth, sizeof(files.groundtruth));
+    output.color.write(sample.color.data(), sample.color.size());
+    output.depth.write(sample.depth.data(), sample.depth.size());
+    return;
+  }
+  const std::vector<uint8_t>& depth =
+    (output.bCompress) ? sample.encoded : sample.depth;
+  output.nRawBytes[0] += sample.depth.size();
+  output.nBytes[0] += depth.size();
+  output.nRawBytes[1] += sample.color.size();
+  output.nBytes[1] += sample.color.size();
+  if (output.bCompress)
+    output.recording.writeFrame(0, sample.encoded.data(),
+				sample.encoded.size(), files.depthTimestamp,
+				index, 0, CODEC_DEPTH_RLZ);
+  else
+    output.recording.writeFrame(0, sample.depth.data(), sample.depth.size(),
+				files.depthTimestamp, index, 0);
+  output.recording.writeFrame(1, sample.color.data(), sample.color.size(),
+			      files.colorTimestamp, index, 0);
+  output.groundtruthList << files.timestamp;
+  for (float value : files.groundtruth)
+    output.groundtruthList << " " << value;
+  output.groundtruthList << "\n";
+}
+
+void closeOutput(Output& output) {
+  if (DATASET_NPY == output.format) {
+    output.timestamps.close();
+    output.groundtruth.close();
+    output.color.close();
+    output.depth.close();
+    return;
+  }
+  output.recording.close();
+  output.groundtruthList.close();
+  if (!output.groundtruthList)
+    throw RuntimeError(__func__, ": Failed to write ", output.path,
+		       ".groundtruth.txt.");
+}
+
+//!
+//! Decode the samples in batches on the pool and write each batch on a
+//! writer thread while the next one is decoded, so at most two batches
+//! are in memory.
+//!
+void buildDataset(const std::vector<SampleFiles>& files, Output& output,
+		  uint batchSize, ThreadPool& pool) {
+  std::vector<Sample> batches[2];
+  batches[0].resize(batchSize);
+  batches[1].resize(batchSize);
+  std::thread writer;
+  std::exception_ptr error;
+  auto joinWriter = [&](){
+    if (writer.joinable())
+      writer.join();
+    if (error)
+      std::rethrow_exception(error);
+  };
+  const uint nSamples = files.size();
+  try {
+    for (uint begin=0, iBatch=0; begin<nSamples; begin+=batchSize, iBatch^=1) {
+      const uint end = std::min(nSamples, begin + batchSize);
+      std::vector<Sample>& batch = batches[iBatch];
+      pool.parallelFor(begin, end, [&](uint i0, uint i1){
+	  DepthCodec codec;
+	  for (uint i=i0; i<i1; ++i)
+	    decodeSample(files[i], output, codec, batch[i - begin]);
+	});
+      joinWriter();
+      writer = std::thread([&, iBatch, begin, end](){
+	  try {
+	    for (uint i=begin; i<end; ++i)
+	      writeSample(output, files[i], batches[iBatch][i - begin], i);
+	  } catch (...) {
+	    error = std::current_exception();
+	  }
+	});
+      printf("processing %u/%u\r", end, nSamples);
+      fflush(stdout);
+    }
+    joinWriter();
+  } catch (...) {
+    if (writer.joinable())
+      writer.join();
+    throw;
+  }
+  printf("\n");
+}
+
+//! True if path a and b name the same existing file or directory.
+bool isSameFile(const std::string& a, const std::string& b) {
+  struct stat statA, statB;
+  return 0 == stat(a.c_str(), &statA) && 0 == stat(b.c_str(), &statB) &&
+    statA.st_dev == statB.st_dev && statA.st_ino == statB.st_ino;
+}
+
+//! Directory of path, "." if it has none.
+std::string getParentDirectory(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  if (std::string::npos == slash)
+    return ".";
+  return (0 == slash) ? "/" : path.substr(0, slash);
+}
+
+void createDataset(const std::string& groundtruthFile,
+		   const std::string& colorFile, const std::string& depthFile,
+		   const std::string& outputPath, DatasetFormat format,
+		   bool bCompress, double maxDiff, uint batchSize,
+		   uint nThreads) {
+  // The npy files must not land among the images of the sequence
+  for (const std::string* pList : {&groundtruthFile, &colorFile, &depthFile})
+    if (DATASET_NPY == format &&
+	isSameFile(outputPath, getParentDirectory(*pList)))
+      throw RuntimeError(__func__, ": Output ", outputPath, " is the ",
+			 "directory of the input ", *pList, ".");
+  std::vector<SampleFiles> files = associateSamples(groundtruthFile, colorFile,
+						    depthFile, maxDiff);
+  if (files.empty())
+    throw RuntimeError(__func__, ": No sample could be associated.");
+  printf("Associated %u samples.\n", uint(files.size()));
+
+  Output output;
+  output.format = format;
+  output.path = outputPath;
+  output.bCompress = bCompress;
+  std::fill_n(output.nRawBytes, 2, 0);
+  std::fill_n(output.nBytes, 2, 0);
+  // The size of the first image sets the shape of the output
+  std::vector<uint8_t> data;
+  uint BPP;
+  readPNG(files[0].color.c_str(), data, output.width, output.height, BPP);
+  openOutput(output, files.size());
+
+  ThreadPool pool(nThreads);
+  auto t0 = getSteadyTimestamp();
+  buildDataset(files, output, std::max(1u, batchSize), pool);
+  closeOutput(output);
+  double seconds = (getSteadyTimestamp() - t0).count() / 1e6;
+  printf("Wrote %u samples to %s in %.1f s (%.1f samples/s).\n",
+	 uint(files.size()), outputPath.c_str(), seconds,
+	 files.size() / seconds);
+  if (DATASET_RECORDING == format) {
+    // Color is stored raw, so the ratio of the file is below the depth one
+    const char* names[] = {"depth", "color"};
+    for (int i=0; i<2; ++i)
+      printf("Wrote %.1f MB of %.1f MB %s frame data (%.2fx).\n",
+	     output.nBytes[i] / 1e6, output.nRawBytes[i] / 1e6, names[i],
+	     double(output.nRawBytes[i]) / output.nBytes[i]);
+    printf("Wrote %.1f MB of %.1f MB frame data (%.2fx).\n",
+	   (output.nBytes[0] + output.nBytes[1]) / 1e6,
+	   (output.nRawBytes[0] + output.nRawBytes[1]) / 1e6,
+	   double(output.nRawBytes[0] + output.nRawBytes[1]) /
+	   (output.nBytes[0] + output.nBytes[1]));
+  }
+}
+
+struct Option {
+  bool printHelp = false;
+  std::string groundtruthFile = DEFAULT_SEQUENCE "/groundtruth.txt";
+  std::string colorFile = DEFAULT_SEQUENCE "/rgb.txt";
+  std::string depthFile = DEFAULT_SEQUENCE "/depth.txt";
+  std::string output; // DEFAULT_NPY_OUTPUT or DEFAULT_RECORDING_OUTPUT
+  DatasetFormat format = DATASET_NPY;
+  bool compress = true;
+  double maxDiff = TUM_MAX_DIFF;
+  uint batchSize = DEFAULT_BATCH_SIZE;
+  uint nThreads = DEFAULT_NUM_THREADS;
+};
+
+void printHelp() {
+  printf("%-30s:%s\n", "--help", "Show this message and quit.");
+  printf("%-30s:%s\n", "--groundtruth-file PATH", "TUM ground truth list.");
+  printf("%-30s:%s\n", "--rgb-file PATH", "TUM rgb list.");
+  printf("%-30s:%s\n", "--depth-file PATH", "TUM depth list.");
+  printf("%-30s:%s\n", "--output PATH",
+	 "Output directory (npy) or file (recording).");
+  printf("%-30s:%s\n", "", "(" DEFAULT_NPY_OUTPUT " or");
+  printf("%-30s:%s\n", "", " " DEFAULT_RECORDING_OUTPUT ")");
+  printf("%-30s:%s\n", "--format npy|recording",
+	 "npy: timestamps, groundtruth, rgb and depth .npy files. (npy)");
+  printf("%-30s:%s\n", "", "recording: recording file with depth in mm,");
+  printf("%-30s:%s\n", "", "and PATH.groundtruth.txt.");
+  printf("%-30s:%s\n", "--no-compress",
+	 "Store depth of recordings uncompressed.");
+  printf("%-30s:%s\n", "--max-diff SECONDS",
+	 "Largest time difference of associated entries. (0.02)");
+  printf("%-30s:%s\n", "--batch-size N",
+	 "Samples decoded at once. Bounds the memory. (64)");
+  printf("%-30s:%s\n", "--n-threads N-THREADS",
+	 "Number of decoding threads. (0: all cores)");
+}
+
+Option parseArguments(int argc, char *argv[]) {
+  Option opt;
+  std::string arg, val;
+  for (int i=1; i<argc; ++i) {
+    arg = argv[i];
+    if (arg == "--help") {
+      opt.printHelp = true;
+      break;
+    } else if (arg == "--groundtruth-file") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.groundtruthFile = argv[i];
+    } else if (arg == "--rgb-file") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.colorFile = argv[i];
+    } else if (arg == "--depth-file") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.depthFile = argv[i];
+    } else if (arg == "--output") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.output = argv[i];
+    } else if (arg == "--format") {
+      i += 1;
+      if (i == argc) goto fail2;
+      val = argv[i];
+      if (val == "npy")
+	opt.format = DATASET_NPY;
+      else if (val == "recording")
+	opt.format = DATASET_RECORDING;
+      else
+	throw RuntimeError({"Unknown format ", val, "."});
+    } else if (arg == "--no-compress") {
+      opt.compress = false;
+    } else if (arg == "--max-diff") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.maxDiff = std::stod(argv[i]);
+    } else if (arg == "--batch-size") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.batchSize = std::stoi(argv[i]);
+    } else if (arg == "--n-threads") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.nThreads = std::stoi(argv[i]);
+    } else {
+      goto fail1;
+    }
+  }
+  if (opt.output.empty())
+    opt.output = (DATASET_NPY == opt.format) ?
+      DEFAULT_NPY_OUTPUT : DEFAULT_RECORDING_OUTPUT;
+  return opt;
+ fail1:
+  throw RuntimeError({"Unexpected option ", arg, " was given."});
+ fail2:
+  throw RuntimeError({"Parameter for ", arg, " is missing."});
+}
+
+int main(int argc, char *argv[]) {
+  Option opt;
+  try {
+    opt = parseArguments(argc, argv);
+  } catch (const std::exception& e) {
+    printf("%s\n", e.what());
+    return -1;
+  }
+
+  if (opt.printHelp) {
+    printHelp();
+    return 0;
+  }
+
+  try {
+    createDataset(opt.groundtruthFile, opt.colorFile, opt.depthFile,
+		  opt.output, opt.format, opt.compress, opt.maxDiff,
+		  opt.batchSize, opt.nThreads);
+  } catch (const std::exception& e) {
+    printf("%s\n", e.what());
+    return -1;
+  }
+  return 0;
+}
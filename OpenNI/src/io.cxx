@@ -1,6 +1,14 @@
 #include "io.hpp"
+#include "colormap.hpp"
+#include "simd.hpp"
+#include "ThreadPool.hpp"
+#include "Recording.hpp"
+#include "FrameView.hpp"
+#include "FrameArena.hpp"
 #include <cmath>
+#include <cstring>
 #include <stdexcept>
+#include <algorithm>
 
 using namespace std::chrono;
 
@@ -20,6 +28,10 @@ microseconds getCurrentTimestamp() {
   return duration_cast<microseconds>(system_clock::now().time_since_epoch());
 }
 
+microseconds getSteadyTimestamp() {
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch());
+}
+
 void jet(const uint16_t val, uint8_t& R, uint8_t& G, uint8_t& B,
 	 const uint16_t v_min, const uint16_t v_max) {
   if (val < v_min) {
@@ -42,39 +54,95 @@ void jet(const uint16_t val, uint8_t& R, uint8_t& G, uint8_t& B,
 
 void convert16BitFrameToJet(const uint16_t* pSrc, uint8_t* pDst,
 			    const uint width, const uint height, const uint mode,
-			    const uint16_t v_min, const uint16_t v_max) {
-  uint8_t R=0, G=1, B=2, channel=3;
+			    const uint16_t v_min, const uint16_t v_max,
+			    ThreadPool* pool, const uint dstStride,
+			    const uint srcStride) {
   switch (mode) {
   case 1: // ARGB == SDL_PIXELFORMAT_BGRA8888
-    R=1; G=2; B=3;
-    channel = 4;
     break;
   default:
     throw RuntimeError(__func__, ":Not implemented for format ", mode);
   }
-  for (uint h=0; h<height; ++h) {
-    for (uint w=0; w<width; ++w) {
-      jet(*pSrc, pDst[R], pDst[G], pDst[B], v_min, v_max);
-      ++pSrc; pDst += channel;
+  std::shared_ptr<const JetColormap> colormap = JetColormap::get(v_min, v_max);
+  const uint8_t* pSrcBuff = reinterpret_cast<const uint8_t *>(pSrc);
+  size_t srcRow = srcStride ? srcStride : size_t(width) * 2;
+  size_t dstRow = dstStride ? dstStride : size_t(width) * 4;
+  if (srcRow == size_t(width) * 2 && dstRow == size_t(width) * 4) {
+    // Packed rows: convert the whole band at once
+    if (!pool) {
+      colormap->apply(pSrc, pDst, size_t(width) * height);
+      return;
+    }
+    pool->parallelFor(0, height, [&](uint h0, uint h1){
+	size_t begin = size_t(h0) * width;
+	colormap->apply(pSrc + begin, pDst + 4 * begin,
+			size_t(h1 - h0) * width);
+      });
+    return;
+  }
+  auto convertRows = [&](uint h0, uint h1){
+    for (uint h=h0; h<h1; ++h)
+      colormap->apply(reinterpret_cast<const uint16_t *>(pSrcBuff + h * srcRow),
+		      pDst + h * dstRow, width);
+  };
+  if (pool)
+    pool->parallelFor(0, height, convertRows);
+  else
+    convertRows(0, height);
+}
+
+// Copy nPixels pixels. pDst already points past the offset.
+static void copyPixels(const uint8_t* pSrc, uint8_t* pDst, const size_t nPixels,
+		       const uint BPP, const int padding) {
+  if (0 == padding) {
+    memcpy(pDst, pSrc, nPixels * BPP);
+    return;
+  }
+  if (3 == BPP && 1 == padding) { // e.g. RGB888 -> SDL_PIXELFORMAT_BGRA8888
+    expand3To4(pSrc, pDst, nPixels);
+    return;
+  }
+  for (size_t i=0; i<nPixels; ++i) {
+    for (uint b=0; b<BPP; ++b) {
+      *pDst = *pSrc;
+      ++pDst; ++pSrc;
     }
+    pDst += padding;
   }
 }
 
 void copyFrame(const void* pSrc, void* pDst,
 	       const uint width, const uint height,
-	       const uint BPP, const int offset, const int padding) {
+	       const uint BPP, const int offset, const int padding,
+	       ThreadPool* pool, const uint dstStride, const uint srcStride) {
   const uint8_t* pSrcBuff = static_cast<const uint8_t *>(pSrc);
   uint8_t* pDstBuff = static_cast<uint8_t *>(pDst);
   pDstBuff += offset;
-  for (uint h=0; h<height; ++h) {
-    for (uint w=0; w<width; ++w) {
-      for (uint b=0; b<BPP; ++b) {
-	*pDstBuff = *pSrcBuff;
-	++pDstBuff; ++pSrcBuff;
-      }
-      pDstBuff += padding;
+  size_t srcRow = srcStride ? srcStride : size_t(width) * BPP;
+  size_t dstRow = dstStride ? dstStride : size_t(width) * (BPP + padding);
+  if (srcRow == size_t(width) * BPP &&
+      dstRow == size_t(width) * (BPP + padding)) {
+    // Packed rows: copy the whole band at once
+    if (!pool) {
+      copyPixels(pSrcBuff, pDstBuff, size_t(width) * height, BPP, padding);
+      return;
     }
+    pool->parallelFor(0, height, [&](uint h0, uint h1){
+	size_t begin = size_t(h0) * width;
+	copyPixels(pSrcBuff + begin * BPP, pDstBuff + begin * (BPP + padding),
+		   size_t(h1 - h0) * width, BPP, padding);
+      });
+    return;
   }
+  auto copyRows = [&](uint h0, uint h1){
+    for (uint h=h0; h<h1; ++h)
+      copyPixels(pSrcBuff + h * srcRow, pDstBuff + h * dstRow, width, BPP,
+		 padding);
+  };
+  if (pool)
+    pool->parallelFor(0, height, copyRows);
+  else
+    copyRows(0, height);
 }
 
 Frames::Frames()
@@ -83,31 +151,74 @@ Frames::Frames()
   , m_BPP(0)
   , m_nFrames(0)
   , m_currentFrame(0)
+  , m_fixedBPP(0)
   , m_pBuffer(NULL)
+  , m_pArena(NULL)
+  , m_info()
 {}
 
+Frames::Frames(uint BPP)
+  : Frames()
+{
+  m_fixedBPP = BPP;
+}
+
 Frames::~Frames() {
   deallocate();
 }
 
 void Frames::deallocate() {
   if (m_pBuffer) {
-    delete[] static_cast<uint8_t *>(m_pBuffer);
+    if (m_pArena)
+      m_pArena->deallocate(m_pBuffer);
+    else
+      free(m_pBuffer);
     m_pBuffer = NULL;
   }
+  m_pArena = NULL;
 }
 
-void Frames::allocate(uint width, uint height, uint BPP, uint nFrames) {
+void Frames::allocate(uint width, uint height, uint BPP, uint nFrames,
+		      FrameArena* pArena) {
+  if (m_fixedBPP && BPP != m_fixedBPP)
+    throw RuntimeError(__func__, ": Frames of ", m_fixedBPP,
+		       " byte pixels can not take ", BPP, " byte pixels.");
   deallocate();
   m_width = width; m_height = height; m_BPP = BPP; m_nFrames = nFrames;
   size_t buffersize = size_t(m_nFrames) * m_width * m_height * m_BPP;
-  m_pBuffer = static_cast<void *>(new uint8_t[buffersize]);
+  if (pArena) {
+    m_pBuffer = pArena->allocate(buffersize);
+    m_pArena = pArena;
+  } else if (posix_memalign(&m_pBuffer, ARENA_ALIGNMENT,
+			    std::max<size_t>(buffersize, 1))) {
+    m_pBuffer = NULL;
+    throw RuntimeError(__func__, ": Failed to allocate ", buffersize,
+		       " byte.");
+  }
+  m_info.assign(m_nFrames, FrameInfo{0, -1, 0});
+}
+
+void Frames::load(const RecordingReader& reader, uint stream, uint BPP) {
+  const StreamInfo& info = reader.getStreamInfo(stream);
+  if (BPP && BPP != info.BPP)
+    throw RuntimeError(__func__, ": Stream ", stream, " has ", info.BPP,
+		       " byte pixels instead of ", BPP, ".");
+  allocate(info.width, info.height, info.BPP, reader.getNumFrames(stream));
+  for (uint i=0; i<m_nFrames; ++i) {
+    reader.readFrame(stream, i, getFrame(i));
+    const ChunkHeader& chunk = reader.getChunkHeader(stream, i);
+    m_info[i] = FrameInfo{chunk.timestamp, int(chunk.frameIndex),
+			  chunk.hostTimestamp};
+  }
+  m_currentFrame = 0;
 }
 
 uint Frames::getWidth() { return m_width; }
 
 uint Frames::getHeight() { return m_height; }
 
+uint Frames::getBPP() { return m_BPP; }
+
 uint Frames::getNumFrames() { return m_nFrames; }
 
 uint Frames::getFrameIndex() { return m_currentFrame; }
@@ -134,26 +245,63 @@ void* Frames::getFrame(int iFrame){
   return static_cast<void *>(pFrame);
 }
 
-void Frames::copyFrameTo(void* pDst, int iFrame, int offset, int padding) {
+const FrameInfo& Frames::getFrameInfo(int iFrame) {
+  if (iFrame < 0)
+    iFrame = m_currentFrame;
+  if (iFrame >= m_nFrames)
+    throw RuntimeError(__func__, ":Invalid frame number ",
+		       iFrame, ". (< ", m_nFrames, ").");
+  return m_info[iFrame];
+}
+
+FrameView Frames::getFrameView(int iFrame) {
+  const void* pData = getFrame(iFrame);
+  const FrameInfo& info = getFrameInfo(iFrame);
+  FrameView frame(std::shared_ptr<const void>(), pData, m_width, m_height,
+		  m_width * m_BPP, m_BPP, info.timestamp, info.frameIndex,
+		  (iFrame < 0 ? m_currentFrame : iFrame) + 1);
+  frame.setHostTimestamp(info.hostTimestamp);
+  return frame;
+}
+
+void Frames::store(const FrameView& frame, ThreadPool* pool) {
+  if (frame.getWidth() != m_width || frame.getHeight() != m_height ||
+      frame.getBPP() != m_BPP)
+    throw RuntimeError(__func__, ": Frame size ", frame.getWidth(), "x",
+		       frame.getHeight(), "x", frame.getBPP(),
+		       " does not match.");
+  frame.copyTo(getFrame(), 0, 0, pool);
+  m_info[m_currentFrame] = FrameInfo{frame.getTimestamp(),
+				     frame.getFrameIndex(),
+				     frame.getHostTimestamp()};
+  incrementFrameIndex();
+}
+
+void Frames::copyFrameTo(void* pDst, int iFrame, int offset, int padding,
+			 ThreadPool* pool, uint dstStride) {
   const void *pSrc = static_cast<const void *>(getFrame(iFrame));
-  ::copyFrame(pSrc, pDst, m_width, m_height, m_BPP, offset, padding);
+  ::copyFrame(pSrc, pDst, m_width, m_height, m_BPP, offset, padding, pool,
+	      dstStride);
 }
 
-void Frames::copyCurrentFrameTo(void* pDst, int offset, int padding) {
-  copyFrameTo(pDst, -1, offset, padding);
+void Frames::copyCurrentFrameTo(void* pDst, int offset, int padding,
+				ThreadPool* pool) {
+  copyFrameTo(pDst, -1, offset, padding, pool);
 }
 
 void Frames::convert16BitFrameToJet(uint8_t* pDst, int iFrame,
 				    const uint16_t v_min, const uint16_t v_max,
-				    const uint format) {
+				    const uint format, ThreadPool* pool,
+				    uint dstStride) {
   const uint16_t *pSrc = static_cast<const uint16_t *>(getFrame(iFrame));
-  ::convert16BitFrameToJet(pSrc, pDst, m_width, m_height, format, v_min, v_max);
+  ::convert16BitFrameToJet(pSrc, pDst, m_width, m_height, format, v_min, v_max,
+			   pool, dstStride);
 }
 
 void Frames::convertCurrent16BitFrameToJet(uint8_t *pDst,
 				    const uint16_t v_min, const uint16_t v_max,
-				    const uint format) {
-  convert16BitFrameToJet(pDst, -1, v_min, v_max, format);
+				    const uint format, ThreadPool* pool) {
+  convert16BitFrameToJet(pDst, -1, v_min, v_max, format, pool);
 }
 
 RGBDFrames::RGBDFrames()
@@ -170,9 +318,20 @@ void RGBDFrames::deallocate() {
   m_colorFrames.deallocate();
 }
 
-void RGBDFrames::allocate(uint depthW, uint depthH, uint colorW, uint colorH, uint nFrames) {
-  m_depthFrames.allocate(depthW, depthH, 2, nFrames);
-  m_colorFrames.allocate(colorW, colorH, 3, nFrames);
+void RGBDFrames::allocate(uint depthW, uint depthH, uint colorW, uint colorH, uint nFrames,
+			  FrameArena* pArena) {
+  m_depthFrames.allocateFrames(depthW, depthH, nFrames, pArena);
+  m_colorFrames.allocateFrames(colorW, colorH, nFrames, pArena);
+}
+
+void RGBDFrames::load(const RecordingReader& reader) {
+  int depthStream = reader.findStream(RECORDING_SENSOR_DEPTH);
+  int colorStream = reader.findStream(RECORDING_SENSOR_COLOR);
+  if (depthStream < 0 || colorStream < 0)
+    throw RuntimeError(__func__, ": Recording does not have both depth and ",
+		       "color streams.");
+  m_depthFrames.load(reader, depthStream);
+  m_colorFrames.load(reader, colorStream);
 }
 
 uint RGBDFrames::getNumFrames() {
@@ -193,30 +352,75 @@ void RGBDFrames::setFrameIndex(int iFrame) {
   m_colorFrames.setFrameIndex(iFrame);
 }
 
+uint RGBDFrames::getDepthWidth() {
+  return m_depthFrames.getWidth();
+}
+
+uint RGBDFrames::getDepthHeight() {
+  return m_depthFrames.getHeight();
+}
+
+uint RGBDFrames::getColorWidth() {
+  return m_colorFrames.getWidth();
+}
+
+uint RGBDFrames::getColorHeight() {
+  return m_colorFrames.getHeight();
+}
+
+FrameBuffer<Depth16>& RGBDFrames::getDepthFrames() {
+  return m_depthFrames;
+}
+
+FrameBuffer<RGB888>& RGBDFrames::getColorFrames() {
+  return m_colorFrames;
+}
+
 uint8_t* RGBDFrames::getColorFrame(int iFrame) {
-  return static_cast<uint8_t *>(m_colorFrames.getFrame(iFrame));
+  return reinterpret_cast<uint8_t *>(m_colorFrames.getFrame(iFrame));
 }
 
 uint16_t* RGBDFrames::getDepthFrame(int iFrame) {
-  return static_cast<uint16_t *>(m_depthFrames.getFrame(iFrame));
+  return reinterpret_cast<uint16_t *>(m_depthFrames.getFrame(iFrame));
+}
+
+const FrameInfo& RGBDFrames::getColorFrameInfo(int iFrame) {
+  return m_colorFrames.getFrameInfo(iFrame);
+}
+
+const FrameInfo& RGBDFrames::getDepthFrameInfo(int iFrame) {
+  return m_depthFrames.getFrameInfo(iFrame);
+}
+
+int64_t RGBDFrames::getSyncSkew(int iFrame) {
+  return int64_t(getDepthFrameInfo(iFrame).timestamp -
+		 getColorFrameInfo(iFrame).timestamp);
 }
 
 void RGBDFrames::copyDepthFrameTo(uint16_t* pDst, int iFrame,
-				  uint offset, uint padding) {
-  m_depthFrames.copyFrameTo(pDst, iFrame, offset, padding);
+				  uint offset, uint padding, ThreadPool* pool,
+				  uint dstStride) {
+  m_depthFrames.copyFrameTo(pDst, iFrame, offset, padding, pool, dstStride);
 }
 
 void RGBDFrames::copyColorFrameTo(uint8_t* pDst, int iFrame,
-				  uint offset, uint padding) {
-  m_colorFrames.copyFrameTo(pDst, iFrame, offset, padding);
-};
+				  uint offset, uint padding, ThreadPool* pool,
+				  uint dstStride) {
+  if (1 == offset && 1 == padding) { // SDL_PIXELFORMAT_BGRA8888
+    m_colorFrames.convertTo(reinterpret_cast<BGRA8888 *>(pDst), iFrame, pool,
+			    dstStride);
+    return;
+  }
+  m_colorFrames.copyFrameTo(pDst, iFrame, offset, padding, pool, dstStride);
+}
 
 void RGBDFrames::convert16BitFrameToJet(uint8_t* pDst, int iFrame,
 					const uint16_t v_min,
 					const uint16_t v_max,
-					const uint color_format) {
-  uint width = m_depthFrames.getWidth();
-  uint height = m_depthFrames.getHeight();
-  const uint16_t *pSrc = getDepthFrame(iFrame);
-  ::convert16BitFrameToJet(pSrc, pDst, width, height, color_format, v_min, v_max);
+					const uint color_format,
+					ThreadPool* pool, uint dstStride) {
+  if (1 != color_format)
+    throw RuntimeError(__func__, ":Not implemented for format ", color_format);
+  m_depthFrames.convertToJet(reinterpret_cast<BGRA8888 *>(pDst), iFrame,
+			     v_min, v_max, pool, dstStride);
 }
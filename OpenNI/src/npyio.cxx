@@ -0,0 +1,92 @@
+#include "npyio.hpp"
+#include "io.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#define NPY_MAGIC     "\x93NUMPY"
+#define NPY_ALIGNMENT 64 // Header size including the preamble
+
+NpyWriter::NpyWriter()
+  : m_pFile(NULL)
+  , m_path()
+  , m_nBytes(0)
+  , m_nWritten(0)
+{}
+
+NpyWriter::~NpyWriter() {
+  if (m_pFile)
+    std::fclose(m_pFile);
+}
+
+void NpyWriter::open(const char* path, const char* descr, uint itemSize,
+		     const std::vector<uint64_t>& shape) {
+  if (m_pFile)
+    throw RuntimeError(__func__, ": ", m_path, " is already open.");
+  // Header: magic, version 1.0, uint16 header length, then a Python dict
+  // padded with spaces and ended by a newline.
+  std::string dict = std::string("{'descr': '") + descr +
+    "', 'fortran_order': False, 'shape': (";
+  m_nBytes = itemSize;
+  for (uint64_t dim : shape) {
+    dict += std::to_string(dim) + ", ";
+    m_nBytes *= dim;
+  }
+  if (!shape.empty()) // Strip ", " but keep the comma of (N,)
+    dict.resize(dict.size() - ((1 < shape.size()) ? 2 : 1));
+  dict += "), }";
+  const size_t preamble = sizeof(NPY_MAGIC) - 1 + 2 + 2;
+  size_t headerSize = preamble + dict.size() + 1;
+  headerSize = (headerSize + NPY_ALIGNMENT - 1) / NPY_ALIGNMENT * NPY_ALIGNMENT;
+  if (headerSize - preamble > 0xffff)
+    throw RuntimeError(__func__, ": Too many dimensions for ", path, ".");
+  dict.resize(headerSize - preamble - 1, ' ');
+  dict += '\n';
+
+  m_pFile = std::fopen(path, "wb");
+  if (!m_pFile)
+    throw RuntimeError(__func__, ": Failed to open ", path, ": ",
+		       std::string(strerror(errno)));
+  m_path = path;
+  m_nWritten = 0;
+  const uint8_t version[2] = {1, 0};
+  const uint8_t length[2] = {uint8_t(dict.size() & 0xff),
+			     uint8_t(dict.size() >> 8)};
+  try {
+    write(NPY_MAGIC, sizeof(NPY_MAGIC) - 1);
+    write(version, sizeof(version));
+    write(length, sizeof(length));
+    write(dict.data(), dict.size());
+  } catch (...) {
+    std::fclose(m_pFile);
+    m_pFile = NULL;
+    throw;
+  }
+  m_nWritten = 0;
+}
+
+bool NpyWriter::isOpen() const {
+  return NULL != m_pFile;
+}
+
+void NpyWriter::write(const void* pData, size_t size) {
+  if (!m_pFile)
+    throw RuntimeError(__func__, ": File is not open.");
+  if (size != std::fwrite(pData, 1, size, m_pFile))
+    throw RuntimeError(__func__, ": Failed to write to ", m_path, ": ",
+		       std::string(strerror(errno)));
+  m_nWritten += size;
+}
+
+void NpyWriter::close() {
+  if (!m_pFile)
+    return;
+  int ret = std::fclose(m_pFile);
+  m_pFile = NULL;
+  if (ret)
+    throw RuntimeError(__func__, ": Failed to close ", m_path, ": ",
+		       std::string(strerror(errno)));
+  if (m_nWritten != m_nBytes)
+    throw RuntimeError(__func__, ": ", m_path, " has ", m_nWritten, " of ",
+		       m_nBytes, " bytes.");
+}
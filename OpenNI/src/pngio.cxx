@@ -0,0 +1,61 @@
+#include "pngio.hpp"
+#include "io.hpp"
+
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <png.h>
+
+void readPNG(const char* path, std::vector<uint8_t>& data,
+	     uint& width, uint& height, uint& BPP) {
+  std::FILE* pFile = std::fopen(path, "rb");
+  if (!pFile)
+    throw RuntimeError(__func__, ": Failed to open ", path, ": ",
+		       std::string(strerror(errno)));
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+					   NULL, NULL, NULL);
+  png_infop info = png ? png_create_info_struct(png) : NULL;
+  if (!info) {
+    png_destroy_read_struct(&png, NULL, NULL);
+    std::fclose(pFile);
+    throw RuntimeError(__func__, ": Failed to create PNG decoder.");
+  }
+  std::vector<png_bytep> rows;
+  if (setjmp(png_jmpbuf(png))) {
+    png_destroy_read_struct(&png, &info, NULL);
+    std::fclose(pFile);
+    throw RuntimeError(__func__, ": Failed to decode ", path, ".");
+  }
+  png_init_io(png, pFile);
+  png_read_info(png, info);
+  int colorType = png_get_color_type(png, info);
+  int bitDepth = png_get_bit_depth(png, info);
+  if (PNG_COLOR_TYPE_PALETTE == colorType)
+    png_set_palette_to_rgb(png);
+  if (PNG_COLOR_TYPE_GRAY == colorType && bitDepth < 8)
+    png_set_expand_gray_1_2_4_to_8(png);
+  if (colorType & PNG_COLOR_MASK_ALPHA)
+    png_set_strip_alpha(png);
+  if (16 == bitDepth && (colorType & PNG_COLOR_MASK_COLOR))
+    png_set_strip_16(png);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (16 == bitDepth)
+    png_set_swap(png);
+#endif
+  png_read_update_info(png, info);
+
+  width = png_get_image_width(png, info);
+  height = png_get_image_height(png, info);
+  size_t rowSize = png_get_rowbytes(png, info);
+  BPP = rowSize / width;
+  data.resize(rowSize * height);
+  rows.resize(height);
+  for (uint y=0; y<height; ++y)
+    rows[y] = data.data() + y * rowSize;
+  png_read_image(png, rows.data());
+  png_read_end(png, NULL);
+  png_destroy_read_struct(&png, &info, NULL);
+  std::fclose(pFile);
+}
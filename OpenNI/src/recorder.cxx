@@ -1,139 +1,527 @@
 #include "RGBDVisualizer.hpp"
+#include "ThreadPool.hpp"
+#include "FrameRecorder.hpp"
 #include "NIDevice.hpp"
+#include "FrameArena.hpp"
+#include "Player.hpp"
 #include "io.hpp"
 
+#include <atomic>
 #include <string>
+#include <thread>
+#include <exception>
 #include <stdexcept>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/resource.h>
 
 #define DEFAULT_DEPTH_MODE 0
 #define DEFAULT_COLOR_MODE 0
 #define DEFAULT_IR_MODE    -1
 #define DEFAULT_NUM_FRAMES 9000
+#define DEFAULT_NUM_THREADS 0
+#define DEFAULT_PLAYBACK_SPEED 1.0
+#define MAX_PREFAULT_SHARE 0.5 // of the physical memory a ring may prefault
 
-void listModes() {
+void listModes(const char* device) {
   NIDevice nid;
-  nid.openDevice();
+  nid.openDevice(device);
   nid.listAllSensorModes();
 }
 
-void recordIR(uint nFrames, int IRMode) {
+StreamInfo getStreamInfo(const NIDevice& nid, const openni::SensorType type,
+			 const bool bCompress) {
+  StreamInfo info;
+  info.sensorType = type;
+  info.pixelFormat = nid.getPixelFormat(type);
+  info.width = nid.getWidth(type);
+  info.height = nid.getHeight(type);
+  info.BPP = getBytesPerPixel(nid.getPixelFormat(type));
+  info.minValue = nid.getMinValue(type);
+  info.maxValue = nid.getMaxValue(type);
+  // 16 bit depth and IR compress losslessly, color is kept raw.
+  info.codec = (bCompress && 2 == info.BPP) ? CODEC_DEPTH_RLZ : CODEC_RAW;
+  return info;
+}
+
+void printStageStats(const char* name, uint maxQueued, uint queueSize,
+		     uint64_t nDropped) {
+  printf("  %-16s: max queue depth %3u/%-3u, dropped %llu\n",
+	 name, maxQueued, queueSize, (unsigned long long)nDropped);
+}
+
+void printRecorderStats(const FrameRecorder& recorder) {
+  printStageStats("encode", recorder.getMaxEncodeQueued(),
+		  recorder.getNumSlots(), recorder.getNumDropped());
+  printStageStats("write", recorder.getMaxWriteQueued(),
+		  recorder.getNumSlots(), 0);
+  printf("Wrote %llu frames.\n", (unsigned long long)recorder.getNumWritten());
+  if (0 < recorder.getNumBytes())
+    printf("Wrote %.1f MB of %.1f MB frame data (%.2fx).\n",
+	   recorder.getNumBytes() / 1e6, recorder.getNumRawBytes() / 1e6,
+	   double(recorder.getNumRawBytes()) / recorder.getNumBytes());
+}
+
+//! Page faults of this process so far.
+uint64_t getPageFaults() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+  return uint64_t(usage.ru_minflt) + usage.ru_majflt;
+}
+
+//!
+//! Flags of the arena of a ring of size byte. The ring is prefaulted only if
+//! bPrefault and it takes at most MAX_PREFAULT_SHARE of the physical memory,
+//! else its pages are faulted in as capture fills them.
+//!
+uint getRingArenaFlags(size_t size, bool bPrefault) {
+  if (!bPrefault)
+    return ARENA_HUGE_PAGES;
+  const double memory =
+    double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+  if (0 < memory && MAX_PREFAULT_SHARE * memory < size) {
+    printf("Ring of %.1f MB exceeds %.0f%% of %.1f MB memory, "
+	   "not prefaulting it.\n", size / 1e6, MAX_PREFAULT_SHARE * 100,
+	   memory / 1e6);
+    return ARENA_HUGE_PAGES;
+  }
+  return ARENA_HUGE_PAGES | ARENA_PREFAULT;
+}
+
+//! " | " and the latency summary of NIDevice if bShow, else "".
+std::string getStatsTitle(NIDevice& nid, bool bShow) {
+  return (bShow) ? " | " + nid.getStreamStatsSummary() : std::string();
+}
+
+//!
+//! Call capture() on a capture thread for every new set of frames, then
+//! updateTitle(), and run the render loop of visualizer on this thread
+//! until the window is closed, so presentation never delays capture.
+//! capture() publishes the previews to visualizer. The stop state of
+//! visualizer is cleared on return.
+//! @param maxFPS Display frame rate cap, 0 for none.
+//! @return Number of frame sets captured.
+//! @throw The first exception thrown by capture().
+//!
+uint64_t runCaptureLoop(NIDevice& nid, RGBDVisualizer& visualizer,
+			const std::function<void()>& capture,
+			const std::function<void()>& updateTitle,
+			uint maxFPS, ThreadPool* pool) {
+  std::atomic<bool> bStop(false);
+  std::atomic<uint64_t> nCaptured(0);
+  std::exception_ptr error;
+  const uint64_t nFaults = getPageFaults();
+  std::thread captureThread([&](){
+      try {
+	while (!bStop) {
+	  if (!nid.waitForFrames())
+	    continue;
+	  capture();
+	  ++nCaptured;
+	  updateTitle();
+	}
+      } catch (...) {
+	error = std::current_exception();
+	visualizer.stop();
+      }
+    });
+  visualizer.run(maxFPS, pool);
+  bStop = true;
+  captureThread.join();
+  // The quit event ends capture only, the window goes on with playback
+  visualizer.resetStop();
+  if (error)
+    std::rethrow_exception(error);
+  printf("Page faults during capture: %llu\n",
+	 (unsigned long long)(getPageFaults() - nFaults));
+  return nCaptured;
+}
+
+//!
+//! Keys of playback: space pauses, left and right step, up and down double
+//! and halve the speed, f toggles unthrottled playback, home restarts.
+//!
+class PlaybackControl : public EventHandler {
+  Player& m_player;
+
+public:
+  PlaybackControl(Player& player) : m_player(player) {};
+
+  virtual void onKeyDown(const SDL_Keysym& key) {
+    switch (key.sym) {
+    case SDLK_SPACE:
+      m_player.setPaused(!m_player.isPaused());
+      break;
+    case SDLK_RIGHT:
+    case SDLK_PERIOD:
+      m_player.step(1);
+      break;
+    case SDLK_LEFT:
+    case SDLK_COMMA:
+      m_player.step(-1);
+      break;
+    case SDLK_UP:
+      m_player.setSpeed(std::min(2.0 * m_player.getSpeed(),
+				 MAX_PLAYBACK_SPEED));
+      break;
+    case SDLK_DOWN:
+      m_player.setSpeed(std::max(0.5 * m_player.getSpeed(),
+				 MIN_PLAYBACK_SPEED));
+      break;
+    case SDLK_f:
+      m_player.setUnthrottled(!m_player.isUnthrottled());
+      break;
+    case SDLK_HOME:
+      m_player.seek(0);
+      break;
+    }
+  };
+};
+
+//!
+//! Show the frame sets of source until the window is closed: stream 0 on
+//! the left (16 bit through the jet colormap from leftMin to leftMax),
+//! stream 1 on the right.
+//! @param speed Playback speed, 0 for as fast as possible.
+//!
+void runPlayback(PlaybackSource& source, RGBDVisualizer& visualizer,
+		 ThreadPool& pool, uint16_t leftMin, uint16_t leftMax,
+		 double speed) {
+  Player player;
+  PlaybackControl control(player);
+  if (0.0 < speed)
+    player.setSpeed(speed);
+  else
+    player.setUnthrottled(true);
+  player.open(&source);
+  // A quit event of an earlier loop on this window must not end playback
+  visualizer.resetStop();
+  visualizer.setEventHandler(&control);
+  PlaybackFrame frames;
+  while (!visualizer.isStopped()) {
+    if (!player.next(frames, std::chrono::milliseconds(EVENT_POLL_INTERVAL)))
+      continue;
+    for (uint i=0; i<frames.frames.size() && i<N_VISUALIZER_REGIONS; ++i) {
+      const FrameView& frame = frames.frames[i];
+      if (!frame.isValid())
+	continue;
+      TextureLock region = (REGION_DEPTH == i) ?
+	visualizer.lockDepthRegion() : visualizer.lockColorRegion();
+      if (2 == frame.getBPP())
+	frame.convert16BitFrameToJet(region.getPixels(), leftMin, leftMax, 1,
+				     &pool, region.getPitch());
+      else
+	frame.copyTo(region.getPixels(), 1, 1, &pool, region.getPitch());
+    }
+    char speedText[16];
+    snprintf(speedText, sizeof(speedText), "x%.2f", player.getSpeed());
+    visualizer.setWindowTitle("Frame %5llu/%5llu %s",
+			      (unsigned long long)frames.index + 1,
+			      (unsigned long long)player.getNumFrames(),
+			      player.isPaused() ? "paused" :
+			      player.isUnthrottled() ? "unthrottled" :
+			      speedText);
+    visualizer.refreshWindow();
+  }
+  visualizer.setEventHandler(NULL);
+  player.close();
+  printf("Playback stalled on %llu frames.\n",
+	 (unsigned long long)player.getNumStalls());
+}
+
+//!
+//! Depth stream of reader with its value range, else its IR stream with the
+//! default IR range. -1 if it has neither.
+//!
+int findLeftStream(const RecordingReader& reader,
+		   uint16_t& minValue, uint16_t& maxValue) {
+  int stream = reader.findStream(RECORDING_SENSOR_DEPTH);
+  if (stream < 0) {
+    minValue = DEFAULT_IR_MIN; maxValue = DEFAULT_IR_MAX;
+    return reader.findStream(RECORDING_SENSOR_IR);
+  }
+  minValue = reader.getStreamInfo(stream).minValue;
+  maxValue = reader.getStreamInfo(stream).maxValue;
+  return stream;
+}
+
+//!
+//! Play the open reader back in the window of visualizer, depth (or IR) on
+//! the left and color on the right. The window must fit the streams.
+//!
+void playRecording(RecordingReader& reader, RGBDVisualizer& visualizer,
+		   ThreadPool& pool, uint nThreads, double speed) {
+  uint16_t leftMin, leftMax;
+  int leftStream = findLeftStream(reader, leftMin, leftMax);
+  int colorStream = reader.findStream(RECORDING_SENSOR_COLOR);
+  // Compressed frames are decoded on their own pool while others are shown
+  ThreadPool decodePool(nThreads);
+  RecordingSource source(reader, {leftStream, colorStream}, &decodePool);
+  runPlayback(source, visualizer, pool, leftMin, leftMax, speed);
+}
+
+void playRecording(const char* path, uint nThreads, double speed) {
+  RecordingReader reader;
+  RGBDVisualizer visualizer;
+  ThreadPool pool(nThreads);
+  reader.open(path);
+  uint16_t leftMin, leftMax;
+  int leftStream = findLeftStream(reader, leftMin, leftMax);
+  int colorStream = reader.findStream(RECORDING_SENSOR_COLOR);
+  uint wLeft = 0, hLeft = 0, wColor = 0, hColor = 0;
+  uint64_t nFrames = 0;
+  if (0 <= leftStream) {
+    wLeft = reader.getStreamInfo(leftStream).width;
+    hLeft = reader.getStreamInfo(leftStream).height;
+    nFrames = reader.getNumFrames(leftStream);
+  }
+  if (0 <= colorStream) {
+    wColor = reader.getStreamInfo(colorStream).width;
+    hColor = reader.getStreamInfo(colorStream).height;
+    if (nFrames < reader.getNumFrames(colorStream))
+      nFrames = reader.getNumFrames(colorStream);
+  }
+  if (0 == nFrames)
+    throw RuntimeError(__func__, ": ", path, " has no frame.");
+  visualizer.initWindow(wLeft, hLeft, wColor, hColor);
+  playRecording(reader, visualizer, pool, nThreads, speed);
+}
+
+void streamIR(const char* device, const char* output, uint queueSize,
+	      bool bCompress, BackpressurePolicy recordPolicy,
+	      int IRMode, uint nThreads, uint maxFPS, bool bShowStats,
+	      double speed) {
+  NIDevice nid;
+  FrameRecorder recorder;
+  RGBDVisualizer visualizer;
+  ThreadPool pool(nThreads);
+  nid.openDevice(device);
+  nid.createIRStream(IRMode);
+  uint wIR = nid.getIRWidth();
+  uint hIR = nid.getIRHeight();
+  uint IRStream = recorder.addStream(getStreamInfo(nid, openni::SENSOR_IR,
+						   bCompress));
+  recorder.setBackpressurePolicy(recordPolicy);
+  recorder.open(output, queueSize, nThreads);
+  StreamStats& IRStats = nid.getStreamStats(openni::SENSOR_IR);
+  nid.startStreams();
+  nid.waitStreamsToGetReady();
+  visualizer.initWindow(wIR, hIR, 0, 0, 0 == maxFPS);
+  uint64_t nCaptured = runCaptureLoop(nid, visualizer, [&](){
+      FrameView frame = nid.getIRFrameView();
+      recorder.push(IRStream, frame);
+      visualizer.publish(REGION_DEPTH, frame, 0, 1024, &IRStats);
+    }, [&](){
+      visualizer.setWindowTitle("Frame %5llu (Dropped %llu)%s",
+				(unsigned long long)recorder.getNumPushed(),
+				(unsigned long long)recorder.getNumDropped(),
+				getStatsTitle(nid, bShowStats).c_str());
+    }, maxFPS, &pool);
+  nid.stopStreams();
+  recorder.close();
+  printf("Captured %llu frames.\n", (unsigned long long)nCaptured);
+  nid.printStreamStats();
+  printRecorderStats(recorder);
+
+  if (0 < recorder.getNumWritten()) {
+    // Play the file back in the capture window
+    RecordingReader reader;
+    reader.open(output);
+    playRecording(reader, visualizer, pool, nThreads, speed);
+  }
+}
+
+void streamRGBD(const char* device, const char* output, uint queueSize,
+		bool bCompress, BackpressurePolicy recordPolicy,
+		int depthMode, int colorMode, RegistrationMode registration,
+		bool bTemporalFilter, uint nThreads, uint maxFPS,
+		bool bShowStats, double speed) {
+  NIDevice nid;
+  FrameRecorder recorder;
+  RGBDVisualizer visualizer;
+  ThreadPool pool(nThreads);
+  uint wDepth = 0, hDepth = 0, wColor = 0, hColor = 0;
+  uint depthStream = 0, colorStream = 0;
+  uint16_t minDepth = DEFAULT_DEPTH_MIN, maxDepth = DEFAULT_DEPTH_MAX;
+  nid.openDevice(device);
+  if (-1 < depthMode) {
+    nid.createDepthStream(depthMode);
+    wDepth = nid.getDepthWidth();
+    hDepth = nid.getDepthHeight();
+    minDepth = nid.getDepthMinValue();
+    maxDepth = nid.getDepthMaxValue();
+    nid.setDepthTemporalFilter(bTemporalFilter);
+    depthStream = recorder.addStream(getStreamInfo(nid, openni::SENSOR_DEPTH,
+						   bCompress));
+  }
+  if (-1 < colorMode) {
+    nid.createColorStream(colorMode);
+    wColor = nid.getColorWidth();
+    hColor = nid.getColorHeight();
+    colorStream = recorder.addStream(getStreamInfo(nid, openni::SENSOR_COLOR,
+						   bCompress));
+  }
+  if (-1 < depthMode && -1 < colorMode) {
+    nid.setImageRegistrationMode(registration);
+    nid.setDepthColorSync();
+  }
+  recorder.setBackpressurePolicy(recordPolicy);
+  recorder.open(output, queueSize, nThreads);
+  StreamStats& depthStats = nid.getStreamStats(openni::SENSOR_DEPTH);
+  StreamStats& colorStats = nid.getStreamStats(openni::SENSOR_COLOR);
+  nid.startStreams();
+  nid.waitStreamsToGetReady();
+  visualizer.initWindow(wDepth, hDepth, wColor, hColor, 0 == maxFPS);
+  uint64_t nCaptured = runCaptureLoop(nid, visualizer, [&](){
+      if (-1 < colorMode) {
+	FrameView colorFrame = nid.getColorFrameView();
+	recorder.push(colorStream, colorFrame);
+	visualizer.publish(REGION_COLOR, colorFrame, 0, 0, &colorStats);
+      }
+      if (-1 < depthMode) {
+	FrameView depthFrame = nid.getDepthFrameView();
+	recorder.push(depthStream, depthFrame);
+	visualizer.publish(REGION_DEPTH, depthFrame, minDepth, maxDepth,
+			   &depthStats);
+      }
+    }, [&](){
+      visualizer.setWindowTitle("Frame %5llu (Dropped %llu)%s",
+				(unsigned long long)recorder.getNumPushed(),
+				(unsigned long long)recorder.getNumDropped(),
+				getStatsTitle(nid, bShowStats).c_str());
+    }, maxFPS, &pool);
+  nid.stopStreams();
+  recorder.close();
+  printf("Captured %llu frame sets.\n", (unsigned long long)nCaptured);
+  nid.printStreamStats();
+  printRecorderStats(recorder);
+
+  if (0 < recorder.getNumWritten()) {
+    // Play the file back in the capture window
+    RecordingReader reader;
+    reader.open(output);
+    playRecording(reader, visualizer, pool, nThreads, speed);
+  }
+}
+
+void recordIR(const char* device, uint nFrames,
+	      int IRMode, bool bPrefault, uint nThreads, uint maxFPS,
+	      bool bShowStats, double speed) {
   NIDevice nid;
+  FrameArena arena;
   Frames IRFrame;
   RGBDVisualizer visualizer;
-  nid.openDevice();
+  ThreadPool pool(nThreads);
+  nid.openDevice(device);
   nid.createIRStream(IRMode);
   uint wIR = nid.getIRWidth();
   uint hIR = nid.getIRHeight();
   uint cIR = nid.getIRNumChannels();
-  if (3 == cIR)
-    IRFrame.allocate(wIR, hIR, 3, nFrames);
-  else
-    IRFrame.allocate(wIR, hIR, 2, nFrames);
+  uint BPP = (3 == cIR) ? 3 : 2;
+  // With bPrefault, fault the ring in now rather than while capturing
+  size_t IRSize = FrameArena::getBlockSize(size_t(wIR) * hIR * BPP * nFrames);
+  arena.reserve(IRSize, getRingArenaFlags(IRSize, bPrefault));
+  IRFrame.allocate(wIR, hIR, BPP, nFrames, &arena);
+  StreamStats& IRStats = nid.getStreamStats(openni::SENSOR_IR);
   nid.startStreams();
   nid.waitStreamsToGetReady();
-  visualizer.initWindow(wIR, hIR, 0, 0);
-  uint iFrame = 0;
-  while (1) {
-    try {
-      nid.copyIRFrame(IRFrame.getFrame());
-      if (3 == cIR)
-	IRFrame.copyCurrentFrameTo(visualizer.getDepthBuffer(), 1, 1);
-      else
-	IRFrame.convertCurrent16BitFrameToJet(visualizer.getDepthBuffer(), 0, 1024);
-      IRFrame.incrementFrameIndex();
-      iFrame = (++iFrame) % nFrames;
-    } catch(const std::runtime_error& e) {
-      printf("%s/n", e.what());
-    }
-    visualizer.setWindowTitle("Frame %5d/%5d", iFrame+1, nFrames);
-    visualizer.refreshWindow();
-    if (visualizer.isStopped())
-      break;
-  }
+  visualizer.initWindow(wIR, hIR, 0, 0, 0 == maxFPS);
+  std::atomic<uint> iFrame(0);
+  uint64_t nCaptured = runCaptureLoop(nid, visualizer, [&](){
+      FrameView frame = nid.getIRFrameView();
+      IRFrame.store(frame);
+      iFrame = (iFrame + 1) % nFrames;
+      visualizer.publish(REGION_DEPTH, frame, 0, 1024, &IRStats);
+    }, [&](){
+      visualizer.setWindowTitle("Frame %5d/%5d%s", iFrame+1, nFrames,
+				getStatsTitle(nid, bShowStats).c_str());
+    }, maxFPS, &pool);
   nid.stopStreams();
+  printf("Captured %llu frames.\n", (unsigned long long)nCaptured);
+  nid.printStreamStats();
 
-  iFrame = 0;
-  while (1) {
-    if (3 == cIR)
-      IRFrame.copyFrameTo(visualizer.getDepthBuffer(), iFrame, 1, 1);
-    else
-      IRFrame.convert16BitFrameToJet(visualizer.getDepthBuffer(), iFrame, 0, 1024);
-    iFrame = (++iFrame) % nFrames;
-    visualizer.setWindowTitle("Frame %5d/%5d", iFrame+1, nFrames);
-    visualizer.refreshWindow();
-    visualizer.delay(20);
-    if (visualizer.isStopped()) {
-      break;
-    }
+  if (0 < nCaptured) {
+    FramesSource source({&IRFrame}, std::min<uint64_t>(nCaptured, nFrames));
+    runPlayback(source, visualizer, pool, DEFAULT_IR_MIN, DEFAULT_IR_MAX,
+		speed);
   }
   IRFrame.deallocate();
 }
 
-void recordRGBD(uint nFrames, int depthMode, int colorMode) {
+void recordRGBD(const char* device, uint nFrames,
+		int depthMode, int colorMode, RegistrationMode registration,
+		bool bTemporalFilter, bool bPrefault, uint nThreads,
+		uint maxFPS, bool bShowStats, double speed) {
   NIDevice nid;
-  Frames depthFrame, colorFrame;
+  FrameArena arena;
+  FrameBuffer<Depth16> depthFrame;
+  FrameBuffer<RGB888> colorFrame;
   RGBDVisualizer visualizer;
+  ThreadPool pool(nThreads);
   uint wDepth = 0, hDepth = 0, wColor = 0, hColor = 0;
   uint16_t minDepth = DEFAULT_DEPTH_MIN, maxDepth = DEFAULT_DEPTH_MAX;
-  nid.openDevice();
+  nid.openDevice(device);
   if (-1 < depthMode) {
     nid.createDepthStream(depthMode);
     wDepth = nid.getDepthWidth();
     hDepth = nid.getDepthHeight();
     minDepth = nid.getDepthMinValue();
     maxDepth = nid.getDepthMaxValue();
-    depthFrame.allocate(wDepth, hDepth, 2, nFrames);
+    nid.setDepthTemporalFilter(bTemporalFilter);
   }
   if (-1 < colorMode) {
     nid.createColorStream(colorMode);
     wColor = nid.getColorWidth();
     hColor = nid.getColorHeight();
-    colorFrame.allocate(wColor, hColor, 3, nFrames);
   }
+  // With bPrefault, fault the rings in now rather than while capturing
+  size_t depthSize = size_t(wDepth) * hDepth * sizeof(Depth16) * nFrames;
+  size_t colorSize = size_t(wColor) * hColor * sizeof(RGB888) * nFrames;
+  size_t ringSize = FrameArena::getBlockSize(depthSize) +
+    FrameArena::getBlockSize(colorSize);
+  arena.reserve(ringSize, getRingArenaFlags(ringSize, bPrefault));
+  if (-1 < depthMode)
+    depthFrame.allocateFrames(wDepth, hDepth, nFrames, &arena);
+  if (-1 < colorMode)
+    colorFrame.allocateFrames(wColor, hColor, nFrames, &arena);
   if (-1 < depthMode && -1 < colorMode) {
-    nid.setImageRegistration();
+    nid.setImageRegistrationMode(registration);
     nid.setDepthColorSync();
   }
+  StreamStats& depthStats = nid.getStreamStats(openni::SENSOR_DEPTH);
+  StreamStats& colorStats = nid.getStreamStats(openni::SENSOR_COLOR);
   nid.startStreams();
   nid.waitStreamsToGetReady();
-  visualizer.initWindow(wDepth, hDepth, wColor, hColor);
-  uint iFrame = 0;
-  while (1) {
-    try {
+  visualizer.initWindow(wDepth, hDepth, wColor, hColor, 0 == maxFPS);
+  std::atomic<uint> iFrame(0);
+  uint64_t nCaptured = runCaptureLoop(nid, visualizer, [&](){
       if (-1 < colorMode) {
-	nid.copyColorFrame(colorFrame.getFrame());
-	colorFrame.copyCurrentFrameTo(visualizer.getColorBuffer(), 1, 1);
-	colorFrame.incrementFrameIndex();
+	FrameView frame = nid.getColorFrameView();
+	colorFrame.store(frame);
+	visualizer.publish(REGION_COLOR, frame, 0, 0, &colorStats);
       }
       if (-1 < depthMode) {
-	nid.copyDepthFrame(depthFrame.getFrame());
-	depthFrame.convertCurrent16BitFrameToJet(visualizer.getDepthBuffer(), minDepth, maxDepth);
-	depthFrame.incrementFrameIndex();
+	FrameView frame = nid.getDepthFrameView();
+	depthFrame.store(frame);
+	visualizer.publish(REGION_DEPTH, frame, minDepth, maxDepth,
+			   &depthStats);
       }
-      iFrame = (++iFrame) % nFrames;
-    } catch(const std::runtime_error& e) {
-      printf("%s/n", e.what());
-    }
-    visualizer.setWindowTitle("Frame %5d/%5d", iFrame+1, nFrames);
-    visualizer.refreshWindow();
-    if (visualizer.isStopped())
-      break;
-  }
+      iFrame = (iFrame + 1) % nFrames;
+    }, [&](){
+      visualizer.setWindowTitle("Frame %5d/%5d%s", iFrame+1, nFrames,
+				getStatsTitle(nid, bShowStats).c_str());
+    }, maxFPS, &pool);
   nid.stopStreams();
+  printf("Captured %llu frame sets.\n", (unsigned long long)nCaptured);
+  nid.printStreamStats();
 
-  iFrame = 0;
-  while (1) {
-    if (-1 < colorMode)
-      colorFrame.copyFrameTo(visualizer.getColorBuffer(), iFrame, 1, 1);
-    if (-1 < depthMode)
-      depthFrame.convert16BitFrameToJet(visualizer.getDepthBuffer(), iFrame, minDepth, maxDepth);
-    iFrame = (++iFrame) % nFrames;
-    visualizer.setWindowTitle("Frame %5d/%5d", iFrame+1, nFrames);
-    visualizer.refreshWindow();
-    visualizer.delay(20);
-    if (visualizer.isStopped()) {
-      break;
-    }
+  if (0 < nCaptured) {
+    FramesSource source({(-1 < depthMode) ? &depthFrame : NULL,
+			 (-1 < colorMode) ? &colorFrame : NULL},
+			std::min<uint64_t>(nCaptured, nFrames));
+    runPlayback(source, visualizer, pool, minDepth, maxDepth, speed);
   }
   colorFrame.deallocate();
   depthFrame.deallocate();
@@ -145,16 +533,64 @@ struct Option {
   int IRMode = DEFAULT_IR_MODE;
   int depthMode = DEFAULT_DEPTH_MODE;
   int colorMode = DEFAULT_COLOR_MODE;
+  RegistrationMode registration = REGISTRATION_AUTO;
+  bool temporalFilter = false;
   uint nFrames = DEFAULT_NUM_FRAMES;
+  uint nThreads = DEFAULT_NUM_THREADS;
+  std::string output;
+  uint queueSize = DEFAULT_QUEUE_SIZE;
+  bool compress = true;
+  BackpressurePolicy recordPolicy = BACKPRESSURE_BLOCK;
+  std::string input;
+  std::string device;
+  bool showStats = false;
+  bool prefault = false;
+  double speed = DEFAULT_PLAYBACK_SPEED;
+  uint maxFPS = DEFAULT_MAX_FPS;
 };
 
 void printHelp() {
   printf("%-30s:%s\n", "--list-modes", "Show available camera modes and quit.");
   printf("%-30s:%s\n", "--help", "Show this message and quit.");
+  printf("%-30s:%s\n", "--device URI",
+	 "OpenNI device, replay://PATH or synthetic://WxH@FPS.");
   printf("%-30s:%s\n", "--ir-mode IR-MODE", "IR camera mode.");
   printf("%-30s:%s\n", "--depth-mode DEPTH-MODE", "Depth camera mode.");
   printf("%-30s:%s\n", "--color-mode COLOR-MODE", "Color camera mode.");
-  printf("%-30s:%s\n", "--n-frames N-FRAMES", "Number of frames.");}
+  printf("%-30s:%s\n", "--registration auto|device|host|off",
+	 "Where depth is registered to color. (auto)");
+  printf("%-30s:%s\n", "--temporal-filter",
+	 "Denoise depth over time, filling short holes.");
+  printf("%-30s:%s\n", "--n-frames N-FRAMES",
+	 "Number of frames kept in memory. Ignored with --output.");
+  printf("%-30s:%s\n", "--output PATH",
+	 "Stream frames to PATH instead of keeping them in memory.");
+  printf("%-30s:%s\n", "--prefault",
+	 "Fault the --n-frames ring in before capture, if it fits in memory.");
+  printf("%-30s:%s\n", "--queue-size N-FRAMES",
+	 "Number of frames buffered for --output.");
+  printf("%-30s:%s\n", "--no-compress",
+	 "Store depth and IR without compression in --output.");
+  printf("%-30s:%s\n", "--record-policy block|drop",
+	 "Wait or drop frames when --output is slow. (block)");
+  printf("%-30s:%s\n", "--play PATH", "Play a recording and quit.");
+  printf("%-30s:%s\n", "--speed SPEED",
+	 "Playback speed, 0.25 to 16. (1, 0: as fast as possible)");
+  printf("%-30s:%s\n", "--n-threads N-THREADS",
+	 "Number of conversion threads. (0: all cores)");
+  printf("%-30s:%s\n", "--max-fps FPS",
+	 "Display frame rate cap. (60, 0: vsync)");
+  printf("%-30s:%s\n", "--show-stats",
+	 "Show p99 latencies [ms] and drop rates in the window title.");
+}
+
+BackpressurePolicy parseBackpressurePolicy(const std::string& val) {
+  if (val == "block")
+    return BACKPRESSURE_BLOCK;
+  if (val == "drop")
+    return BACKPRESSURE_DROP;
+  throw std::runtime_error("Unknown backpressure policy " + val + ".");
+}
 
 Option parseArguments(int argc, char *argv[]) {
   Option opt;
@@ -198,6 +634,53 @@ Option parseArguments(int argc, char *argv[]) {
       i += 1;
       if (i == argc) goto fail2;
       opt.nFrames = std::stoi(argv[i]);
+    } else if (arg == "--device") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.device = argv[i];
+    } else if (arg == "--registration") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.registration = parseRegistrationMode(argv[i]);
+    } else if (arg == "--temporal-filter") {
+      opt.temporalFilter = true;
+    } else if (arg == "--show-stats") {
+      opt.showStats = true;
+    } else if (arg == "--prefault") {
+      opt.prefault = true;
+    } else if (arg == "--n-threads") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.nThreads = std::stoi(argv[i]);
+    } else if (arg == "--output") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.output = argv[i];
+    } else if (arg == "--play") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.input = argv[i];
+    } else if (arg == "--speed") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.speed = std::stod(argv[i]);
+      if (0.0 != opt.speed && (opt.speed < MIN_PLAYBACK_SPEED ||
+			       MAX_PLAYBACK_SPEED < opt.speed))
+	throw std::runtime_error("Speed must be 0 or in [0.25, 16].");
+    } else if (arg == "--queue-size") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.queueSize = std::stoi(argv[i]);
+    } else if (arg == "--no-compress") {
+      opt.compress = false;
+    } else if (arg == "--max-fps") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.maxFPS = std::stoi(argv[i]);
+    } else if (arg == "--record-policy") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.recordPolicy = parseBackpressurePolicy(argv[i]);
     } else {
       goto fail1;
     }
@@ -226,14 +709,30 @@ int main(int argc, char *argv[]) {
   int ret = 0;
   NIDevice::initONI();
   RGBDVisualizer::initSDL();
+  const char* device = opt.device.empty() ? NULL : opt.device.c_str();
   try {
     if (opt.listModes) {
-      listModes();
+      listModes(device);
+    } else if (!opt.input.empty()) {
+      playRecording(opt.input.c_str(), opt.nThreads, opt.speed);
+    } else if (!opt.output.empty()) {
+      if (opt.IRMode >= 0)
+	streamIR(device, opt.output.c_str(), opt.queueSize, opt.compress,
+		 opt.recordPolicy, opt.IRMode, opt.nThreads, opt.maxFPS,
+		 opt.showStats, opt.speed);
+      else
+	streamRGBD(device, opt.output.c_str(), opt.queueSize, opt.compress,
+		   opt.recordPolicy, opt.depthMode, opt.colorMode,
+		   opt.registration, opt.temporalFilter, opt.nThreads,
+		   opt.maxFPS, opt.showStats, opt.speed);
     } else {
       if (opt.IRMode >= 0)
-	recordIR(opt.nFrames, opt.IRMode);
+	recordIR(device, opt.nFrames, opt.IRMode, opt.prefault, opt.nThreads,
+		 opt.maxFPS, opt.showStats, opt.speed);
       else
-	recordRGBD(opt.nFrames, opt.depthMode, opt.colorMode);
+	recordRGBD(device, opt.nFrames, opt.depthMode, opt.colorMode,
+		   opt.registration, opt.temporalFilter, opt.prefault,
+		   opt.nThreads, opt.maxFPS, opt.showStats, opt.speed);
     }
   } catch (const std::exception& e) {
     printf("%s\n", e.what());
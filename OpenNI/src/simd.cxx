@@ -0,0 +1,112 @@
+#include "simd.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+static SIMDLevel detectSIMDLevel() {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  if (__builtin_cpu_supports("ssse3"))
+    return SIMD_SSSE3;
+#endif
+  return SIMD_NONE;
+}
+
+SIMDLevel getSIMDLevel() {
+  static const SIMDLevel level = detectSIMDLevel();
+  return level;
+}
+
+const char* getSIMDLevelString(const SIMDLevel level) {
+  switch (level) {
+  case SIMD_AVX2:
+    return "AVX2";
+  case SIMD_SSSE3:
+    return "SSSE3";
+  default:
+    return "None";
+  }
+}
+
+static void expand3To4Scalar(const uint8_t* pSrc, uint8_t* pDst,
+			     const size_t nPixels) {
+  for (size_t i=0; i<nPixels; ++i) {
+    pDst[0] = pSrc[0];
+    pDst[1] = pSrc[1];
+    pDst[2] = pSrc[2];
+    pSrc += 3; pDst += 4;
+  }
+}
+
+#ifdef SIMD_X86
+// The vector loops load and store whole registers, and keep the fourth byte
+// of each output pixel by blending with the destination. They stop early
+// enough that neither the source nor the destination is accessed beyond the
+// range the scalar loop touches; the remainder is handled by the scalar loop.
+
+__attribute__((target("ssse3")))
+static void expand3To4SSSE3(const uint8_t* pSrc, uint8_t* pDst,
+			    const size_t nPixels) {
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+					6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i keep = _mm_setr_epi8(0, 0, 0, -1, 0, 0, 0, -1,
+				     0, 0, 0, -1, 0, 0, 0, -1);
+  size_t i = 0;
+  for (; i + 6 <= nPixels; i += 4) {
+    __m128i src = _mm_loadu_si128((const __m128i*)(pSrc + 3 * i));
+    __m128i dst = _mm_loadu_si128((const __m128i*)(pDst + 4 * i));
+    dst = _mm_or_si128(_mm_and_si128(dst, keep), _mm_shuffle_epi8(src, shuffle));
+    _mm_storeu_si128((__m128i*)(pDst + 4 * i), dst);
+  }
+  expand3To4Scalar(pSrc + 3 * i, pDst + 4 * i, nPixels - i);
+}
+
+__attribute__((target("avx2")))
+static void expand3To4AVX2(const uint8_t* pSrc, uint8_t* pDst,
+			   const size_t nPixels) {
+  const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+					   6, 7, 8, -1, 9, 10, 11, -1,
+					   0, 1, 2, -1, 3, 4, 5, -1,
+					   6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i keep = _mm256_setr_epi8(0, 0, 0, -1, 0, 0, 0, -1,
+					0, 0, 0, -1, 0, 0, 0, -1,
+					0, 0, 0, -1, 0, 0, 0, -1,
+					0, 0, 0, -1, 0, 0, 0, -1);
+  size_t i = 0;
+  for (; i + 10 <= nPixels; i += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)(pSrc + 3 * i));
+    __m128i hi = _mm_loadu_si128((const __m128i*)(pSrc + 3 * i + 12));
+    __m256i src = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    __m256i dst = _mm256_loadu_si256((const __m256i*)(pDst + 4 * i));
+    dst = _mm256_or_si256(_mm256_and_si256(dst, keep),
+			  _mm256_shuffle_epi8(src, shuffle));
+    _mm256_storeu_si256((__m256i*)(pDst + 4 * i), dst);
+  }
+  expand3To4SSSE3(pSrc + 3 * i, pDst + 4 * i, nPixels - i);
+}
+#endif
+
+typedef void (*Expand3To4Fcn)(const uint8_t*, uint8_t*, const size_t);
+
+static Expand3To4Fcn selectExpand3To4() {
+#ifdef SIMD_X86
+  switch (getSIMDLevel()) {
+  case SIMD_AVX2:
+    return expand3To4AVX2;
+  case SIMD_SSSE3:
+    return expand3To4SSSE3;
+  default:
+    break;
+  }
+#endif
+  return expand3To4Scalar;
+}
+
+void expand3To4(const uint8_t* pSrc, uint8_t* pDst, const size_t nPixels) {
+  static const Expand3To4Fcn fcn = selectExpand3To4();
+  fcn(pSrc, pDst, nPixels);
+}
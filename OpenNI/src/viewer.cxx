@@ -1,99 +1,125 @@
 #include "io.hpp"
 #include "NIDevice.hpp"
 #include "RGBDVisualizer.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <thread>
+#include <functional>
 
 #define DEFAULT_DEPTH_MODE 0
 #define DEFAULT_COLOR_MODE 0
 #define DEFAULT_IR_MODE    -1
+#define DEFAULT_NUM_THREADS 0
+#define STATS_INTERVAL 500 // Window title update with --show-stats [ms]
 
-void listModes() {
+void listModes(const char* device) {
   NIDevice nid;
-  nid.openDevice();
+  nid.openDevice(device);
   nid.listAllSensorModes();
 }
 
-void viewIR(int IRMode) {
+//! Show the latency statistics in the window title every STATS_INTERVAL.
+void updateStatsTitle(NIDevice& nid, const RGBDVisualizer& visualizer,
+		      std::chrono::steady_clock::time_point& next) {
+  auto now = std::chrono::steady_clock::now();
+  if (now < next)
+    return;
+  next = now + std::chrono::milliseconds(STATS_INTERVAL);
+  visualizer.setWindowTitle("%s", nid.getStreamStatsSummary().c_str());
+}
+
+//!
+//! Call capture() on a capture thread for every new set of frames, and run
+//! the render loop of visualizer on this thread until the window is
+//! closed, so presentation never delays capture.
+//!
+void runViewLoop(NIDevice& nid, RGBDVisualizer& visualizer,
+		 const std::function<void()>& capture, uint maxFPS,
+		 ThreadPool* pool) {
+  std::atomic<bool> bStop(false);
+  std::thread captureThread([&](){
+      while (!bStop) {
+	if (!nid.waitForFrames())
+	  continue;
+	try {
+	  capture();
+	} catch(const std::exception& e) {
+	  printf("%s\n", e.what());
+	}
+      }
+    });
+  visualizer.run(maxFPS, pool);
+  bStop = true;
+  captureThread.join();
+}
+
+void viewIR(const char* device, int IRMode, uint nThreads, uint maxFPS,
+	    bool bShowStats) {
   NIDevice nid;
-  Frames frame;
   RGBDVisualizer visualizer;
-  nid.openDevice();
+  ThreadPool pool(nThreads);
+  nid.openDevice(device);
   nid.createIRStream(IRMode);
   uint wIR = nid.getIRWidth();
   uint hIR = nid.getIRHeight();
-  uint cIR = nid.getIRNumChannels();
   nid.startStreams();
   nid.waitStreamsToGetReady();
-  if (3 == cIR)
-    frame.allocate(wIR, hIR, 3, 1);
-  else
-    frame.allocate(wIR, hIR, 2, 1);
-  visualizer.initWindow(0, 0, wIR, hIR);
-  while (1) {
-    try {
-      nid.copyIRFrame(frame.getFrame());
-      if (3 == cIR)
-	frame.copyCurrentFrameTo(visualizer.getColorBuffer(), 1, 1);
-      else
-	frame.convertCurrent16BitFrameToJet(visualizer.getColorBuffer(), 0, 1024);
-    } catch(const std::exception& e) {
-      printf("%s\n", e.what());
-    }
-    visualizer.refreshWindow();
-    if (visualizer.isStopped())
-      break;
-  }
+  visualizer.initWindow(0, 0, wIR, hIR, 0 == maxFPS);
+  StreamStats& stats = nid.getStreamStats(openni::SENSOR_IR);
+  auto nextStats = std::chrono::steady_clock::now();
+  runViewLoop(nid, visualizer, [&](){
+      visualizer.publish(REGION_COLOR, nid.getIRFrameView(), 0, 1024, &stats);
+      if (bShowStats)
+	updateStatsTitle(nid, visualizer, nextStats);
+    }, maxFPS, &pool);
   nid.stopStreams();
-  frame.deallocate();
+  nid.printStreamStats();
 }
 
-void viewRGBD(int depthMode, int colorMode) {
+void viewRGBD(const char* device, int depthMode, int colorMode,
+	      RegistrationMode registration, uint nThreads, uint maxFPS,
+	      bool bShowStats) {
   NIDevice nid;
-  Frames depthFrame, colorFrame;
   RGBDVisualizer visualizer;
+  ThreadPool pool(nThreads);
   uint wDepth = 0, hDepth = 0, wColor = 0, hColor = 0;
   uint16_t minDepth = DEFAULT_DEPTH_MIN, maxDepth = DEFAULT_DEPTH_MAX;
-  nid.openDevice();
+  nid.openDevice(device);
  if (-1 < depthMode) {
     nid.createDepthStream(depthMode);
     wDepth = nid.getDepthWidth();
     hDepth = nid.getDepthHeight();
     minDepth = nid.getDepthMinValue();
     maxDepth = nid.getDepthMaxValue();
-    depthFrame.allocate(wDepth, hDepth, 2, 1);
   }
   if (-1 < colorMode) {
     nid.createColorStream(colorMode);
     wColor = nid.getColorWidth();
     hColor = nid.getColorHeight();
-    colorFrame.allocate(wColor, hColor, 3, 1);
   }
   if (-1 < depthMode && -1 < colorMode) {
-    nid.setImageRegistration();
+    nid.setImageRegistrationMode(registration);
     nid.setDepthColorSync();
   }
   nid.startStreams();
   nid.waitStreamsToGetReady();
-  visualizer.initWindow(wDepth, hDepth, wColor, hColor);
-  while (1) {
-    try {
-      if (-1 < colorMode) {
-	nid.copyColorFrame(colorFrame.getFrame());
-	colorFrame.copyCurrentFrameTo(visualizer.getColorBuffer(), 1, 1);
-      }
-      if (-1 < depthMode) {
-	nid.copyDepthFrame(depthFrame.getFrame());
-	depthFrame.convertCurrent16BitFrameToJet(visualizer.getDepthBuffer(), minDepth, maxDepth);
-      }
-    } catch(const std::exception& e) {
-      printf("%s\n", e.what());
-    }
-    visualizer.refreshWindow();
-    if (visualizer.isStopped())
-      break;
-  }
+  visualizer.initWindow(wDepth, hDepth, wColor, hColor, 0 == maxFPS);
+  StreamStats& colorStats = nid.getStreamStats(openni::SENSOR_COLOR);
+  StreamStats& depthStats = nid.getStreamStats(openni::SENSOR_DEPTH);
+  auto nextStats = std::chrono::steady_clock::now();
+  runViewLoop(nid, visualizer, [&](){
+      if (-1 < colorMode)
+	visualizer.publish(REGION_COLOR, nid.getColorFrameView(), 0, 0,
+			   &colorStats);
+      if (-1 < depthMode)
+	visualizer.publish(REGION_DEPTH, nid.getDepthFrameView(), minDepth,
+			   maxDepth, &depthStats);
+      if (bShowStats)
+	updateStatsTitle(nid, visualizer, nextStats);
+    }, maxFPS, &pool);
   nid.stopStreams();
-  colorFrame.deallocate();
-  depthFrame.deallocate();
+  nid.printStreamStats();
 }
 
 struct Option {
@@ -102,14 +128,29 @@ struct Option {
   int IRMode = DEFAULT_IR_MODE;
   int depthMode = DEFAULT_DEPTH_MODE;
   int colorMode = DEFAULT_COLOR_MODE;
+  RegistrationMode registration = REGISTRATION_AUTO;
+  uint nThreads = DEFAULT_NUM_THREADS;
+  uint maxFPS = DEFAULT_MAX_FPS;
+  std::string device;
+  bool showStats = false;
 };
 
 void printHelp() {
   printf("%-30s:%s\n", "--list-modes", "Show available camera modes and quit.");
   printf("%-30s:%s\n", "--help", "Show this message and quit.");
+  printf("%-30s:%s\n", "--device URI",
+	 "OpenNI device, replay://PATH or synthetic://WxH@FPS.");
   printf("%-30s:%s\n", "--ir-mode IR-MODE", "IR camera mode.");
   printf("%-30s:%s\n", "--depth-mode DEPTH-MODE", "Depth camera mode.");
   printf("%-30s:%s\n", "--color-mode COLOR-MODE", "Color camera mode.");
+  printf("%-30s:%s\n", "--registration auto|device|host|off",
+	 "Where depth is registered to color. (auto)");
+  printf("%-30s:%s\n", "--n-threads N-THREADS",
+	 "Number of conversion threads. (0: all cores)");
+  printf("%-30s:%s\n", "--max-fps FPS",
+	 "Display frame rate cap. (60, 0: vsync)");
+  printf("%-30s:%s\n", "--show-stats",
+	 "Show p99 latencies [ms] and drop rates in the window title.");
 }
 
 Option parseArguments(int argc, char *argv[]) {
@@ -150,6 +191,24 @@ Option parseArguments(int argc, char *argv[]) {
 	opt.colorMode = mode;
 	opt.IRMode = -1;
       }
+    } else if (arg == "--device") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.device = argv[i];
+    } else if (arg == "--registration") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.registration = parseRegistrationMode(argv[i]);
+    } else if (arg == "--show-stats") {
+      opt.showStats = true;
+    } else if (arg == "--n-threads") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.nThreads = std::stoi(argv[i]);
+    } else if (arg == "--max-fps") {
+      i += 1;
+      if (i == argc) goto fail2;
+      opt.maxFPS = std::stoi(argv[i]);
     } else {
       goto fail1;
     }
@@ -178,14 +237,16 @@ int main(int argc, char *argv[]) {
   int ret = 0;
   NIDevice::initONI();
   RGBDVisualizer::initSDL();
+  const char* device = opt.device.empty() ? NULL : opt.device.c_str();
   try{
     if (opt.listModes) {
-      listModes();
+      listModes(device);
     } else {
       if (opt.IRMode >= 0)
-	viewIR(opt.IRMode);
+	viewIR(device, opt.IRMode, opt.nThreads, opt.maxFPS, opt.showStats);
       else
-	viewRGBD(opt.depthMode, opt.colorMode);
+	viewRGBD(device, opt.depthMode, opt.colorMode, opt.registration,
+		 opt.nThreads, opt.maxFPS, opt.showStats);
     }
   } catch (const std::exception& e) {
     printf("%s\n", e.what());